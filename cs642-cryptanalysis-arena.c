@@ -0,0 +1,145 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-arena.c
+//  Description    : This is the scratch arena allocator for the cs642 first
+//                   project. Every thread gets one arena; an analysis reserves
+//                   what it needs from the ciphertext length, bumps pointers
+//                   out of it, and resets it when done. After the first few
+//                   samples the arena stops growing and cracking makes no heap
+//                   calls at all.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-arena.h"
+
+// Defines
+#define ARENA_MIN_CAPACITY 65536
+
+// Per-thread arena, freed by the key destructor when a worker exits
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+// Functions
+
+// Frees an arena and its memory
+static void destroyArena(void *arg) {
+  cs642Arena *arena = (cs642Arena *)arg;
+  if (arena != NULL) {
+    free(arena->base);
+    free(arena);
+  }
+}
+
+// Creates the thread-specific key holding the arenas
+static void createArenaKey(void) {
+  pthread_key_create(&arena_key, destroyArena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ScratchArena
+// Description  : Returns the calling thread's scratch arena, creating an empty
+//                one the first time a thread asks
+//
+// Inputs       : void
+// Outputs      : the arena, or NULL if it could not be created
+cs642Arena *cs642ScratchArena(void) {
+  pthread_once(&arena_key_once, createArenaKey);
+  cs642Arena *arena = pthread_getspecific(arena_key);
+  if (arena == NULL) {
+    arena = calloc(1, sizeof(cs642Arena));
+    if (arena == NULL || pthread_setspecific(arena_key, arena)) {
+      free(arena);
+      return (NULL);
+    }
+  }
+  return (arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ArenaReserve
+// Description  : Makes sure the arena holds at least bytes beyond what is
+//                already handed out. Growing moves the memory, so it is only
+//                allowed while nothing is handed out.
+//
+// Inputs       : arena - the arena
+//                bytes - the bytes the caller is about to allocate
+// Outputs      : 0 if successful, -1 if failure
+int cs642ArenaReserve(cs642Arena *arena, size_t bytes) {
+  if (arena == NULL) {
+    return (-1);
+  }
+  size_t needed = arena->used + bytes + CS642_ARENA_ALIGNMENT;
+  if (needed <= arena->capacity) {
+    return (0);
+  }
+  if (arena->used != 0) {
+    return (-1);
+  }
+
+  // Double up to the size needed so slightly longer samples do not regrow it
+  size_t capacity = (arena->capacity < ARENA_MIN_CAPACITY) ? ARENA_MIN_CAPACITY : arena->capacity;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  char *grown = realloc(arena->base, capacity);
+  if (grown == NULL) {
+    return (-1);
+  }
+  arena->base = grown;
+  arena->capacity = capacity;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ArenaAlloc
+// Description  : Bumps an aligned block of scratch out of the arena
+//
+// Inputs       : arena - the arena
+//                bytes - the size of the block
+// Outputs      : the block, or NULL if the arena is exhausted
+void *cs642ArenaAlloc(cs642Arena *arena, size_t bytes) {
+  uintptr_t start = ((uintptr_t)arena->base + arena->used + CS642_ARENA_ALIGNMENT - 1) & ~(uintptr_t)(CS642_ARENA_ALIGNMENT - 1);
+  size_t offset = start - (uintptr_t)arena->base;
+  if (arena->base == NULL || offset + bytes > arena->capacity) {
+    return (NULL);
+  }
+  arena->used = offset + bytes;
+  return ((void *)start);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ArenaReset
+// Description  : Releases every block handed out, keeping the memory for the
+//                next analysis
+//
+// Inputs       : arena - the arena
+// Outputs      : void
+void cs642ArenaReset(cs642Arena *arena) {
+  arena->used = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ReleaseScratchArena
+// Description  : Frees the calling thread's scratch arena (worker threads have
+//                theirs freed when they exit)
+//
+// Inputs       : void
+// Outputs      : void
+void cs642ReleaseScratchArena(void) {
+  pthread_once(&arena_key_once, createArenaKey);
+  destroyArena(pthread_getspecific(arena_key));
+  pthread_setspecific(arena_key, NULL);
+}
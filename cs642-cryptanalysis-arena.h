@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-arena.h
+//  Description    : This is an include file for the per-thread scratch arena
+//                   that the cryptanalysis paths borrow working memory from.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stddef.h>
+
+// Defines
+#define CS642_ARENA_ALIGNMENT 64 // Every block handed out starts on its own cache line
+
+//
+// Type definitions
+
+// Define struct and type for a bump allocated scratch arena
+struct cs642Arena {
+  char *base;      // Start of the arena memory
+  size_t capacity; // Bytes available in the arena
+  size_t used;     // Bytes handed out since the last reset
+};
+typedef struct cs642Arena cs642Arena;
+
+//
+// Arena functions
+
+cs642Arena *cs642ScratchArena(void);
+// Returns the calling thread's scratch arena (created on first use)
+
+int cs642ArenaReserve(cs642Arena *arena, size_t bytes);
+// Makes sure the arena can hand out bytes before the next reset. It may only
+// grow an arena with nothing handed out, so paths borrowing several blocks
+// reserve them together (CS642_ARENA_ALIGNMENT more per extra block).
+// Returns 0 if successful, -1 otherwise.
+
+void *cs642ArenaAlloc(cs642Arena *arena, size_t bytes);
+// Hands out bytes of cache line aligned scratch, or NULL if the reservation is
+// exceeded
+
+void cs642ArenaReset(cs642Arena *arena);
+// Releases everything handed out by the arena (the memory itself is kept)
+
+void cs642ReleaseScratchArena(void);
+// Frees the calling thread's scratch arena
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-candidates.c
+//  Description    : This is the candidate key heap for the cs642 first project.
+//                   The analyses offer every key they score; a min-heap bounded
+//                   at K keeps the K best distinct keys, so rejecting a key that
+//                   is no better than the worst one held costs one comparison.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-impl.h"
+#include "cs642-cryptanalysis-candidates.h"
+
+// Functions
+
+// Swaps two heap entries
+static void swapCandidates(cs642Candidate *a, cs642Candidate *b) {
+  cs642Candidate temp = *a;
+  *a = *b;
+  *b = temp;
+}
+
+// Moves the entry at index down until both children score at least as high
+static void siftCandidateDown(cs642CandidateHeap *heap, int index) {
+  for (;;) {
+    int smallest = index, left = 2 * index + 1, right = 2 * index + 2;
+    if (left < heap->size && heap->entries[left].score < heap->entries[smallest].score) {
+      smallest = left;
+    }
+    if (right < heap->size && heap->entries[right].score < heap->entries[smallest].score) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    swapCandidates(&heap->entries[index], &heap->entries[smallest]);
+    index = smallest;
+  }
+}
+
+// Moves the entry at index up while it scores lower than its parent
+static void siftCandidateUp(cs642CandidateHeap *heap, int index) {
+  while (index > 0 && heap->entries[index].score < heap->entries[(index - 1) / 2].score) {
+    swapCandidates(&heap->entries[index], &heap->entries[(index - 1) / 2]);
+    index = (index - 1) / 2;
+  }
+}
+
+// Function to compare two candidates for sorting by descending score
+static int compareCandidates(const void *a, const void *b) {
+  const cs642Candidate *candidateA = (const cs642Candidate *)a;
+  const cs642Candidate *candidateB = (const cs642Candidate *)b;
+  return (candidateB->score > candidateA->score) - (candidateB->score < candidateA->score);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642InitCandidateHeap
+// Description  : Initializes an empty candidate heap
+//
+// Inputs       : heap - the heap
+//                entries - storage for capacity candidates
+//                capacity - the number of candidates to keep (K)
+// Outputs      : void
+void cs642InitCandidateHeap(cs642CandidateHeap *heap, cs642Candidate *entries, int capacity) {
+  heap->entries = entries;
+  heap->capacity = capacity;
+  heap->size = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642OfferCandidate
+// Description  : Offers a scored key to the heap. The plaintext preview is only
+//                copied when the key is kept.
+//
+// Inputs       : heap - the heap
+//                key - the key (keylen characters)
+//                keylen - the length of the key
+//                score - the dictionary score of the key
+//                plaintext - the decryption under the key (for the preview)
+// Outputs      : 1 if the heap changed, 0 otherwise
+int cs642OfferCandidate(cs642CandidateHeap *heap, const char *key, int keylen, int score, const char *plaintext) {
+  if (heap->capacity <= 0 || keylen > CS642_CANDIDATE_KEY) {
+    return (0);
+  }
+  if (heap->size == heap->capacity && score <= heap->entries[0].score) {
+    return (0); // No better than the worst candidate held
+  }
+
+  // Keep keys distinct: a key seen again only has its score raised
+  for (int i = 0; i < heap->size; i++) {
+    if (heap->entries[i].keylen == keylen && memcmp(heap->entries[i].key, key, keylen) == 0) {
+      if (score <= heap->entries[i].score) {
+        return (0);
+      }
+      heap->entries[i].score = score;
+      siftCandidateDown(heap, i);
+      return (1);
+    }
+  }
+
+  // Add the key, replacing the worst candidate when the heap is full
+  int index = (heap->size < heap->capacity) ? heap->size++ : 0;
+  cs642Candidate *candidate = &heap->entries[index];
+  memcpy(candidate->key, key, keylen);
+  candidate->key[keylen] = '\0';
+  candidate->keylen = keylen;
+  candidate->score = score;
+  strncpy(candidate->preview, plaintext, CS642_CANDIDATE_PREVIEW);
+  candidate->preview[CS642_CANDIDATE_PREVIEW] = '\0';
+  if (index == 0 && heap->size == heap->capacity) {
+    siftCandidateDown(heap, 0);
+  } else {
+    siftCandidateUp(heap, index);
+  }
+  return (1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642SortCandidates
+// Description  : Sorts the candidates held by descending score
+//
+// Inputs       : heap - the heap
+// Outputs      : the number of candidates
+int cs642SortCandidates(cs642CandidateHeap *heap) {
+  qsort(heap->entries, heap->size, sizeof(cs642Candidate), compareCandidates);
+  return (heap->size);
+}
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-candidates.h
+//  Description    : This is an include file for the bounded heap that keeps the
+//                   best distinct candidate keys seen during an analysis.
+//                   Include it after cs642-cryptanalysis-impl.h.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+//
+// Type definitions
+
+// Define struct and type for a bounded min-heap of candidates (worst on top)
+struct cs642CandidateHeap {
+  cs642Candidate *entries; // Heap storage (capacity entries)
+  int capacity;            // Maximum number of candidates kept
+  int size;                // Number of candidates held
+};
+typedef struct cs642CandidateHeap cs642CandidateHeap;
+
+//
+// Candidate heap functions
+
+void cs642InitCandidateHeap(cs642CandidateHeap *heap, cs642Candidate *entries,
+                            int capacity);
+// Initializes an empty heap over caller provided storage
+
+int cs642OfferCandidate(cs642CandidateHeap *heap, const char *key, int keylen,
+                        int score, const char *plaintext);
+// Offers a scored key. It is kept if the heap has room or it beats the worst
+// candidate held; a key already held only has its score raised. Returns 1 if
+// the heap changed, 0 otherwise.
+
+int cs642SortCandidates(cs642CandidateHeap *heap);
+// Sorts the candidates held by descending score (this ends the heap) and
+// returns their number
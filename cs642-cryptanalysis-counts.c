@@ -0,0 +1,433 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-counts.c
+//  Description    : These are the text statistics counters of the cs642 first
+//                   project. A text is converted to letter codes a block at a
+//                   time and counted into several private banks, so runs of
+//                   the same letter or bigram do not wait on each other's
+//                   increments, and the banks are summed at the end. Large
+//                   texts are split into one slice per thread; each slice
+//                   starts from the two characters before it, so n-grams
+//                   crossing a slice boundary are counted exactly once.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-counts.h"
+#include "cs642-cryptanalysis-kernels.h"
+
+// Defines
+#define ALPHABET_SIZE CS642_COUNT_ALPHABET
+#define CODE_BLOCK 256             // Characters converted to letter codes at once
+#define COUNT_SLICE_MIN (1 << 20)  // Smallest slice of a text worth its own thread
+#define COUNT_MAX_THREADS 64
+#define LETTER_BANKS 4             // Private letter histograms per slice
+#define BIGRAM_BANKS 2             // Private bigram histograms per slice
+#define DENSE_SLICE_MIN 65536      // Slices long enough to count branch-free
+#define DENSE_CODES (ALPHABET_SIZE + 1) // Letter codes plus one bin for everything else
+#define DENSE_TRIGRAMS (DENSE_CODES * DENSE_CODES * DENSE_CODES)
+#define MAX_COLUMNS (CS642_COUNT_MAX_PERIOD * (CS642_COUNT_MAX_PERIOD + 1) / 2)
+
+// Struct to hold a slice of a text and the banks it is counted into
+struct CountTask {
+  const char *text;                                  // First character of the slice
+  size_t len;                                        // Length of the slice
+  uint8_t first, second;                             // Codes of the two characters before it
+  uint32_t letters[LETTER_BANKS][ALPHABET_SIZE];     // Letter banks
+  uint32_t bigrams[BIGRAM_BANKS][CS642_COUNT_BIGRAMS]; // Bigram banks
+  uint32_t *trigrams;                                // Trigram counts (one bank, they rarely repeat back to back)
+  uint32_t total_bigrams, total_trigrams;
+};
+
+// Struct to hold a slice of a text and the columns it is counted into
+struct ColumnTask {
+  const char *text;                          // First character of the slice
+  size_t len;                                // Length of the slice
+  size_t position;                           // Stream position of the first character
+  int min_period, max_period;                // Periods counted
+  uint32_t (*columns)[ALPHABET_SIZE];        // Columns of every period
+};
+
+// Functions
+
+// Returns the letter code of a single character
+static uint8_t characterCode(char c) {
+  uint8_t code;
+  cs642GetKernels()->letter_codes(&c, 1, &code);
+  return (code);
+}
+
+// Returns how many slices to split a text of len characters into
+static int countSlices(size_t len, int threads) {
+  if (threads <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (online > 0) ? (int)online : 1;
+  }
+  size_t useful = len / COUNT_SLICE_MIN;
+  if (useful < (size_t)threads) {
+    threads = (useful > 0) ? (int)useful : 1;
+  }
+  return ((threads < COUNT_MAX_THREADS) ? threads : COUNT_MAX_THREADS);
+}
+
+// Runs fn on every task, on its own thread where possible, and waits for them
+static void runCountTasks(void *(*fn)(void *), void *tasks, size_t task_size, int count) {
+  pthread_t threads[COUNT_MAX_THREADS];
+  int started[COUNT_MAX_THREADS] = {0};
+  for (int t = 1; t < count; t++) {
+    started[t] = (pthread_create(&threads[t], NULL, fn, (char *)tasks + t * task_size) == 0);
+    if (!started[t]) {
+      fn((char *)tasks + t * task_size);
+    }
+  }
+  fn(tasks); // The calling thread takes the first slice
+  for (int t = 1; t < count; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
+    }
+  }
+}
+
+// Counts a long slice without branches: non-letters get a bin of their own
+// (code 26) in every table and the n-grams touching it are dropped at the end.
+// Returns -1 (having counted nothing) if its tables cannot be allocated.
+static int countDenseSlice(struct CountTask *task) {
+  uint32_t *trigrams = calloc(DENSE_TRIGRAMS, sizeof(uint32_t));
+  uint32_t (*bigrams)[DENSE_CODES * DENSE_CODES] = calloc(BIGRAM_BANKS, sizeof(*bigrams));
+  uint32_t letters[LETTER_BANKS][DENSE_CODES] = {{0}};
+  uint8_t codes[CODE_BLOCK];
+  if (trigrams == NULL || bigrams == NULL) {
+    free(trigrams);
+    free(bigrams);
+    return (-1);
+  }
+
+  uint32_t first = (task->first < ALPHABET_SIZE) ? task->first : ALPHABET_SIZE;
+  uint32_t second = (task->second < ALPHABET_SIZE) ? task->second : ALPHABET_SIZE;
+  for (size_t block = 0; block < task->len; block += CODE_BLOCK) {
+    int size = (task->len - block < CODE_BLOCK) ? (int)(task->len - block) : CODE_BLOCK;
+    cs642GetKernels()->letter_codes(task->text + block, size, codes);
+    for (int i = 0; i < size; i++) {
+      uint32_t third = (codes[i] < ALPHABET_SIZE) ? codes[i] : ALPHABET_SIZE;
+      letters[i & (LETTER_BANKS - 1)][third]++;
+      bigrams[i & (BIGRAM_BANKS - 1)][second * DENSE_CODES + third]++;
+      trigrams[(first * DENSE_CODES + second) * DENSE_CODES + third]++;
+      first = second;
+      second = third;
+    }
+  }
+
+  // Keep the letter-only bins
+  for (int b = 0; b < LETTER_BANKS; b++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      task->letters[b][i] += letters[b][i];
+    }
+  }
+  for (int b = 0; b < BIGRAM_BANKS; b++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      for (int j = 0; j < ALPHABET_SIZE; j++) {
+        task->bigrams[b][i * ALPHABET_SIZE + j] += bigrams[b][i * DENSE_CODES + j];
+        task->total_bigrams += bigrams[b][i * DENSE_CODES + j];
+      }
+    }
+  }
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    for (int j = 0; j < ALPHABET_SIZE; j++) {
+      for (int k = 0; k < ALPHABET_SIZE; k++) {
+        uint32_t count = trigrams[(i * DENSE_CODES + j) * DENSE_CODES + k];
+        task->trigrams[(i * ALPHABET_SIZE + j) * ALPHABET_SIZE + k] += count;
+        task->total_trigrams += count;
+      }
+    }
+  }
+  free(trigrams);
+  free(bigrams);
+  return (0);
+}
+
+// Counts the letters and n-grams of a slice into its banks
+static void *countSlice(void *arg) {
+  struct CountTask *task = (struct CountTask *)arg;
+  uint8_t codes[CODE_BLOCK];
+  uint8_t first = task->first, second = task->second;
+  if (task->len >= DENSE_SLICE_MIN && countDenseSlice(task) == 0) {
+    return (NULL);
+  }
+
+  for (size_t block = 0; block < task->len; block += CODE_BLOCK) {
+    int size = (task->len - block < CODE_BLOCK) ? (int)(task->len - block) : CODE_BLOCK;
+    cs642GetKernels()->letter_codes(task->text + block, size, codes);
+    for (int i = 0; i < size; i++) {
+      uint8_t third = codes[i];
+      if (third < ALPHABET_SIZE) {
+        task->letters[i & (LETTER_BANKS - 1)][third]++;
+        if (second < ALPHABET_SIZE) {
+          task->bigrams[i & (BIGRAM_BANKS - 1)][second * ALPHABET_SIZE + third]++;
+          task->total_bigrams++;
+          if (first < ALPHABET_SIZE) {
+            task->trigrams[(first * ALPHABET_SIZE + second) * ALPHABET_SIZE + third]++;
+            task->total_trigrams++;
+          }
+        }
+      }
+      first = second;
+      second = third;
+    }
+  }
+  return (NULL);
+}
+
+// Counts the letters of a slice into the columns of every period, one period
+// at a time over each block of codes. Non-letters land in a spare bin, so the
+// inner loop has no data-dependent branch.
+static void *countColumnSlice(void *arg) {
+  struct ColumnTask *task = (struct ColumnTask *)arg;
+  uint32_t local[MAX_COLUMNS][DENSE_CODES];
+  int periods = task->max_period - task->min_period + 1, total_columns = 0;
+  int cursor[CS642_COUNT_MAX_PERIOD], offset[CS642_COUNT_MAX_PERIOD];
+  uint8_t codes[CODE_BLOCK];
+
+  for (int p = 0; p < periods; p++) {
+    int period = task->min_period + p;
+    offset[p] = total_columns;
+    cursor[p] = (int)(task->position % period);
+    total_columns += period;
+  }
+  memset(local, 0x00, sizeof(uint32_t) * DENSE_CODES * total_columns);
+  for (size_t block = 0; block < task->len; block += CODE_BLOCK) {
+    int size = (task->len - block < CODE_BLOCK) ? (int)(task->len - block) : CODE_BLOCK;
+    cs642GetKernels()->letter_codes(task->text + block, size, codes);
+    for (int i = 0; i < size; i++) {
+      codes[i] = (codes[i] < ALPHABET_SIZE) ? codes[i] : ALPHABET_SIZE;
+    }
+    for (int p = 0; p < periods; p++) {
+      int period = task->min_period + p, column = cursor[p];
+      uint32_t (*columns)[DENSE_CODES] = local + offset[p];
+      for (int i = 0; i < size; i++) {
+        columns[column][codes[i]]++;
+        column = (column + 1 == period) ? 0 : column + 1;
+      }
+      cursor[p] = column;
+    }
+  }
+
+  for (int c = 0; c < total_columns; c++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      task->columns[c][i] += local[c][i];
+    }
+  }
+  return (NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642InitTextCounts
+// Description  : Clears a set of text counts
+//
+// Inputs       : counts - the counts
+// Outputs      : void
+void cs642InitTextCounts(cs642TextCounts *counts) {
+  memset(counts, 0x00, sizeof(cs642TextCounts));
+  counts->history[0] = CS642_KERNEL_NONLETTER;
+  counts->history[1] = CS642_KERNEL_NONLETTER;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CountText
+// Description  : Adds the letter and n-gram counts of a text, one slice per
+//                thread for large texts, and merges the banks of every slice
+//
+// Inputs       : counts - the counts to add to
+//                text - the text
+//                len - the length of the text
+//                threads - the most threads to use (0 = online CPUs)
+// Outputs      : 0 if successful, -1 if failure
+int cs642CountText(cs642TextCounts *counts, const char *text, size_t len, int threads) {
+  if (len == 0) {
+    return (0);
+  }
+  int slices = countSlices(len, threads);
+  struct CountTask single = {0}, *tasks = &single; // One slice needs no heap
+  if (slices > 1 && (tasks = calloc(slices, sizeof(struct CountTask))) == NULL) {
+    return (-1);
+  }
+
+  // Slice the text; the first slice counts straight into the trigram table
+  for (int t = 0; t < slices; t++) {
+    size_t start = len / slices * t;
+    tasks[t].text = text + start;
+    tasks[t].len = (t == slices - 1) ? len - start : len / slices;
+    tasks[t].first = (start >= 2) ? characterCode(text[start - 2]) : (start == 1) ? counts->history[1] : counts->history[0];
+    tasks[t].second = (start >= 1) ? characterCode(text[start - 1]) : counts->history[1];
+    tasks[t].trigrams = (t == 0) ? counts->trigrams : calloc(CS642_COUNT_TRIGRAMS, sizeof(uint32_t));
+    if (tasks[t].trigrams == NULL) {
+      for (int u = 1; u < t; u++) {
+        free(tasks[u].trigrams);
+      }
+      free(tasks);
+      return (-1);
+    }
+  }
+  runCountTasks(countSlice, tasks, sizeof(struct CountTask), slices);
+
+  // Merge the banks of every slice
+  for (int t = 0; t < slices; t++) {
+    for (int b = 0; b < LETTER_BANKS; b++) {
+      for (int i = 0; i < ALPHABET_SIZE; i++) {
+        counts->letters[i] += tasks[t].letters[b][i];
+      }
+    }
+    for (int b = 0; b < BIGRAM_BANKS; b++) {
+      for (int i = 0; i < CS642_COUNT_BIGRAMS; i++) {
+        counts->bigrams[i] += tasks[t].bigrams[b][i];
+      }
+    }
+    if (t > 0) {
+      for (int i = 0; i < CS642_COUNT_TRIGRAMS; i++) {
+        counts->trigrams[i] += tasks[t].trigrams[i];
+      }
+      free(tasks[t].trigrams);
+    }
+    counts->total_bigrams += tasks[t].total_bigrams;
+    counts->total_trigrams += tasks[t].total_trigrams;
+  }
+
+  // Remember the last two characters for the next call
+  counts->history[0] = (len >= 2) ? characterCode(text[len - 2]) : counts->history[1];
+  counts->history[1] = characterCode(text[len - 1]);
+  if (tasks != &single) {
+    free(tasks);
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CountColumns
+// Description  : Adds the letters of a text to the columns of a range of
+//                periods, one slice per thread for large texts
+//
+// Inputs       : columns - the columns of every period (shortest first)
+//                text - the text
+//                len - the length of the text
+//                position - the stream position of the first character
+//                min_period, max_period - the periods counted
+//                threads - the most threads to use (0 = online CPUs)
+// Outputs      : 0 if successful, -1 if failure
+int cs642CountColumns(uint32_t (*columns)[CS642_COUNT_ALPHABET], const char *text, size_t len, size_t position,
+                      int min_period, int max_period, int threads) {
+  if (min_period < 1 || max_period < min_period || max_period > CS642_COUNT_MAX_PERIOD) {
+    return (-1);
+  }
+  int total_columns = (min_period + max_period) * (max_period - min_period + 1) / 2;
+  int slices = countSlices(len, threads);
+  struct ColumnTask tasks[COUNT_MAX_THREADS];
+
+  // Slice the text; the first slice counts straight into the columns
+  for (int t = 0; t < slices; t++) {
+    size_t start = len / slices * t;
+    tasks[t] = (struct ColumnTask){text + start, (t == slices - 1) ? len - start : len / slices,
+                                   position + start, min_period, max_period, columns};
+    if (t > 0) {
+      tasks[t].columns = calloc(total_columns, sizeof(*columns));
+      if (tasks[t].columns == NULL) {
+        for (int u = 1; u < t; u++) {
+          free(tasks[u].columns);
+        }
+        return (-1);
+      }
+    }
+  }
+  runCountTasks(countColumnSlice, tasks, sizeof(struct ColumnTask), slices);
+
+  // Merge the columns of the other slices
+  for (int t = 1; t < slices; t++) {
+    for (int c = 0; c < total_columns; c++) {
+      for (int i = 0; i < ALPHABET_SIZE; i++) {
+        columns[c][i] += tasks[t].columns[c][i];
+      }
+    }
+    free(tasks[t].columns);
+  }
+  return (0);
+}
+
+// Returns the next pseudo-random number of the self-test
+static uint32_t countTestRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CountSelfTest
+// Description  : Counts texts long enough to be split into several slices
+//                (with slice boundaries inside letter runs, on non-letters
+//                and on high bytes) three ways: in one slice, split over
+//                threads, and in short calls that continue from the history.
+//                Checks that the text and column counts are identical.
+//
+// Inputs       : void
+// Outputs      : 0 if successful, -1 if failure
+int cs642CountSelfTest(void) {
+  static const size_t lengths[] = {2 * COUNT_SLICE_MIN + 1, 3 * COUNT_SLICE_MIN + 2};
+  static const char alphabet[] = "ETAOINSHRDLUetaoinshrdlu QXZJKVBPYGFWMCqxzjkvbpygfwmc  .,'\x80\xc1";
+  int columns = (5 + 13) * (13 - 5 + 1) / 2; // Periods 5-13 (a few around the Vigenere range)
+  uint32_t state = 0x9E3779B9;
+  int failures = 0;
+
+  for (int l = 0; l < (int)(sizeof(lengths) / sizeof(lengths[0])); l++) {
+    size_t len = lengths[l];
+    char *text = malloc(len);
+    cs642TextCounts *counts = malloc(3 * sizeof(cs642TextCounts));
+    uint32_t (*table)[ALPHABET_SIZE] = calloc(2 * columns, sizeof(*table));
+    if (text == NULL || counts == NULL || table == NULL) {
+      free(text);
+      free(counts);
+      free(table);
+      return (-1);
+    }
+    for (size_t i = 0; i < len; i++) {
+      text[i] = alphabet[countTestRandom(&state) % (sizeof(alphabet) - 1)];
+    }
+
+    // One slice, one slice per thread, and short calls (below the dense size)
+    for (int c = 0; c < 3; c++) {
+      cs642InitTextCounts(&counts[c]);
+    }
+    int failed = cs642CountText(&counts[0], text, len, 1) || cs642CountText(&counts[1], text, len, 4);
+    for (size_t at = 0, step; at < len && !failed; at += step) {
+      step = 1 + countTestRandom(&state) % (DENSE_SLICE_MIN - 1);
+      step = (step < len - at) ? step : len - at;
+      failed = cs642CountText(&counts[2], text + at, step, 1);
+    }
+    failed = failed || cs642CountColumns(table, text, len, 3, 5, 13, 1) ||
+             cs642CountColumns(table + columns, text, len, 3, 5, 13, 4);
+    if (failed || memcmp(&counts[0], &counts[1], sizeof(cs642TextCounts)) ||
+        memcmp(&counts[0], &counts[2], sizeof(cs642TextCounts)) ||
+        memcmp(table, table + columns, columns * sizeof(*table))) {
+      logMessage(LOG_ERROR_LEVEL, "Count self-test failed (length %zu, %d slices).", len, countSlices(len, 4));
+      failures++;
+    }
+    free(text);
+    free(counts);
+    free(table);
+  }
+
+  if (failures == 0) {
+    logMessage(LOG_OUTPUT_LEVEL, "Count self-test passed.");
+  }
+  return (failures ? -1 : 0);
+}
@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-counts.h
+//  Description    : This is an include file for the text statistics counters
+//                   (letters, bigrams, trigrams and periodic columns) that
+//                   split large inputs over threads.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stddef.h>
+#include <stdint.h>
+
+// Defines
+#define CS642_COUNT_ALPHABET 26
+#define CS642_COUNT_BIGRAMS (CS642_COUNT_ALPHABET * CS642_COUNT_ALPHABET)
+#define CS642_COUNT_TRIGRAMS (CS642_COUNT_BIGRAMS * CS642_COUNT_ALPHABET)
+#define CS642_COUNT_MAX_PERIOD 32 // Longest period the column counter handles
+
+//
+// Type definitions
+
+// Define struct and type for the letter and n-gram counts of a text. N-grams
+// are indexed (a * 26 + b) and ((a * 26 + b) * 26 + c) by letter code.
+struct cs642TextCounts {
+  uint32_t letters[CS642_COUNT_ALPHABET];  // Letter counts (either case)
+  uint32_t bigrams[CS642_COUNT_BIGRAMS];   // Adjacent letter pairs
+  uint32_t trigrams[CS642_COUNT_TRIGRAMS]; // Adjacent letter triples
+  uint32_t total_bigrams;                  // Sum of the bigram counts
+  uint32_t total_trigrams;                 // Sum of the trigram counts
+  uint8_t history[2]; // Letter codes of the last two characters counted, so
+                      // n-grams spanning two calls are counted
+};
+typedef struct cs642TextCounts cs642TextCounts;
+
+//
+// Counting functions
+
+void cs642InitTextCounts(cs642TextCounts *counts);
+// Clears the counts (and the history)
+
+int cs642CountText(cs642TextCounts *counts, const char *text, size_t len,
+                   int threads);
+// Adds the letters and n-grams of text to counts, continuing from the
+// characters counted before. Large texts are split over up to threads threads
+// (0 = online CPUs). Returns 0 if successful, -1 if failure.
+
+int cs642CountColumns(uint32_t (*columns)[CS642_COUNT_ALPHABET],
+                      const char *text, size_t len, size_t position,
+                      int min_period, int max_period, int threads);
+// Adds the letters of text to the columns of every period from min_period to
+// max_period. Period p owns the p columns after those of the shorter periods,
+// and the character at index i falls in column (position + i) % p (every
+// character, letter or not, advances the column). Large texts are split over
+// up to threads threads (0 = online CPUs). Returns 0 if successful, -1 if not.
+
+int cs642CountSelfTest(void);
+// Checks that texts split over several slices (and over several calls) count
+// exactly as in a single slice. Returns 0 if they agree, -1 otherwise.
@@ -12,31 +12,78 @@
 
 // Include Files
 #include <compsci642_log.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <ctype.h>
 #include <float.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
 
 // Project Include Files
 #include "cs642-cryptanalysis-support.h"
+#include "cs642-cryptanalysis-impl.h"
+#include "cs642-cryptanalysis-arena.h"
+#include "cs642-cryptanalysis-kernels.h"
+#include "cs642-cryptanalysis-candidates.h"
+#include "cs642-cryptanalysis-profile.h"
+#include "cs642-cryptanalysis-counts.h"
+#include "cs642-cryptanalysis-trie.h"
+#include "cs642-cryptanalysis-topology.h"
+#include "cs642-cryptanalysis-tuning.h"
 
 // Declare Global Variables
 #define ALPHABET_SIZE 26
-#define MAX_ATTEMPTS 600
-#define INCREMENT_VALUE 0.0005
-
-// Struct to represent a trigram and its frequency
-struct TrigramFrequency {
-    char trigram[4];  // Assuming trigrams are represented as three characters plus null terminator
-    double frequency;
-};
-
-// Struct to represent a bigram and its frequency
-struct BigramFrequency {
-    char bigram[3];  // Assuming bigrams are represented as two characters plus null terminator
-    double frequency;
+#define VIGE_MIN_PERIOD 6
+#define VIGE_MAX_PERIOD 11
+#define VIGE_PERIODS (VIGE_MAX_PERIOD - VIGE_MIN_PERIOD + 1)
+#define VIGE_COLUMNS 51 // Columns across all candidate periods (6 + 7 + ... + 11)
+#define VIGE_REFINE_LETTERS 200 // Letters per column below which keys are refined with bigrams
+#define VIGE_REFINE_SWEEPS 4    // Most passes of joint adjustment over the adjacent columns
+#define VIGE_CONFIRMATION 0.9   // Share of letters in dictionary words that confirms a short decryption
+#define EVALUATION_BATCH 8 // Candidate keys decrypted per pass over the ciphertext
+#define ARENA_BLOCK(bytes) ((bytes) + CS642_ARENA_ALIGNMENT) // Reservation of one of several blocks borrowed together
+#define CODE_BLOCK 256 // Characters converted to letter codes per kernel call
+#define CHECKPOINT_MAGIC "CS642SUB"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_PREFIX 4096
+#define SUBS_BIGRAM_INCREMENTS 5  // Matching threshold steps of the bigram phase
+#define SUBS_TRIGRAM_INCREMENTS 3 // Matching threshold steps of the trigram phase
+#define SESSION_WINDOW 5000 // Most recent characters a Vigenere session key is confirmed on
+#define SESSION_WARM_TEMPERATURE 4.0 // Annealing start temperature from the previous session key
+#define SESSION_WARM_RUNS 2          // Annealing runs of a warm-started session refinement
+#define SCORE_MEMO_SLOTS 8192 // Slots of the key score memo of a search (a power of two)
+#define SCORE_MEMO_PROBES 8   // Slots probed before a memo entry is evicted
+#define SUBS_BEAM_WIDTH 64    // Default partial keys kept per depth by the beam search
+#define SUBS_BEAM_MAX 4096    // Widest beam accepted
+#define PORTFOLIO_ENGINES 4          // Engines in the default substitution portfolio
+#define PORTFOLIO_CONFIDENCE 0.99    // Share of plaintext letters in dictionary words that confirms a key
+#define ANNEAL_START_TEMPERATURE 40.0 // Default schedule (temperatures per 1000 ciphertext trigrams)
+#define ANNEAL_END_TEMPERATURE 0.5
+#define ANNEAL_STEPS 20000            // Default key swaps proposed per restart
+#define ANNEAL_RESTARTS 8             // Default restarts before the best key is kept
+#define ANNEAL_TABLE_SIZE 4096        // Entries of the Metropolis acceptance table
+#define ANNEAL_TABLE_RANGE 16.0       // Largest -delta / T in the table (e^-16: rejected beyond)
+#define ANNEAL_CANCEL_CHECK 1024      // Steps between checks of the cancel flag
+#define CRIB_MAX_PLACEMENTS 64        // Crib placements verified before falling back on statistics
+#define SPACELESS_TOKEN_LENGTH 12     // Mean token length beyond which a text is taken to have lost its spaces
+
+// N-grams are packed into integer indices (a*676 + b*26 + c)
+#define FNV_OFFSET 0xcbf29ce484222325ULL // 64-bit FNV-1a parameters
+#define FNV_PRIME 0x100000001b3ULL
+#define BIGRAM_SPACE (ALPHABET_SIZE * ALPHABET_SIZE)
+#define TRIGRAM_SPACE (ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE)
+#define BIGRAM_INDEX(a, b) ((a) * ALPHABET_SIZE + (b))
+#define TRIGRAM_INDEX(a, b, c) (((a) * ALPHABET_SIZE + (b)) * ALPHABET_SIZE + (c))
+
+// Struct to represent n-grams ranked by descending count (struct of arrays)
+struct NgramRanking {
+  int size;        // Number of ranked n-grams
+  uint32_t total;  // Total used to turn counts into frequencies
+  uint16_t *index; // Packed n-gram index at each rank
+  uint32_t *count; // Count of the n-gram at each rank
 };
 
 // Struct to represent a letter and its frequency
@@ -48,11 +95,95 @@ struct LetterFrequency {
 // Global Variables for Storing Letter, Bigram, and Trigram Frequency
 struct LetterFrequency letter_frequencies_struct[ALPHABET_SIZE] = {0};
 double letter_frequencies[ALPHABET_SIZE] = {0};
-double bigram_frequencies[ALPHABET_SIZE][ALPHABET_SIZE] = {0};
-double trigram_frequencies[ALPHABET_SIZE][ALPHABET_SIZE][ALPHABET_SIZE] = {0};
+uint32_t bigram_counts[BIGRAM_SPACE] = {0};
+uint32_t trigram_counts[TRIGRAM_SPACE] = {0};
+float bigram_log_probs[BIGRAM_SPACE];   // Smoothed log-probabilities of the model n-grams
+float trigram_log_probs[TRIGRAM_SPACE];
+
+uint16_t bigram_rank_index[BIGRAM_SPACE];
+uint32_t bigram_rank_count[BIGRAM_SPACE];
+uint16_t trigram_rank_index[TRIGRAM_SPACE];
+uint32_t trigram_rank_count[TRIGRAM_SPACE];
+struct NgramRanking bigram_ranking = {0, 0, bigram_rank_index, bigram_rank_count};
+struct NgramRanking trigram_ranking = {0, 0, trigram_rank_index, trigram_rank_count};
+pthread_once_t ngram_model_once = PTHREAD_ONCE_INIT;
+
+// Struct to represent a distinct word in the dictionary hash set
+struct DictionarySlot {
+  uint64_t hash;    // FNV-1a hash of the word
+  int word;         // Index of the first copy of the word (-1 = empty slot)
+  int multiplicity; // Number of dictionary entries spelling the word
+};
+
+// Struct to hold a snapshot of the dictionary in one allocation: the words
+// packed back to back, per-word arrays, a by-length index and a hash set
+struct DictionaryCopy {
+  void *block;                  // The allocation everything below lives in
+  size_t block_size;            // Bytes in block
+  struct DictionarySlot *slots; // Open-addressed hash set of the distinct words
+  uint32_t slot_mask;           // Number of slots - 1 (a power of two - 1)
+  int *offsets;                 // Offset of each word in words
+  int *lengths;                 // Length of each word
+  int *counts;                  // Corpus count of each word
+  int *length_start;            // Words of length L are by_length[length_start[L] .. length_start[L + 1] - 1]
+  int *by_length;               // Word indices grouped by length
+  char *words;                  // NUL-terminated words, back to back
+  int size;                     // Number of words
+  int max_length;               // Length of the longest word
+  int empty_words;              // Number of empty words (contained in any text)
+  uint8_t in_words[256];        // Whether each byte occurs in some word
+};
 
-struct BigramFrequency bigramArray[ALPHABET_SIZE * ALPHABET_SIZE];
-struct TrigramFrequency trigramArray[ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE];
+struct DictionaryCopy dictionary = {0};
+
+// Struct to hold the read-only tables the searches score with. The shared
+// model points at the globals; the replica of a memory node points into one
+// allocation that a thread running on that node copied (so first touched).
+struct LanguageModel {
+  const struct DictionaryCopy *dictionary;
+  const float *bigram_log_probs;
+  const float *trigram_log_probs;
+  const struct NgramRanking *bigram_ranking;
+  const struct NgramRanking *trigram_ranking;
+};
+
+static const struct LanguageModel shared_model = {&dictionary, bigram_log_probs, trigram_log_probs, &bigram_ranking,
+                                                  &trigram_ranking};
+static struct LanguageModel *node_models[CS642_TOPOLOGY_MAX_NODES]; // Replica of each node (NULL = none yet)
+static pthread_mutex_t node_models_lock = PTHREAD_MUTEX_INITIALIZER;
+static int replicate_models = 0;   // -1 = never, 0 = on hosts of several nodes, 1 = always
+static int model_generation = 1;   // Bumped when the replicas are released
+
+// Model this thread reads, valid while its generation is current
+static __thread const struct LanguageModel *thread_model = NULL;
+static __thread int thread_model_generation = 0;
+
+// Returns the model of the calling thread: the replica of its node if one was
+// built, the shared model otherwise
+static inline const struct LanguageModel *localModel(void) {
+  int generation = __atomic_load_n(&model_generation, __ATOMIC_ACQUIRE);
+  if (thread_model_generation != generation) {
+    int node = cs642CurrentNode();
+    pthread_mutex_lock(&node_models_lock);
+    thread_model = (node_models[node] != NULL) ? node_models[node] : &shared_model;
+    pthread_mutex_unlock(&node_models_lock);
+    thread_model_generation = generation;
+  }
+  return (thread_model);
+}
+
+// Trie of the dictionary words for the segmenter (built on first use)
+cs642Trie *word_trie = NULL;
+pthread_once_t word_trie_once = PTHREAD_ONCE_INIT;
+
+// Candidate heap of the analysis running on this thread (NULL = not collecting)
+static __thread cs642CandidateHeap *candidate_sink = NULL;
+
+// Counts of the ciphertext handed to this thread by the driver (NULL = none)
+static __thread const char *attached_text = NULL;
+static __thread int attached_length = 0;
+static __thread const cs642TextCounts *attached_counts = NULL;
+cs642ModelTimings model_timings = {0};
 
 
 // Functions
@@ -72,183 +203,671 @@ int compareLetterFrequencies(const void *a, const void *b) {
   }
 }
 
-// Function to compare two bigram frequencies for sorting
-int compareBigramFrequencies(const void *a, const void *b) {
-  const struct BigramFrequency *bigramA = (const struct BigramFrequency *)a;
-  const struct BigramFrequency *bigramB = (const struct BigramFrequency *)b;
+// Function to compare two packed (count, rank) sort keys in descending order
+int compareNgramSortKeys(const void *a, const void *b) {
+  uint64_t keyA = *(const uint64_t *)a;
+  uint64_t keyB = *(const uint64_t *)b;
+  return (keyB > keyA) - (keyB < keyA);
+}
+
+// Ranks n-gram counts by descending count (ties keep ascending index order).
+// When skip_zero is set, n-grams that never occur are left out of the ranking.
+void rankNgrams(const uint32_t *counts, int space, uint32_t total, int skip_zero, struct NgramRanking *ranking) {
+  // Pack count and inverted index into one key so a plain sort orders both
+  uint64_t keys[space];
+  int size = 0;
+  for (int i = 0; i < space; i++) {
+    if (counts[i] > 0 || !skip_zero) {
+      keys[size++] = ((uint64_t)counts[i] << 32) | (uint32_t)(space - 1 - i);
+    }
+  }
+  qsort(keys, size, sizeof(uint64_t), compareNgramSortKeys);
+
+  // Unpack into the struct-of-arrays ranking
+  for (int i = 0; i < size; i++) {
+    ranking->index[i] = (uint16_t)(space - 1 - (int)(keys[i] & 0xFFFFFFFF));
+    ranking->count[i] = (uint32_t)(keys[i] >> 32);
+  }
+  ranking->size = size;
+  ranking->total = total;
+}
+
+// Returns the frequency of the n-gram at a given rank
+static inline double rankedFrequency(const struct NgramRanking *ranking, int rank) {
+  return ranking->count[rank] / (double)ranking->total;
+}
 
-  // Compare frequencies in descending order
-  if (bigramB->frequency > bigramA->frequency) {
-    return 1;
-  } else if (bigramB->frequency < bigramA->frequency) {
-    return -1;
-  } else {
-    return 0;
+// Offers a scored key to the candidate heap of this thread, if one is collecting
+static inline void offerCandidate(const char *key, int keylen, int score, const char *plaintext) {
+  if (candidate_sink != NULL) {
+    cs642OfferCandidate(candidate_sink, key, keylen, score, plaintext);
   }
 }
 
-// Function to compare two trigram frequencies for sorting
-int compareTrigramFrequencies(const void *a, const void *b) {
-    const struct TrigramFrequency *trigramA = (const struct TrigramFrequency *)a;
-    const struct TrigramFrequency *trigramB = (const struct TrigramFrequency *)b;
+// Returns the 64-bit FNV-1a hash of a text
+uint64_t fingerprintText(const char *text, int len) {
+  uint64_t hash = FNV_OFFSET;
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ (uint8_t)text[i]) * FNV_PRIME;
+  }
+  return hash;
+}
 
-    // Compare frequencies in descending order
-    if (trigramB->frequency > trigramA->frequency) {
-        return 1;
-    } else if (trigramB->frequency < trigramA->frequency) {
-        return -1;
-    } else {
-        return 0;
+// Returns the hash set slot of a word of the dictionary (-1 if not a word)
+int findDictionaryWord(const char *word, int length, uint64_t hash) {
+  const struct DictionaryCopy *words = localModel()->dictionary;
+  for (uint32_t slot = hash & words->slot_mask; words->slots[slot].word >= 0; slot = (slot + 1) & words->slot_mask) {
+    int index = words->slots[slot].word;
+    if (words->slots[slot].hash == hash && words->lengths[index] == length &&
+        memcmp(words->words + words->offsets[index], word, length) == 0) {
+      return (int)slot;
     }
+  }
+  return (-1);
 }
 
-// Returns number of words from dictionary found in plaintext
+// Returns number of words from dictionary found in plaintext. Rather than
+// searching for every word, each window of the plaintext that is as long as
+// some word is looked up in the hash set (the hash grows with the window).
 int getNumberWordsFromDict(char *plaintext) {
-  int num_words_from_dict = 0;
-  for(int i = 0; i < cs642GetDictSize(); i++) {
-    if(strstr(plaintext, cs642GetWordfromDict(i).word) != NULL) {
-      //printf("%s\n", cs642GetWordfromDict(i).word);
-      num_words_from_dict++;
+  const struct DictionaryCopy *words = localModel()->dictionary;
+  int num_words_from_dict = words->empty_words;
+  int len = strlen(plaintext);
+  uint64_t found[(words->slot_mask >> 6) + 1]; // Distinct words already counted
+  memset(found, 0x00, sizeof(found));
+
+  for (int i = 0; i < len; i++) {
+    uint64_t hash = FNV_OFFSET;
+    for (int length = 1; length <= words->max_length && i + length <= len; length++) {
+      uint8_t c = (uint8_t)plaintext[i + length - 1];
+      if (!words->in_words[c]) {
+        break; // No word spans this character
+      }
+      hash = (hash ^ c) * FNV_PRIME;
+      if (words->length_start[length] == words->length_start[length + 1]) {
+        continue; // No word has this length
+      }
+      int slot = findDictionaryWord(plaintext + i, length, hash);
+      if (slot >= 0 && !(found[slot >> 6] & (1ULL << (slot & 63)))) {
+        found[slot >> 6] |= 1ULL << (slot & 63);
+        num_words_from_dict += words->slots[slot].multiplicity;
+      }
     }
   }
   return num_words_from_dict;
 }
 
+// Decrypts a batch of substitution keys in one pass over the ciphertext. Each
+// plaintext k is written at plaintexts + k * stride.
+void decryptSubsBatch(const char *ciphertext, int clen, char **keys, int count, char *plaintexts, int stride) {
+  // Invert the keys into lookup tables: ciphertext letter -> plaintext letter
+  char tables[count][ALPHABET_SIZE];
+  for (int k = 0; k < count; k++) {
+    for (int p = 0; p < ALPHABET_SIZE; p++) {
+      tables[k][keys[k][p] - 'A'] = p + 'A';
+    }
+  }
+
+  cs642GetKernels()->substitute(ciphertext, clen, tables, count, plaintexts, stride);
+  for (int k = 0; k < count; k++) {
+    plaintexts[k * stride + clen] = '\0';
+  }
+}
+
+// Decrypts a batch of shift keys (ROTX keys have period 1, Vigenere keys have
+// their key length as period) in one pass over the ciphertext. Key letters
+// are 'A' + shift, and spaces count as key positions.
+void decryptShiftBatch(const char *ciphertext, int clen, char **keys, const int *periods, int count, char *plaintexts, int stride) {
+  // Repeat each key's shifts into a pattern the kernels can load at any column
+  uint8_t patterns[count][CS642_SHIFT_PATTERN];
+  for (int k = 0; k < count; k++) {
+    for (int j = 0; j < CS642_SHIFT_PATTERN; j++) {
+      patterns[k][j] = (uint8_t)(ALPHABET_SIZE - (keys[k][j % periods[k]] - 'A') % ALPHABET_SIZE);
+    }
+  }
+
+  cs642GetKernels()->shift(ciphertext, clen, patterns, periods, count, plaintexts, stride);
+  for (int k = 0; k < count; k++) {
+    plaintexts[k * stride + clen] = '\0';
+  }
+}
+
+// Borrows scratch space for a batch of plaintexts of length clen from an arena
+char *borrowBatchPlaintexts(cs642Arena *arena, int clen) {
+  size_t bytes = (size_t)EVALUATION_BATCH * (clen + 1);
+  char *plaintexts = NULL;
+  if (cs642ArenaReserve(arena, bytes) == 0) {
+    plaintexts = cs642ArenaAlloc(arena, bytes);
+  }
+  if (plaintexts == NULL) {
+    perror("Memory allocation failed");
+    exit(EXIT_FAILURE);
+  }
+  return plaintexts;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : cs642StudentInit
-// Description  : This is a function that is called before any cryptanalysis
-//                occurs. Use it if you need to initialize some datastructures
-//                you may be reusing across ciphers.
+// Function     : cs642ScoreSUBSKeys
+// Description  : Scores a set of substitution keys against a ciphertext,
+//                decrypting up to EVALUATION_BATCH keys per pass over it
 //
-// Inputs       : void
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                keys - the candidate keys (26 letters each)
+//                count - the number of candidate keys
+//                scores - the place to put the dictionary score of each key
 // Outputs      : 0 if successful, -1 if failure
-int cs642StudentInit(void) {
-  int dictSize = cs642GetDictSize();
+int cs642ScoreSUBSKeys(char *ciphertext, int clen, char **keys, int count, int *scores) {
+  cs642Arena *arena = cs642ScratchArena();
+  char *plaintexts = borrowBatchPlaintexts(arena, clen);
+  for (int first = 0; first < count; first += EVALUATION_BATCH) {
+    int lanes = (count - first < EVALUATION_BATCH) ? count - first : EVALUATION_BATCH;
+    decryptSubsBatch(ciphertext, clen, keys + first, lanes, plaintexts, clen + 1);
+    for (int k = 0; k < lanes; k++) {
+      scores[first + k] = getNumberWordsFromDict(plaintexts + k * (clen + 1));
+    }
+  }
+  cs642ArenaReset(arena);
+  return (0);
+}
 
-  // Initialize Letters in Letter Frequency Array
-  for(int i = 0; i < ALPHABET_SIZE; i++) {
-    letter_frequencies_struct[i].letter = i + 'A';
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ScoreShiftKeys
+// Description  : Scores a set of ROTX/Vigenere keys against a ciphertext,
+//                decrypting up to EVALUATION_BATCH keys per pass over it
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                keys - the candidate keys (letters 'A' + shift)
+//                keylens - the length of each key (1 for ROTX, 6-11 for VIGE)
+//                count - the number of candidate keys
+//                scores - the place to put the dictionary score of each key
+// Outputs      : 0 if successful, -1 if failure
+int cs642ScoreShiftKeys(char *ciphertext, int clen, char **keys, const int *keylens, int count, int *scores) {
+  for (int k = 0; k < count; k++) {
+    if (keylens[k] < 1 || keylens[k] > VIGE_MAX_PERIOD) {
+      return (-1);
+    }
   }
 
-  // Read words from the dictionary and update counts
-  int total_word_count = 0;
-  for (int i = 0; i < dictSize; i++) {
-    /*** COUNT LETTERS ***/
-    DictWord wordInfo = cs642GetWordfromDict(i); // Obtain individual word
-    char *word = wordInfo.word;
-    int count = wordInfo.count;
+  cs642Arena *arena = cs642ScratchArena();
+  char *plaintexts = borrowBatchPlaintexts(arena, clen);
+  for (int first = 0; first < count; first += EVALUATION_BATCH) {
+    int lanes = (count - first < EVALUATION_BATCH) ? count - first : EVALUATION_BATCH;
+    decryptShiftBatch(ciphertext, clen, keys + first, keylens + first, lanes, plaintexts, clen + 1);
+    for (int k = 0; k < lanes; k++) {
+      scores[first + k] = getNumberWordsFromDict(plaintexts + k * (clen + 1));
+    }
+  }
+  cs642ArenaReset(arena);
+  return (0);
+}
 
-    for (int j = 0; word[j] != '\0'; j++) { // Traverse characters of current word
-      char ch = word[j];
-      if (isalpha(ch)) {
-        ch = toupper(ch); // Convert to uppercase
-        letter_frequencies_struct[ch - 'A'].frequency += count; // Increment by number of occurrences of letter / # words (i.e. 1 * count of word = count)
-        letter_frequencies[ch - 'A'] += count;
-        total_word_count += count;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : elapsedSince
+// Description  : Returns the seconds elapsed since a monotonic start time
+//
+// Inputs       : start - the start time
+// Outputs      : the elapsed seconds
+double elapsedSince(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : buildNgramModel
+// Description  : Counts and ranks the dictionary bigrams and trigrams in one
+//                pass over the contiguous dictionary. Only the substitution
+//                search reads these, so they are built on first use.
+//
+// Inputs       : void
+// Outputs      : void
+void buildNgramModel(void) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int totalBigrams = 0, totalTrigrams = 0;
+  for (int i = 0; i < dictionary.size; i++) {
+    const char *word = dictionary.words + dictionary.offsets[i];
+    int count = dictionary.counts[i];
+
+    // Slide a window over the word, counting both orders as we go
+    for (int j = 0; word[j] != '\0' && word[j + 1] != '\0'; j++) {
+      if (isalpha(word[j]) && isalpha(word[j + 1])) {
+        int first = toupper(word[j]) - 'A';
+        int second = toupper(word[j + 1]) - 'A';
+        bigram_counts[BIGRAM_INDEX(first, second)] += count;
+        totalBigrams++;
+        if (word[j + 2] != '\0' && isalpha(word[j + 2])) {
+          int third = toupper(word[j + 2]) - 'A';
+          trigram_counts[TRIGRAM_INDEX(first, second, third)] += count;
+          totalTrigrams++;
+        }
       }
     }
   }
 
-  // Convert Counts to Frequencies
-  for (int i = 0; i < ALPHABET_SIZE; i++) {
-    letter_frequencies_struct[i].frequency = letter_frequencies_struct[i].frequency / (double)total_word_count;
-    letter_frequencies[i] = letter_frequencies[i] / (double)total_word_count;
+  // Rank Bigrams and Trigrams by Descending Frequency
+  rankNgrams(bigram_counts, BIGRAM_SPACE, totalBigrams, 0, &bigram_ranking);
+  rankNgrams(trigram_counts, TRIGRAM_SPACE, totalTrigrams, 0, &trigram_ranking);
+
+  // Smoothed log-probabilities (add one half) for the beam search
+  double bigram_sum = 0.5 * BIGRAM_SPACE, trigram_sum = 0.5 * TRIGRAM_SPACE;
+  for (int i = 0; i < BIGRAM_SPACE; i++) {
+    bigram_sum += bigram_counts[i];
+  }
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    trigram_sum += trigram_counts[i];
+  }
+  for (int i = 0; i < BIGRAM_SPACE; i++) {
+    bigram_log_probs[i] = (float)log((bigram_counts[i] + 0.5) / bigram_sum);
+  }
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    trigram_log_probs[i] = (float)log((trigram_counts[i] + 0.5) / trigram_sum);
   }
 
-  /*** COUNT BIGRAMS ***/
-  int totalBigrams = 0;
-  for (int i = 0; i < dictSize; i++) {
-    DictWord wordInfo = cs642GetWordfromDict(i); // Obtain individual word
-    char *word = wordInfo.word;
-    int count = wordInfo.count;
-
-    for(int i = 0; word[i] != '\0' && word[i + 1] != '\0'; i++) {
-      if (isalpha(word[i]) && isalpha(word[i + 1])) {
-        char first = toupper(word[i]);
-        char second = toupper(word[i + 1]);
-        bigram_frequencies[first - 'A'][second - 'A'] += count;
-        totalBigrams++;
-      }
+  model_timings.ngram_model = elapsedSince(&start);
+}
+
+// Builds the bigram and trigram model exactly once, whichever thread asks first
+void ensureNgramModel(void) {
+  pthread_once(&ngram_model_once, buildNgramModel);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : buildWordTrie
+// Description  : Builds the compact trie of the dictionary words the segmenter
+//                walks. Only texts without spaces need it, so it is built on
+//                first use; word_trie stays NULL if it cannot be.
+//
+// Inputs       : void
+// Outputs      : void
+void buildWordTrie(void) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  cs642Trie *trie = cs642CreateTrie();
+  if (trie == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Failed to allocate word trie.");
+    return;
+  }
+  for (int i = 0; i < dictionary.size; i++) {
+    if (cs642TrieInsert(trie, dictionary.words + dictionary.offsets[i], dictionary.counts[i])) {
+      logMessage(LOG_ERROR_LEVEL, "Failed to insert word into trie.");
+      cs642DestroyTrie(trie);
+      return;
     }
   }
+  if (cs642TrieCompact(trie)) {
+    logMessage(LOG_ERROR_LEVEL, "Failed to compact word trie.");
+    cs642DestroyTrie(trie);
+    return;
+  }
+  word_trie = trie;
+  model_timings.word_trie = elapsedSince(&start);
+}
 
-  // Convert counts to frequencies
-  for(int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      bigram_frequencies[i][j] /= totalBigrams;
+// Builds the word trie exactly once, whichever thread asks first
+void ensureWordTrie(void) {
+  pthread_once(&word_trie_once, buildWordTrie);
+}
+
+// Returns where a pointer into one block lands in a copy of the block
+static inline void *rebase(const void *pointer, const void *block, void *copy) {
+  return ((char *)copy + ((const char *)pointer - (const char *)block));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replicateModel
+// Description  : Copies the shared model into one allocation made (and so
+//                first touched) by the calling thread: the dictionary block
+//                with its pointers rebased, then the n-gram tables.
+//
+// Inputs       : void
+// Outputs      : the replica, or NULL if failure
+struct LanguageModel *replicateModel(void) {
+  size_t rank_bytes = (sizeof(uint16_t) + sizeof(uint32_t)) * (BIGRAM_SPACE + TRIGRAM_SPACE);
+  size_t table_bytes = sizeof(float) * (BIGRAM_SPACE + TRIGRAM_SPACE);
+  size_t header_bytes = sizeof(struct LanguageModel) + sizeof(struct DictionaryCopy) + 2 * sizeof(struct NgramRanking);
+  header_bytes = (header_bytes + 63) & ~(size_t)63;
+  char *block = malloc(header_bytes + table_bytes + rank_bytes + dictionary.block_size);
+  if (block == NULL) {
+    return (NULL);
+  }
+
+  // Lay the copies out back to back, widest alignment first
+  struct LanguageModel *model = (struct LanguageModel *)block;
+  struct DictionaryCopy *words = (struct DictionaryCopy *)(model + 1);
+  struct NgramRanking *rankings = (struct NgramRanking *)(words + 1);
+  float *bigram_probs = (float *)(block + header_bytes), *trigram_probs = bigram_probs + BIGRAM_SPACE;
+  uint32_t *rank_counts = (uint32_t *)(trigram_probs + TRIGRAM_SPACE);
+  uint16_t *rank_indices = (uint16_t *)(rank_counts + BIGRAM_SPACE + TRIGRAM_SPACE);
+  char *dictionary_block = (char *)(rank_indices + BIGRAM_SPACE + TRIGRAM_SPACE);
+
+  memcpy(bigram_probs, bigram_log_probs, sizeof(bigram_log_probs));
+  memcpy(trigram_probs, trigram_log_probs, sizeof(trigram_log_probs));
+  memcpy(rank_counts, bigram_rank_count, sizeof(bigram_rank_count));
+  memcpy(rank_counts + BIGRAM_SPACE, trigram_rank_count, sizeof(trigram_rank_count));
+  memcpy(rank_indices, bigram_rank_index, sizeof(bigram_rank_index));
+  memcpy(rank_indices + BIGRAM_SPACE, trigram_rank_index, sizeof(trigram_rank_index));
+  rankings[0] = (struct NgramRanking){bigram_ranking.size, bigram_ranking.total, rank_indices, rank_counts};
+  rankings[1] = (struct NgramRanking){trigram_ranking.size, trigram_ranking.total, rank_indices + BIGRAM_SPACE,
+                                      rank_counts + BIGRAM_SPACE};
+
+  memcpy(dictionary_block, dictionary.block, dictionary.block_size);
+  *words = dictionary;
+  words->block = dictionary_block;
+  words->slots = rebase(dictionary.slots, dictionary.block, dictionary_block);
+  words->offsets = rebase(dictionary.offsets, dictionary.block, dictionary_block);
+  words->lengths = rebase(dictionary.lengths, dictionary.block, dictionary_block);
+  words->counts = rebase(dictionary.counts, dictionary.block, dictionary_block);
+  words->length_start = rebase(dictionary.length_start, dictionary.block, dictionary_block);
+  words->by_length = rebase(dictionary.by_length, dictionary.block, dictionary_block);
+  words->words = rebase(dictionary.words, dictionary.block, dictionary_block);
+
+  *model = (struct LanguageModel){words, bigram_probs, trigram_probs, &rankings[0], &rankings[1]};
+  return (model);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642AttachTextCounts
+// Description  : Hands the calling thread counts of a ciphertext made ahead of
+//                its analysis, so the substitution engines start from them
+//                instead of counting the text again
+//
+// Inputs       : ciphertext - the ciphertext the counts were made from
+//                clen - the length of the ciphertext
+//                counts - the counts (NULL to detach)
+// Outputs      : void
+void cs642AttachTextCounts(const char *ciphertext, int clen, const cs642TextCounts *counts) {
+  attached_text = (counts != NULL) ? ciphertext : NULL;
+  attached_length = (counts != NULL) ? clen : 0;
+  attached_counts = counts;
+}
+
+// Fills counts with the statistics of the ciphertext, copied from the counts
+// attached to this thread when they were made from the same text
+static void countCiphertext(cs642TextCounts *counts, const char *ciphertext, int clen) {
+  if (attached_counts != NULL && attached_text == ciphertext && attached_length == clen) {
+    memcpy(counts, attached_counts, sizeof(cs642TextCounts));
+    return;
+  }
+  cs642InitTextCounts(counts);
+  cs642CountText(counts, ciphertext, clen, cs642GetTuning(clen)->count_threads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642AttachModelReplica
+// Description  : Points the calling thread at the model replica of the node
+//                it runs on, copying the replica on this thread if it is the
+//                first of its node to ask
+//
+// Inputs       : void
+// Outputs      : the node of the thread, or -1 if failure (the shared model
+//                is used)
+int cs642AttachModelReplica(void) {
+  const cs642Topology *topology = cs642GetTopology();
+  int node = cs642CurrentNode();
+  int replicate = (replicate_models > 0) || (replicate_models == 0 && topology->nodes > 1);
+  if (replicate) {
+    ensureNgramModel(); // The replica copies the finished tables
+  }
+
+  int failed = 0;
+  pthread_mutex_lock(&node_models_lock);
+  if (replicate && node_models[node] == NULL && dictionary.block != NULL) {
+    node_models[node] = replicateModel();
+    failed = (node_models[node] == NULL);
+    if (!failed) {
+      logMessage(LOG_INFO_LEVEL, "Language model replicated on node %d.", node);
     }
   }
-  // Sort Bigrams into Array by Descending Frequency
-  int index = 0;
-  for (int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      // Create a bigram string (2 characters plus null terminator)
-      char bigram[3] = {i + 'A', j + 'A', '\0'};
-              
-      // Populate the struct
-      strcpy(bigramArray[index].bigram, bigram);
-      bigramArray[index].frequency = bigram_frequencies[i][j];
+  thread_model = (replicate && node_models[node] != NULL) ? node_models[node] : &shared_model;
+  thread_model_generation = __atomic_load_n(&model_generation, __ATOMIC_ACQUIRE);
+  pthread_mutex_unlock(&node_models_lock);
+  return (failed ? -1 : node);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ConfigureModelReplicas
+// Description  : Sets when the language model is replicated per memory node
+//
+// Inputs       : mode - -1 never, 0 on hosts with several nodes, 1 always
+// Outputs      : 0 if successful, -1 if failure
+int cs642ConfigureModelReplicas(int mode) {
+  if (mode < -1 || mode > 1) {
+    return (-1);
+  }
+  replicate_models = mode;
+  return (0);
+}
+
+// Frees every replica; threads fall back on the shared model (or reattach)
+void releaseModelReplicas(void) {
+  pthread_mutex_lock(&node_models_lock);
+  for (int node = 0; node < CS642_TOPOLOGY_MAX_NODES; node++) {
+    free(node_models[node]);
+    node_models[node] = NULL;
+  }
+  __atomic_add_fetch(&model_generation, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&node_models_lock);
+}
 
-      // Move to the next index
-      index++;
+// Returns the share of plaintext letters that belong to tokens that are whole
+// dictionary words (the confirmation test of the portfolio). A text whose
+// tokens run longer than SPACELESS_TOKEN_LENGTH on average has lost its
+// spaces, so its letters are instead credited by its best segmentation.
+double confirmPlaintext(const char *plaintext, int len) {
+  int covered = 0, total = 0, tokens = 0;
+  for (int i = 0; i < len;) {
+    if (!isalpha((unsigned char)plaintext[i])) {
+      i++;
+      continue;
+    }
+    int start = i;
+    while (i < len && isalpha((unsigned char)plaintext[i])) {
+      i++;
+    }
+    int length = i - start;
+    total += length;
+    tokens++;
+    if (length <= localModel()->dictionary->max_length &&
+        findDictionaryWord(plaintext + start, length, fingerprintText(plaintext + start, length)) >= 0) {
+      covered += length;
     }
   }
-  qsort(bigramArray, ALPHABET_SIZE * ALPHABET_SIZE, sizeof(struct BigramFrequency), compareBigramFrequencies);
+  if (tokens > 0 && total > SPACELESS_TOKEN_LENGTH * tokens) {
+    cs642Segmentation segmentation;
+    ensureWordTrie();
+    if (word_trie != NULL && !isnan(cs642TrieSegment(word_trie, plaintext, len, -INFINITY, &segmentation))) {
+      covered = segmentation.covered;
+    }
+  }
+  return ((total > 0) ? covered / (double)total : 0.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ScoreSegmentation
+// Description  : Scores a text that may have lost its spaces by its best
+//                segmentation into dictionary words
+//
+// Inputs       : text - the text to score
+//                len - the length of the text
+//                cutoff - the score below which scoring may stop early
+//                         (-INFINITY = never)
+//                words - the place to put the number of words (or NULL)
+//                covered - the place to put the letters in words (or NULL)
+// Outputs      : the log-likelihood of the segmentation (or a bound below
+//                cutoff), NAN if failure
+double cs642ScoreSegmentation(const char *text, int len, double cutoff, int *words, int *covered) {
+  cs642Segmentation segmentation = {0, 0, 0};
+  ensureWordTrie();
+  if (word_trie == NULL || text == NULL) {
+    return (NAN);
+  }
+  double score = cs642TrieSegment(word_trie, text, len, cutoff, &segmentation);
+  if (words != NULL) {
+    *words = segmentation.words;
+  }
+  if (covered != NULL) {
+    *covered = segmentation.covered;
+  }
+  return (score);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetModelTimings
+// Description  : Reports where the language model construction time went
+//
+// Inputs       : timings - the place to put the timings
+// Outputs      : 0 if successful, -1 if failure
+int cs642GetModelTimings(cs642ModelTimings *timings) {
+  if (timings == NULL) {
+    return (-1);
+  }
+  *timings = model_timings;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642StudentInit
+// Description  : This is a function that is called before any cryptanalysis
+//                occurs. Use it if you need to initialize some datastructures
+//                you may be reusing across ciphers.
+//
+// Inputs       : void
+// Outputs      : 0 if successful, -1 if failure
+int cs642StudentInit(void) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int dictSize = cs642GetDictSize();
+
+  // Size the snapshot (the hash set is kept at most half full)
+  size_t bytes = 0;
+  int max_length = 0;
+  for (int i = 0; i < dictSize; i++) {
+    int length = strlen(cs642GetWordfromDict(i).word);
+    bytes += length + 1;
+    max_length = (length > max_length) ? length : max_length;
+  }
+  uint32_t slots = 64;
+  while (slots < 2 * (uint32_t)dictSize) {
+    slots *= 2;
+  }
+
+  // Carve the slots, per-word arrays, length index and words out of one block
+  size_t slot_bytes = sizeof(struct DictionarySlot) * slots;
+  size_t index_bytes = sizeof(int) * (4 * (size_t)dictSize + max_length + 2);
+  dictionary.block_size = slot_bytes + index_bytes + bytes;
+  dictionary.block = malloc(dictionary.block_size);
+  if (dictionary.block == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Failed to allocate dictionary copy.");
+    return (-1);
+  }
+  dictionary.slots = dictionary.block;
+  dictionary.slot_mask = slots - 1;
+  dictionary.offsets = (int *)((char *)dictionary.block + slot_bytes);
+  dictionary.lengths = dictionary.offsets + dictSize;
+  dictionary.counts = dictionary.lengths + dictSize;
+  dictionary.by_length = dictionary.counts + dictSize;
+  dictionary.length_start = dictionary.by_length + dictSize;
+  dictionary.words = (char *)(dictionary.length_start + max_length + 2);
+  dictionary.size = dictSize;
+  dictionary.max_length = max_length;
+  dictionary.empty_words = 0;
+  memset(dictionary.in_words, 0x00, sizeof(dictionary.in_words));
+  memset(dictionary.length_start, 0x00, sizeof(int) * (max_length + 2));
+  for (uint32_t i = 0; i < slots; i++) {
+    dictionary.slots[i].word = -1;
+  }
 
-  /*** COUNT TRIGRAMS ***/
-  // Count Trigrams in Dictionary
-  int totalTrigrams = 0;
+  // Copy the words back to back, counting each length as we go
+  size_t offset = 0;
   for (int i = 0; i < dictSize; i++) {
     DictWord wordInfo = cs642GetWordfromDict(i); // Obtain individual word
-    char *word = wordInfo.word;
-    int count = wordInfo.count;
+    int length = strlen(wordInfo.word);
+    memcpy(dictionary.words + offset, wordInfo.word, length + 1);
+    dictionary.offsets[i] = (int)offset;
+    dictionary.lengths[i] = length;
+    dictionary.counts[i] = wordInfo.count;
+    dictionary.length_start[length + 1]++;
+    for (int j = 0; j < length; j++) {
+      dictionary.in_words[(uint8_t)wordInfo.word[j]] = 1;
+    }
+    offset += length + 1;
+  }
 
-    for(int i = 0; word[i] != '\0' && word[i + 1] != '\0' && word[i + 2] != '\0'; i++) {
-      if (isalpha(word[i]) && isalpha(word[i + 1]) && isalpha(word[i + 2])) {
-        char first = toupper(word[i]);
-        char second = toupper(word[i + 1]);
-        char third = toupper(word[i + 2]);
-        trigram_frequencies[first - 'A'][second - 'A'][third - 'A'] += count;
-        totalTrigrams++;
+  // Group the words by length
+  for (int length = 0; length <= max_length; length++) {
+    dictionary.length_start[length + 1] += dictionary.length_start[length];
+  }
+  int cursor[max_length + 1];
+  memcpy(cursor, dictionary.length_start, sizeof(cursor));
+  for (int i = 0; i < dictSize; i++) {
+    dictionary.by_length[cursor[dictionary.lengths[i]]++] = i;
+  }
+
+  // Insert the distinct words into the hash set
+  for (int i = 0; i < dictSize; i++) {
+    const char *word = dictionary.words + dictionary.offsets[i];
+    if (dictionary.lengths[i] == 0) {
+      dictionary.empty_words++;
+      continue;
+    }
+    uint64_t hash = fingerprintText(word, dictionary.lengths[i]);
+    int slot = findDictionaryWord(word, dictionary.lengths[i], hash);
+    if (slot < 0) {
+      for (slot = hash & dictionary.slot_mask; dictionary.slots[slot].word >= 0;
+           slot = (slot + 1) & dictionary.slot_mask) {
       }
+      dictionary.slots[slot] = (struct DictionarySlot){hash, i, 0};
     }
+    dictionary.slots[slot].multiplicity++;
   }
+  model_timings.dictionary_copy = elapsedSince(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-  // Convert counts to frequencies
+  // Initialize Letters in Letter Frequency Array
   for(int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      for (int k = 0; k < ALPHABET_SIZE; k++) {
-        trigram_frequencies[i][j][k] /= totalTrigrams;
-      }
-    }
+    letter_frequencies_struct[i].letter = i + 'A';
   }
 
-  // Sort Trigrams into Array by Descending Frequency
-  index = 0;
-  for (int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      for (int k = 0; k < ALPHABET_SIZE; k++) {
-        // Create a trigram string (3 characters plus null terminator)
-        char trigram[4] = {i + 'A', j + 'A', k + 'A', '\0'};
-              
-        // Populate the struct
-        strcpy(trigramArray[index].trigram, trigram);
-        trigramArray[index].frequency = trigram_frequencies[i][j][k];
+  /*** COUNT LETTERS ***/
+  uint64_t letter_counts[ALPHABET_SIZE] = {0};
+  uint64_t total_word_count = 0;
+  for (int i = 0; i < dictionary.size; i++) {
+    const char *word = dictionary.words + dictionary.offsets[i];
+    int count = dictionary.counts[i];
 
-        // Move to the next index
-        index++;
+    for (int j = 0; word[j] != '\0'; j++) { // Traverse characters of current word
+      if (isalpha(word[j])) {
+        letter_counts[toupper(word[j]) - 'A'] += count; // Increment by number of occurrences of letter / # words (i.e. 1 * count of word = count)
+        total_word_count += count;
       }
     }
   }
-  // Sort the trigram array
-  qsort(trigramArray, ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE, sizeof(struct TrigramFrequency), compareTrigramFrequencies);
 
-  // Print the sorted trigram frequencies
-  //for (int i = 0; i < ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE; i++) {
-  //  printf("Trigram: %s; Frequency: %f\n", trigramArray[i].trigram, trigramArray[i].frequency);
-  //}
-  
+  // Convert Counts to Frequencies
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    letter_frequencies_struct[i].frequency = letter_counts[i] / (double)total_word_count;
+    letter_frequencies[i] = letter_counts[i] / (double)total_word_count;
+  }
+  model_timings.letter_model = elapsedSince(&start);
+
+  // Bigram and trigram tables are left to ensureNgramModel()
   return 0;
 }
 
@@ -268,56 +887,42 @@ int cs642PerformROTXCryptanalysis(char *ciphertext, int clen, char *plaintext,
                                   int plen, uint8_t *key) {
 
   // Local Variable
-  char **plaintext_possibilities = (char **)malloc(26 * sizeof(char *)); 
-  if (plaintext_possibilities == NULL) {
-    perror("Memory allocation failed");
-    exit(EXIT_FAILURE);
-  }
-
-  // Calculate All Possible Shifts of the Ciphertext
-  for(int k = 0; k < 26; k++) {
-    plaintext_possibilities[k] = (char *)malloc(clen + 1);
-    if (plaintext_possibilities[k] == NULL) {
-      perror("Memory allocation failed");
-      exit(EXIT_FAILURE);
+  cs642Arena *arena = cs642ScratchArena();
+  char *plaintext_possibilities = borrowBatchPlaintexts(arena, clen);
+  int stride = clen + 1;
+
+  // Decrypt a batch of shifts per pass over the ciphertext, checking them in order
+  int found = 0;
+  for (int first = 0; first < 26; first += EVALUATION_BATCH) {
+    int lanes = (26 - first < EVALUATION_BATCH) ? 26 - first : EVALUATION_BATCH;
+    char shift_keys[EVALUATION_BATCH][2];
+    char *keys[EVALUATION_BATCH];
+    int periods[EVALUATION_BATCH];
+    for (int k = 0; k < lanes; k++) {
+      shift_keys[k][0] = first + k + 'A';
+      shift_keys[k][1] = '\0';
+      keys[k] = shift_keys[k];
+      periods[k] = 1;
     }
-
-    // Shift each character in ciphertext by current key value (exclude spaces)
-    for(int i = 0; i < clen; i++) {
-      if(ciphertext[i] != 32) { // Exclude Spaces in Shift
-        plaintext_possibilities[k][i] = (ciphertext[i] - 'A' - k + 26) % 26 + 'A';
-      }
-      else { // Preserve Spaces in Plaintext
-        plaintext_possibilities[k][i] = ' ';
+    decryptShiftBatch(ciphertext, clen, keys, periods, lanes, plaintext_possibilities, stride);
+
+    // Locate Valid Plaintext From Possibilities
+    for (int k = 0; k < lanes && !(found && candidate_sink == NULL); k++) {
+      int score = getNumberWordsFromDict(plaintext_possibilities + k * stride);
+      offerCandidate(shift_keys[k], 1, score, plaintext_possibilities + k * stride);
+      if(!found && score > cs642GetTuning(clen)->word_threshold) { // Checks if at least
+        strcpy(plaintext, plaintext_possibilities + k * stride);
+        *key = first + k;
+        found = 1;
       }
     }
-    plaintext_possibilities[k][clen] = '\0'; // Null Terminate Translation
-  }
-
-  // Locate Valid Plaintext From Possibilities
-  for (int i = 0; i < 26; i++) {
-    // Identify if translation contains two most frequent words ("ALICE" and "THE")
-    /*char* result_the = strstr(plaintext_possibilities[i], " THE ");
-    char* result_alice = strstr(plaintext_possibilities[i], " ALICE ");
-    if(result_the != NULL && result_alice != NULL) {
-      strcpy(plaintext, plaintext_possibilities[i]);
-      *key = i;
-      break;
-    }*/
-    if(getNumberWordsFromDict(plaintext_possibilities[i]) > 400) { // Checks if at least
-      strcpy(plaintext, plaintext_possibilities[i]);
-      *key = i;
-      break;
+    if (found && candidate_sink == NULL) {
+      break; // Keep scoring the other shifts only when collecting candidates
     }
   }
-  //cs642Decrypt(CIPHER_ROTX, key, ALPHABET_SIZE, plaintext, plen, ciphertext, clen);
-  //printf("CIPHER WORDS: %d\n", getNumberWordsFromDict(plaintext));
 
-  // Free Allocated Memory
-  for (int i = 0; i < 26; i++) {
-    free(plaintext_possibilities[i]);
-  }
-  free(plaintext_possibilities);
+  // Return the scratch to the arena
+  cs642ArenaReset(arena);
 
   // Return successfully
   return (0);
@@ -336,11 +941,7 @@ int cs642PerformROTXCryptanalysis(char *ciphertext, int clen, char *plaintext,
 // Outputs      : 0 if successful, -1 if failure
 
 double calculateChiSquared(double observed[], double expected[]) {
-    double chiSquared = 0.0;
-    for (int i = 0; i < 26; i++) {
-        chiSquared += ((observed[i] - expected[i]) * (observed[i] - expected[i])) / expected[i];
-    }
-    return chiSquared;
+    return cs642GetKernels()->chi_squared(observed, expected);
 }
 
 int findBestKey(double observed[], double expected[]) {
@@ -366,97 +967,294 @@ int findBestKey(double observed[], double expected[]) {
     return bestKey;
 }
 
-int cs642PerformVIGECryptanalysis(char *ciphertext, int clen, char *plaintext,
-                                  int plen, char *key) {
-  // Iterate through all possible key lengths
-  for(int possible_key = 6; possible_key <= 11; possible_key++) {
-    char group_keys[possible_key + 1]; // Each idx corresponds to best cipher group key (complete array = key candidate)
-
-    // Form cipher groups by assigning each char index in cipher text to a group number (1 - key length)
-    char** cipher_groups = (char**)malloc(sizeof(char*) * possible_key); // Array of all ciphertext groups
-    if (cipher_groups == NULL) {
-      fprintf(stderr, "Memory allocation failed\n");
-      return 1; // Return an error code
-    }
-
-    // Allocate memory for each cipher group
-    for (int i = 0; i < possible_key; i++) {
-      cipher_groups[i] = (char*)malloc(sizeof(char) * (clen / possible_key) + 1);
-      if (cipher_groups[i] == NULL) {
-        fprintf(stderr, "Memory allocation for group %d failed\n", i);
-        for (int j = 0; j < i; j++) {
-          free(cipher_groups[j]);
-        }
-        free(cipher_groups);
-        return 1;
-      }
-    }
+// Struct to hold letter histograms for every (period, column) pair of the
+// candidate Vigenere periods. Columns of period p start at columnOffset(p).
+struct VigenereColumnTable {
+  uint32_t counts[VIGE_COLUMNS][ALPHABET_SIZE]; // Letter counts per column
+  uint32_t totals[VIGE_COLUMNS];                // Letters per column
+};
 
-    // Form groups from the ciphertext
-    for (int i = 0; i < clen; i++) {
-      int group_index = i % possible_key; // Calculate group index of ith letter
-      cipher_groups[group_index][i / possible_key] = ciphertext[i]; // Add ith letter to position i / key_length in group
-    }
+// Returns the first column of a period in the column table
+static inline int columnOffset(int period) {
+  return (period - VIGE_MIN_PERIOD) * (period + VIGE_MIN_PERIOD - 1) / 2;
+}
 
-    // Null-terminate each group (allows groups to be viewed as strings)
-    for (int group_index = 0; group_index < possible_key; group_index++) {
-      cipher_groups[group_index][clen / possible_key] = '\0';
+// Adds the column histograms of a ciphertext to a table. position is where the
+// ciphertext starts in its stream (spaces count as positions): 0 aligns every
+// message under one key, the length received so far continues a stream.
+void accumulateVigenereColumnTable(const char *ciphertext, int clen, struct VigenereColumnTable *table,
+                                   size_t position) {
+  cs642CountColumns(table->counts, ciphertext, clen, position, VIGE_MIN_PERIOD, VIGE_MAX_PERIOD, 0);
+  for (int column = 0; column < VIGE_COLUMNS; column++) {
+    table->totals[column] = 0;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      table->totals[column] += table->counts[column][i];
     }
+  }
+}
 
-    // Calculate Letter Frequencies in Each Group and Determine Most Likely Key for Each Group
-    for (int group_index = 0; group_index < possible_key; group_index++) {
-      // Count Letter Occurrences in Each Group
-      double observed_letter_frequencies[26] = {0};
-      int total_group_chars = 0;
-      for(int i = 0; cipher_groups[group_index][i] != '\0'; i++) {
-        if (isalpha(cipher_groups[group_index][i])) {
-          char temp = toupper(cipher_groups[group_index][i]); // Convert to uppercase
-          observed_letter_frequencies[temp - 'A']++; // Count letter occurrence
-          total_group_chars++; // Increment total number of characters
-        }
-      }
+// Fills the column histograms of every candidate period in one pass over the ciphertext
+void buildVigenereColumnTable(const char *ciphertext, int clen, struct VigenereColumnTable *table) {
+  memset(table, 0x00, sizeof(struct VigenereColumnTable));
+  accumulateVigenereColumnTable(ciphertext, clen, table, 0);
+}
 
-      // Convert Counts to Frequencies
-      for(int i = 0; i < 26; i++) {
-        observed_letter_frequencies[i] = observed_letter_frequencies[i] / (double)total_group_chars;
-      }
+// Returns the average index of coincidence of the columns of a period
+double periodCoincidence(const struct VigenereColumnTable *table, int period) {
+  double coincidence = 0.0;
+  for (int column = columnOffset(period); column < columnOffset(period) + period; column++) {
+    double total = table->totals[column];
+    if (total < 2) {
+      continue;
+    }
+    double matches = 0.0;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      matches += (double)table->counts[column][i] * (table->counts[column][i] - 1);
+    }
+    coincidence += matches / (total * (total - 1));
+  }
+  return coincidence / period;
+}
 
-      // Determine Best Key for Current Group
-      group_keys[group_index] = findBestKey(observed_letter_frequencies, letter_frequencies);
+// Orders the candidate periods by descending index of coincidence
+void rankVigenerePeriods(const struct VigenereColumnTable *table, int periods[VIGE_PERIODS]) {
+  double coincidence[VIGE_PERIODS];
+  for (int p = 0; p < VIGE_PERIODS; p++) {
+    double current = periodCoincidence(table, p + VIGE_MIN_PERIOD);
+    int slot = p;
+    while (slot > 0 && coincidence[slot - 1] < current) { // Insertion sort (stable for ties)
+      periods[slot] = periods[slot - 1];
+      coincidence[slot] = coincidence[slot - 1];
+      slot--;
     }
-    
-    // Store Current Group Key in Key Variable (for potential break and return)
-    for (int i = 0; i < possible_key; i++) {
-      key[i] = group_keys[i] + 'A';
+    periods[slot] = p + VIGE_MIN_PERIOD;
+    coincidence[slot] = current;
+  }
+}
+
+// Determines the most likely key of a period from the letter frequencies of its columns
+void deriveVigenereKey(const struct VigenereColumnTable *table, int period, char *key) {
+  for (int group_index = 0; group_index < period; group_index++) {
+    int column = columnOffset(period) + group_index;
+    double observed_letter_frequencies[26];
+    for(int i = 0; i < 26; i++) {
+      observed_letter_frequencies[i] = table->counts[column][i] / (double)table->totals[column];
     }
+    key[group_index] = findBestKey(observed_letter_frequencies, letter_frequencies) + 'A';
+  }
+  key[period] = '\0';
+}
 
-    // Decrypt Ciphertext with Key Candidate
-    cs642Decrypt(CIPHER_VIGE, key, possible_key, plaintext, plen, ciphertext, clen);
+// Struct to hold the ciphertext letter pairs of a period that straddle two
+// adjacent columns (column c then c + 1, the last column then the first)
+struct VigenerePairs {
+  int start[VIGE_MAX_PERIOD + 1];                 // Pairs of boundary c are start[c] .. start[c + 1] - 1
+  uint16_t pairs[VIGE_MAX_PERIOD * BIGRAM_SPACE]; // Cipher letter pair (a BIGRAM_INDEX)
+  uint32_t counts[VIGE_MAX_PERIOD * BIGRAM_SPACE]; // Occurrences of the pair
+};
 
-    // Identify if decryption contains two most frequent words ("ALICE" and "THE")
-    //char* result_the = strstr(plaintext, " THE ");
-    //char* result_alice = strstr(plaintext, " ALICE ");
-    if(getNumberWordsFromDict(plaintext) > 400) {
-      for (int i = 0; i < possible_key; i++) {
-        free(cipher_groups[i]);
+// Lists the letter pairs across every column boundary of a period (a space
+// between two letters breaks the pair but still takes a key position)
+void buildVigenerePairs(const char *ciphertext, int clen, int period, struct VigenerePairs *pairs) {
+  uint32_t dense[VIGE_MAX_PERIOD][BIGRAM_SPACE];
+  uint8_t codes[CODE_BLOCK];
+  memset(dense, 0x00, sizeof(uint32_t) * BIGRAM_SPACE * period);
+  int previous = CS642_KERNEL_NONLETTER, column = period - 1; // Column of the previous character
+  for (int base = 0; base < clen; base += CODE_BLOCK) {
+    int block = (clen - base < CODE_BLOCK) ? clen - base : CODE_BLOCK;
+    cs642GetKernels()->letter_codes(ciphertext + base, block, codes);
+    for (int i = 0; i < block; i++) {
+      if (previous != CS642_KERNEL_NONLETTER && codes[i] != CS642_KERNEL_NONLETTER) {
+        dense[column][BIGRAM_INDEX(previous, codes[i])]++;
+      }
+      previous = codes[i];
+      column = (column + 1 == period) ? 0 : column + 1;
+    }
+  }
+
+  int count = 0;
+  for (int c = 0; c < period; c++) {
+    pairs->start[c] = count;
+    for (int i = 0; i < BIGRAM_SPACE; i++) {
+      if (dense[c][i] > 0) {
+        pairs->pairs[count] = (uint16_t)i;
+        pairs->counts[count++] = dense[c][i];
+      }
+    }
+  }
+  pairs->start[period] = count;
+}
+
+// Returns a cipher letter decrypted by an encryption shift
+static inline int unshift(int letter, int shift) {
+  return ((letter >= shift) ? letter - shift : letter + ALPHABET_SIZE - shift);
+}
+
+// Returns the bigram log-likelihood of the pairs across a column boundary
+// decrypted with the shifts of the columns on either side
+static double boundaryScore(const struct VigenerePairs *pairs, const float *log_probs, int boundary, int left,
+                            int right) {
+  double score = 0.0;
+  for (int n = pairs->start[boundary]; n < pairs->start[boundary + 1]; n++) {
+    int first = pairs->pairs[n] / ALPHABET_SIZE, second = pairs->pairs[n] % ALPHABET_SIZE;
+    score += pairs->counts[n] * log_probs[BIGRAM_INDEX(unshift(first, left), unshift(second, right))];
+  }
+  return (score);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : refineVigenereKey
+// Description  : Adjusts the per-column key of a period jointly, two adjacent
+//                columns at a time. Every pair of shifts is scored by the
+//                monogram log-likelihood of both columns plus the bigram
+//                log-likelihood of the three column boundaries they touch,
+//                all from the column histograms and boundary pair counts (no
+//                decryption). Sweeps until no pair of columns changes.
+//
+// Inputs       : ciphertext - the ciphertext
+//                clen - the length of the ciphertext
+//                table - the column histograms of the ciphertext
+//                period - the period of the key
+//                key - the key to refine (letters 'A' + shift), in place
+// Outputs      : the number of key letters changed
+int refineVigenereKey(const char *ciphertext, int clen, const struct VigenereColumnTable *table, int period,
+                      char *key) {
+  ensureNgramModel();
+  const float *log_probs = localModel()->bigram_log_probs;
+  struct VigenerePairs pairs;
+  buildVigenerePairs(ciphertext, clen, period, &pairs);
+
+  // Monogram log-likelihood of every column under every shift
+  double monogram[VIGE_MAX_PERIOD][ALPHABET_SIZE], log_frequency[ALPHABET_SIZE];
+  for (int l = 0; l < ALPHABET_SIZE; l++) {
+    log_frequency[l] = log(letter_frequencies[l] + 1e-6);
+  }
+  for (int c = 0; c < period; c++) {
+    const uint32_t *counts = table->counts[columnOffset(period) + c];
+    for (int shift = 0; shift < ALPHABET_SIZE; shift++) {
+      monogram[c][shift] = 0.0;
+      for (int l = 0; l < ALPHABET_SIZE; l++) {
+        monogram[c][shift] += counts[l] * log_frequency[unshift(l, shift)];
       }
-      free(cipher_groups);
-      break;
     }
-    /*if(result_the != NULL && result_alice != NULL) { // Free Allocated Data and Break Loop (Key + Plaintext Found)
-      for (int i = 0; i < possible_key; i++) {
-        free(cipher_groups[i]);
+  }
+
+  int shifts[VIGE_MAX_PERIOD], changed = 0;
+  for (int c = 0; c < period; c++) {
+    shifts[c] = key[c] - 'A';
+  }
+  for (int sweep = 0; sweep < VIGE_REFINE_SWEEPS; sweep++) {
+    int moved = 0;
+    for (int c = 0; c < period; c++) {
+      int next = (c + 1) % period, before = (c + period - 1) % period, after = (next + 1) % period;
+
+      // Boundaries on the outer sides depend on one free shift each
+      double outer_left[ALPHABET_SIZE], outer_right[ALPHABET_SIZE];
+      for (int shift = 0; shift < ALPHABET_SIZE; shift++) {
+        outer_left[shift] = monogram[c][shift] + boundaryScore(&pairs, log_probs, before, shifts[before], shift);
+        outer_right[shift] = monogram[next][shift] + boundaryScore(&pairs, log_probs, next, shift, shifts[after]);
       }
-      free(cipher_groups);
+
+      // The shared boundary depends on both: accumulate it for every pair of shifts
+      double joint[ALPHABET_SIZE][ALPHABET_SIZE] = {{0.0}};
+      for (int n = pairs.start[c]; n < pairs.start[c + 1]; n++) {
+        int first = pairs.pairs[n] / ALPHABET_SIZE, second = pairs.pairs[n] % ALPHABET_SIZE;
+        for (int left = 0; left < ALPHABET_SIZE; left++) {
+          const float *row = log_probs + BIGRAM_INDEX(unshift(first, left), 0);
+          for (int right = 0; right < ALPHABET_SIZE; right++) {
+            joint[left][right] += pairs.counts[n] * row[unshift(second, right)];
+          }
+        }
+      }
+      int best_left = shifts[c], best_right = shifts[next];
+      double best = joint[best_left][best_right] + outer_left[best_left] + outer_right[best_right];
+      for (int left = 0; left < ALPHABET_SIZE; left++) {
+        for (int right = 0; right < ALPHABET_SIZE; right++) {
+          double score = joint[left][right] + outer_left[left] + outer_right[right];
+          if (score > best + 1e-9) {
+            best = score;
+            best_left = left;
+            best_right = right;
+          }
+        }
+      }
+      moved += (best_left != shifts[c]) + (best_right != shifts[next]);
+      shifts[c] = best_left;
+      shifts[next] = best_right;
+    }
+    changed += moved;
+    if (moved == 0) {
       break;
-    }*/
-    else { // Free Allocated Data and Continue w/ Next Key Length
-      for (int i = 0; i < possible_key; i++) {
-        free(cipher_groups[i]);
+    }
+  }
+
+  for (int c = 0; c < period; c++) {
+    key[c] = (char)('A' + shifts[c]);
+  }
+  return (changed);
+}
+
+int cs642PerformVIGECryptanalysis(char *ciphertext, int clen, char *plaintext,
+                                  int plen, char *key) {
+  // Count letters for every (period, column) pair in a single pass
+  struct VigenereColumnTable table;
+  buildVigenereColumnTable(ciphertext, clen, &table);
+
+  // Estimate the key length: try periods by descending index of coincidence
+  int periods[VIGE_PERIODS];
+  rankVigenerePeriods(&table, periods);
+
+  // Decryptions after the accepted one (only made when collecting candidates) go to scratch
+  cs642Arena *arena = NULL;
+  char *scratch = NULL;
+  if (candidate_sink != NULL) {
+    arena = cs642ScratchArena();
+    if (cs642ArenaReserve(arena, plen + 1) || (scratch = cs642ArenaAlloc(arena, plen + 1)) == NULL) {
+      return (-1);
+    }
+  }
+
+  // Iterate through all possible key lengths (those the tuning band allows)
+  const cs642Tuning *tuning = cs642GetTuning(clen);
+  int found = 0;
+  double best_confidence = -1.0;
+  for(int attempt = 0; attempt < VIGE_PERIODS && !(found && candidate_sink == NULL); attempt++) {
+    int possible_key = periods[attempt];
+    char candidate[VIGE_MAX_PERIOD + 1];
+    if (possible_key < tuning->vige_min_period || possible_key > tuning->vige_max_period) {
+      continue;
+    }
+
+    deriveVigenereKey(&table, possible_key, candidate);
+    if (clen < VIGE_REFINE_LETTERS * possible_key) {
+      refineVigenereKey(ciphertext, clen, &table, possible_key, candidate); // Columns too short to trust alone
+    }
+
+    // Decrypt Ciphertext with Key Candidate
+    char *decrypted = found ? scratch : plaintext;
+    cs642Decrypt(CIPHER_VIGE, candidate, possible_key, decrypted, plen, ciphertext, clen);
+
+    // Identify if decryption contains enough dictionary words, or (for texts
+    // too short for that many) is mostly made of them. The key of the most
+    // convincing attempt is kept if none is confirmed.
+    int score = getNumberWordsFromDict(decrypted);
+    offerCandidate(candidate, possible_key, score, decrypted);
+    if (!found) {
+      double confidence = confirmPlaintext(decrypted, clen);
+      found = score > tuning->word_threshold || confidence >= VIGE_CONFIRMATION;
+      if (found || confidence > best_confidence) {
+        memcpy(key, candidate, possible_key + 1);
+        best_confidence = confidence;
       }
-      free(cipher_groups);
     }
   }
+  if (!found) {
+    cs642Decrypt(CIPHER_VIGE, key, strlen(key), plaintext, plen, ciphertext, clen);
+  }
+  if (arena != NULL) {
+    cs642ArenaReset(arena);
+  }
 
   // Return successfully
   return (0);
@@ -474,87 +1272,262 @@ int countWords(const char *text) {
   return count + 1;
 }
 
-// Function to calculate bigram frequency
-void calculateBigramFrequencies(char *text, double bigramFrequencies[ALPHABET_SIZE][ALPHABET_SIZE]) {
-    int totalBigrams = 0;
+// Struct to store letters, their matches, and the estimated distance between them
+struct LetterMatching {
+  char self;       // Alphabet Character
+  char match;      // Matching character in ciphertext
+  double distance; // Estimated distance between two characters; Approaching 0 --> Better Match
+};
+
+// Struct to track the time and evaluation budget of a substitution search
+struct SubsSearchBudget {
+  struct timespec deadline; // Monotonic time at which the search must stop
+  int has_deadline;         // Whether the deadline applies
+  long max_evaluations;     // Maximum key evaluations (0 = unlimited)
+  long evaluations;         // Key evaluations performed so far
+  long memo_hits;           // Evaluations answered by the score memo instead
+  const int *cancel;        // Set by another thread to stop the search (NULL = never)
+  int exhausted;            // Set once either limit has been reached
+};
 
-    for (int i = 0; text[i] != '\0' && text[i + 1] != '\0'; i++) {
-        if (isalpha(text[i]) && isalpha(text[i + 1])) {
-            char first = toupper(text[i]);
-            char second = toupper(text[i + 1]);
+// Struct to represent an entry of the key score memo
+struct ScoreMemoSlot {
+  uint64_t hash; // Hash of the 26-byte key (0 = empty)
+  int32_t score; // Dictionary score of the key
+};
 
-            bigramFrequencies[first - 'A'][second - 'A']++;
-            totalBigrams++;
-        }
+// Struct to hold the statistics and evolving state of a substitution search
+struct SubsSearch {
+  char *ciphertext;                    // Ciphertext being analyzed
+  int clen;                            // Length of the ciphertext
+  cs642Arena *arena;                   // Scratch arena the plaintexts are borrowed from
+  char *plaintexts;                    // Scratch for a batch of candidate plaintexts
+  struct SubsSearchBudget *budget;     // Budget charged for every evaluation
+  const cs642Tuning *tuning;           // Parameters of the ciphertext length band
+
+  struct LetterFrequency observed_letters[ALPHABET_SIZE]; // Ciphertext letters (reordered by the monogram phase)
+  struct LetterFrequency expected_letters[ALPHABET_SIZE]; // Model letters by descending frequency
+  uint16_t bigram_index[BIGRAM_SPACE];   // Storage of the observed bigram ranking
+  uint32_t bigram_count[BIGRAM_SPACE];
+  uint16_t trigram_index[TRIGRAM_SPACE]; // Storage of the observed trigram ranking
+  uint32_t trigram_count[TRIGRAM_SPACE];
+  struct NgramRanking observed_ngrams[2]; // Observed bigram and trigram rankings
+
+  struct LetterMatching matching[ALPHABET_SIZE]; // Current letter matching
+  int self_slot[ALPHABET_SIZE];                  // Letter -> matching slot (never changes)
+  int match_slot[ALPHABET_SIZE];                 // Matched letter -> matching slot
+  uint32_t pinned;                               // Matching slots fixed by a crib (never swapped)
+  char best_key[ALPHABET_SIZE + 1];              // Best key found so far
+  int best_number;                               // Dictionary score of the best key
+  int increment_distance;                        // Matching threshold step of the current phase
+  int attempts;                                  // Attempts of the current phase
+  int updates;                                   // Improvements of the current phase
+  int phase;                                     // Phase being run (enum SubsPhase)
+  int letter;                                    // Next matching slot of the n-gram phases
+  uint64_t fingerprint;                          // Hash of the ciphertext (names the checkpoint)
+  int checkpointed;                              // Whether this search saves checkpoints (the swap search only)
+  struct timespec last_checkpoint;               // When the state was last saved
+  struct ScoreMemoSlot memo[SCORE_MEMO_SLOTS];   // Scores of the keys already evaluated
+};
+
+// Phases of a substitution search, in the order they run
+enum SubsPhase {
+  SUBS_PHASE_MONOGRAM = 0,
+  SUBS_PHASE_BIGRAM = 1,
+  SUBS_PHASE_TRIGRAM = 2,
+  SUBS_PHASE_DONE = 3
+};
+
+// Struct to hold the checkpoint settings of substitution searches
+struct SubsCheckpointConfig {
+  int enabled;                     // Whether searches save checkpoints
+  int resume;                      // Whether searches resume from existing checkpoints
+  double interval;                 // Seconds between checkpoints
+  char prefix[CHECKPOINT_PREFIX];  // Checkpoint files are <prefix>.<fingerprint>
+};
+
+// Struct to represent the on-disk checkpoint of a substitution search
+struct SubsCheckpointRecord {
+  char magic[8];                        // CHECKPOINT_MAGIC
+  uint32_t version;                     // CHECKPOINT_VERSION
+  uint32_t clen;                        // Length of the ciphertext
+  uint64_t fingerprint;                 // Hash of the ciphertext
+  int32_t phase;                        // Phase being run
+  int32_t letter;                       // Next matching slot of the n-gram phases
+  int32_t increment_distance;           // Matching threshold step
+  int32_t attempts;                     // Attempts of the current phase
+  int32_t updates;                      // Improvements of the current phase
+  int32_t best_number;                  // Score of the best key
+  int64_t evaluations;                  // Key evaluations spent so far
+  char best_key[ALPHABET_SIZE + 1];     // Best key found so far
+  char observed_letters[ALPHABET_SIZE]; // Ciphertext letters in monogram order
+  char matches[ALPHABET_SIZE];          // Matched letter of each matching slot
+  double observed_frequencies[ALPHABET_SIZE];
+  double distances[ALPHABET_SIZE];      // Match distance of each matching slot
+};
+
+struct SubsCheckpointConfig subs_checkpoint = {0, 0, 0.0, ""};
+int subs_beam_width = 0; // Beam width of cs642PerformSUBSCryptanalysis (0 = swap search)
+int subs_portfolio = 0;  // Engines raced by cs642PerformSUBSCryptanalysis (0 = no portfolio)
+int subs_anneal = 0;     // Whether cs642PerformSUBSCryptanalysis anneals (with subs_anneal_schedule)
+cs642AnnealSchedule subs_anneal_schedule;
+
+// Struct to represent a speculative swap candidate of the bigram/trigram phases
+struct SwapCandidate {
+  char key[ALPHABET_SIZE + 1]; // Candidate key
+  int rank;                    // Rank of the observed n-gram that produced it
+  int swap_idx;                // Matching slot swapped with the current letter
+  int pair_indices[2];         // Matching slots of the other letters of the n-gram
+  double frequency;            // Expected frequency of the n-gram of equal rank
+};
+
+// Initializes a search budget from the caller's limits (NULL = unlimited)
+void initSubsSearchBudget(struct SubsSearchBudget *budget, const cs642SubsBudget *limits) {
+  memset(budget, 0x00, sizeof(struct SubsSearchBudget));
+  if (limits == NULL) {
+    return;
+  }
+  budget->max_evaluations = limits->max_evaluations;
+  if (limits->time_limit > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &budget->deadline);
+    budget->deadline.tv_sec += (time_t)limits->time_limit;
+    budget->deadline.tv_nsec += (long)((limits->time_limit - (time_t)limits->time_limit) * 1e9);
+    if (budget->deadline.tv_nsec >= 1000000000L) {
+      budget->deadline.tv_sec++;
+      budget->deadline.tv_nsec -= 1000000000L;
     }
-    //printf("BIGRAM TOTAL: %d\n", totalBigrams);
-    // Convert counts to frequencies
-    for (int i = 0; i < ALPHABET_SIZE; i++) {
-        for (int j = 0; j < ALPHABET_SIZE; j++) {
-            //printf("%d\n", totalBigrams);
-            bigramFrequencies[i][j] /= (double)totalBigrams;
-            //printf("FREQ: %f\n", bigramFrequencies[i][j]);
-        }
+    budget->has_deadline = 1;
+  }
+}
+
+// Charges evaluations against the budget (the clock read is negligible next to the dictionary scan)
+void chargeSubsSearchBudget(struct SubsSearchBudget *budget, int evaluations) {
+  budget->evaluations += evaluations;
+  if (budget->cancel != NULL && __atomic_load_n(budget->cancel, __ATOMIC_RELAXED)) {
+    budget->exhausted = 1;
+  }
+  if (budget->max_evaluations > 0 && budget->evaluations >= budget->max_evaluations) {
+    budget->exhausted = 1;
+  }
+  if (budget->has_deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > budget->deadline.tv_sec ||
+        (now.tv_sec == budget->deadline.tv_sec && now.tv_nsec >= budget->deadline.tv_nsec)) {
+      budget->exhausted = 1;
     }
+  }
 }
 
-// Function to calculate trigram frequencies
-void calculateTrigramFrequencies(char *text, double trigramFrequencies[ALPHABET_SIZE][ALPHABET_SIZE][ALPHABET_SIZE]) {
-    int totalTrigrams = 0;
+// Returns the memo hash of a key (never 0, which marks an empty slot)
+uint64_t scoreMemoHash(const char *key) {
+  uint64_t hash = fingerprintText(key, ALPHABET_SIZE);
+  return (hash != 0) ? hash : 1;
+}
 
-    for (int i = 0; text[i] != '\0' && text[i + 1] != '\0' && text[i + 2] != '\0'; i++) {
-        if (isalpha(text[i]) && isalpha(text[i + 1]) && isalpha(text[i + 2])) {
-            char first = toupper(text[i]);
-            char second = toupper(text[i + 1]);
-            char third = toupper(text[i + 2]);
+// Looks a key up in the score memo, returning 1 and its score if it is there
+int lookupScoreMemo(const struct SubsSearch *search, uint64_t hash, int *score) {
+  for (int probe = 0; probe < SCORE_MEMO_PROBES; probe++) {
+    const struct ScoreMemoSlot *slot = &search->memo[(hash + probe) & (SCORE_MEMO_SLOTS - 1)];
+    if (slot->hash == hash) {
+      *score = slot->score;
+      return (1);
+    }
+    if (slot->hash == 0) {
+      break;
+    }
+  }
+  return (0);
+}
 
-            trigramFrequencies[first - 'A'][second - 'A'][third - 'A']++;
-            totalTrigrams++;
-        }
+// Records the score of a key in the memo, evicting the entry in its home slot
+// once all of its probe slots are taken
+void storeScoreMemo(struct SubsSearch *search, uint64_t hash, int score) {
+  struct ScoreMemoSlot *home = &search->memo[hash & (SCORE_MEMO_SLOTS - 1)];
+  for (int probe = 0; probe < SCORE_MEMO_PROBES; probe++) {
+    struct ScoreMemoSlot *slot = &search->memo[(hash + probe) & (SCORE_MEMO_SLOTS - 1)];
+    if (slot->hash == 0 || slot->hash == hash) {
+      home = slot;
+      break;
     }
+  }
+  home->hash = hash;
+  home->score = score;
+}
 
-    // Convert counts to frequencies
-    for (int i = 0; i < ALPHABET_SIZE; i++) {
-        for (int j = 0; j < ALPHABET_SIZE; j++) {
-            for (int k = 0; k < ALPHABET_SIZE; k++) {
-                trigramFrequencies[i][j][k] /= (double)totalTrigrams;
-            }
-        }
+// Returns whether the memo holds the score of every key (scoring them is free)
+int memoHoldsKeys(const struct SubsSearch *search, char **keys, int count) {
+  int score;
+  for (int k = 0; k < count; k++) {
+    if (!lookupScoreMemo(search, scoreMemoHash(keys[k]), &score)) {
+      return (0);
     }
+  }
+  return (1);
 }
 
-// Struct to store letters, their matches, and the estimated distance between them
-struct LetterMatching {
-  char self;       // Alphabet Character
-  char match;      // Matching character in ciphertext
-  double distance; // Estimated distance between two characters; Approaching 0 --> Better Match
-};
+// Scores a batch of key candidates, answering revisited keys from the memo and
+// decrypting the rest in one pass over the ciphertext
+void evaluateSubsKeys(struct SubsSearch *search, char **keys, int count, int *scores) {
+  uint64_t hashes[count];
+  char *pending[count];
+  int pending_index[count];
+  int misses = 0;
+  for (int k = 0; k < count; k++) {
+    hashes[k] = scoreMemoHash(keys[k]);
+    if (lookupScoreMemo(search, hashes[k], &scores[k])) {
+      search->budget->memo_hits++;
+    } else {
+      pending[misses] = keys[k];
+      pending_index[misses++] = k;
+    }
+  }
+  if (misses > 0) {
+    decryptSubsBatch(search->ciphertext, search->clen, pending, misses, search->plaintexts, search->clen + 1);
+  }
+  for (int m = 0; m < misses; m++) {
+    int k = pending_index[m];
+    scores[k] = getNumberWordsFromDict(search->plaintexts + m * (search->clen + 1));
+    storeScoreMemo(search, hashes[k], scores[k]);
+    offerCandidate(keys[k], ALPHABET_SIZE, scores[k], search->plaintexts + m * (search->clen + 1));
+  }
+  chargeSubsSearchBudget(search->budget, misses);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : cs642PerformSUBSCryptanalysis
-// Description  : This is the function to cryptanalyze the substitution cipher
+// Function     : prepareSubsSearch
+// Description  : Prepares a search from ciphertext statistics, starting from
+//                the monogram matching or, when warm_key is given, from that
+//                key (the bigram/trigram phases then refine it)
 //
-// Inputs       : ciphertext - the ciphertext to analyze
-//                clen - the length of the ciphertext
-//                plaintext - the place to put the plaintext in
-//                plen - the length of the plaintext
-//                key - the place to put the key in
-// Outputs      : 0 if successful, -1 if failure
-int cs642PerformSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
-                                  int plen, char *key) {
+// Inputs       : search - the search to prepare
+//                ciphertext - the text candidate keys are scored on
+//                clen - the length of that text
+//                budget - the search budget
+//                counts - the ciphertext letter and n-gram counts
+//                warm_key - the key to start from (or NULL)
+// Outputs      : void
+void prepareSubsSearch(struct SubsSearch *search, char *ciphertext, int clen, struct SubsSearchBudget *budget,
+                       const cs642TextCounts *counts, const char *warm_key) {
+  const uint32_t *letter_counts = counts->letters;
+  search->ciphertext = ciphertext;
+  search->clen = clen;
+  search->tuning = cs642GetTuning(clen);
+  search->arena = cs642ScratchArena();
+  search->plaintexts = borrowBatchPlaintexts(search->arena, clen);
+  search->budget = budget;
+  search->pinned = 0;
+  memset(search->memo, 0x00, sizeof(search->memo));
+  ensureNgramModel();
+
   // Calculate Letter Frequencies in Ciphertext
-  struct LetterFrequency observed_letter_frequencies[ALPHABET_SIZE];
+  struct LetterFrequency *observed_letter_frequencies = search->observed_letters;
+  int total_chars = 0;
   for(int i = 0; i < ALPHABET_SIZE; i++) {
     observed_letter_frequencies[i].letter = i + 'A';
-  }
-  int total_chars = 0;
-  for(int i = 0; ciphertext[i] != '\0'; i++) {
-    if (isalpha(ciphertext[i])) {
-      char temp = toupper(ciphertext[i]); // Convert to uppercase
-      observed_letter_frequencies[temp - 'A'].frequency++; // Count letter occurrence
-      total_chars++; // Increment total number of characters
-    }
+    observed_letter_frequencies[i].frequency = letter_counts[i]; // Count letter occurrence
+    total_chars += letter_counts[i]; // Increment total number of characters
   }
 
   // Convert Counts to Frequencies
@@ -563,7 +1536,7 @@ int cs642PerformSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
   }
 
   // Create Local Copy of Letter Frequencies
-  struct LetterFrequency my_letter_frequencies[ALPHABET_SIZE];
+  struct LetterFrequency *my_letter_frequencies = search->expected_letters;
   for(int i = 0; i < ALPHABET_SIZE; i++) {
     my_letter_frequencies[i].letter = letter_frequencies_struct[i].letter;
     my_letter_frequencies[i].frequency = letter_frequencies_struct[i].frequency;
@@ -573,390 +1546,2341 @@ int cs642PerformSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
   qsort(my_letter_frequencies, ALPHABET_SIZE, sizeof(struct LetterFrequency), compareLetterFrequencies);
   qsort(observed_letter_frequencies, ALPHABET_SIZE, sizeof(struct LetterFrequency), compareLetterFrequencies);
 
-  // Calculate Bigram Frequencies in Ciphertext
-  double observed_bigram_frequencies[ALPHABET_SIZE][ALPHABET_SIZE] = {0};
-  calculateBigramFrequencies(ciphertext, observed_bigram_frequencies);
+  // Rank the N-grams that occur by Descending Frequency
+  search->observed_ngrams[0] = (struct NgramRanking){0, 0, search->bigram_index, search->bigram_count};
+  rankNgrams(counts->bigrams, BIGRAM_SPACE, counts->total_bigrams, 1, &search->observed_ngrams[0]);
+  search->observed_ngrams[1] = (struct NgramRanking){0, 0, search->trigram_index, search->trigram_count};
+  rankNgrams(counts->trigrams, TRIGRAM_SPACE, counts->total_trigrams, 1, &search->observed_ngrams[1]);
+
+  // Create initial letter matching from monogram frequencies (or the warm key)
+  for(int i = 0; i < ALPHABET_SIZE; i++) {
+    search->matching[i].self = my_letter_frequencies[i].letter;
+    if (warm_key == NULL) {
+      search->matching[i].match = observed_letter_frequencies[i].letter;
+      search->matching[i].distance = fabs(my_letter_frequencies[i].frequency - observed_letter_frequencies[i].frequency);
+    } else {
+      search->matching[i].match = warm_key[my_letter_frequencies[i].letter - 'A'];
+      search->matching[i].distance = fabs(my_letter_frequencies[i].frequency -
+                                          letter_counts[search->matching[i].match - 'A'] / (double)total_chars);
+    }
+  }
+
+  // Inverse lookups into the matching: letter -> slot and matched letter -> slot
+  // (the self column never moves, the match column changes with every swap)
+  for(int i = 0; i < ALPHABET_SIZE; i++) {
+    search->self_slot[search->matching[i].self - 'A'] = i;
+    search->match_slot[search->matching[i].match - 'A'] = i;
+  }
+
+  // Construct key from current matching
+  for(int i = 0; i < ALPHABET_SIZE; i++) {
+    search->best_key[search->matching[i].self - 'A'] = search->matching[i].match;
+  }
+  search->best_key[ALPHABET_SIZE] = '\0';
+
+  // Score the initial key
+  char *keys[1] = {search->best_key};
+  evaluateSubsKeys(search, keys, 1, &search->best_number);
+  search->increment_distance = 0;
+  search->attempts = 0;
+  search->updates = 0;
+  search->phase = (warm_key == NULL) ? SUBS_PHASE_MONOGRAM : SUBS_PHASE_BIGRAM;
+  search->letter = 0;
+  search->fingerprint = fingerprintText(ciphertext, clen);
+  search->checkpointed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &search->last_checkpoint);
+}
+
+// Prepares the ciphertext statistics and the initial matching of a search
+void initSubsSearch(struct SubsSearch *search, char *ciphertext, int clen, struct SubsSearchBudget *budget) {
+  // Count Letters, Bigrams and Trigrams in Ciphertext
+  cs642TextCounts counts;
+  countCiphertext(&counts, ciphertext, clen);
+
+  prepareSubsSearch(search, ciphertext, clen, budget, &counts, NULL);
+}
+
+// Returns the scratch space of a search to its arena
+void freeSubsSearch(struct SubsSearch *search) {
+  cs642ArenaReset(search->arena);
+  search->plaintexts = NULL;
+}
 
-  // Calculate Trigram Frequencies in Ciphertext
-  double observed_trigram_frequencies[ALPHABET_SIZE][ALPHABET_SIZE][ALPHABET_SIZE] = {0};
-  calculateTrigramFrequencies(ciphertext, observed_trigram_frequencies);
+// Writes the checkpoint file name of a search into path
+void subsCheckpointPath(const struct SubsSearch *search, char *path, size_t size) {
+  snprintf(path, size, "%s.%016llx", subs_checkpoint.prefix, (unsigned long long)search->fingerprint);
+}
 
-  // Sort Bigram Frequencies in Descending Order
-  struct BigramFrequency observed_bigram_array[ALPHABET_SIZE * ALPHABET_SIZE];
-  int index = 0;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : saveSubsCheckpoint
+// Description  : Serialises the search state to its checkpoint file. The record
+//                is written to a temporary file and renamed over the old one,
+//                so a process killed mid-write leaves the last checkpoint.
+//
+// Inputs       : search - the substitution search
+// Outputs      : 0 if successful, -1 if failure
+int saveSubsCheckpoint(struct SubsSearch *search) {
+  struct SubsCheckpointRecord record;
+  char path[CHECKPOINT_PREFIX + 32], temp[CHECKPOINT_PREFIX + 48];
+
+  memset(&record, 0x00, sizeof(record));
+  memcpy(record.magic, CHECKPOINT_MAGIC, sizeof(record.magic));
+  record.version = CHECKPOINT_VERSION;
+  record.clen = search->clen;
+  record.fingerprint = search->fingerprint;
+  record.phase = search->phase;
+  record.letter = search->letter;
+  record.increment_distance = search->increment_distance;
+  record.attempts = search->attempts;
+  record.updates = search->updates;
+  record.best_number = search->best_number;
+  record.evaluations = search->budget->evaluations;
+  memcpy(record.best_key, search->best_key, sizeof(record.best_key));
   for (int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      // Create a bigram string (2 characters plus null terminator)
-      char bigram[3] = {i + 'A', j + 'A', '\0'};
-            
-      // Populate the struct
-      strcpy(observed_bigram_array[index].bigram, bigram);
-      observed_bigram_array[index].frequency = observed_bigram_frequencies[i][j];
+    record.observed_letters[i] = search->observed_letters[i].letter;
+    record.observed_frequencies[i] = search->observed_letters[i].frequency;
+    record.matches[i] = search->matching[i].match;
+    record.distances[i] = search->matching[i].distance;
+  }
 
-      // Move to the next index
-      index++;
-    }
+  subsCheckpointPath(search, path, sizeof(path));
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  FILE *file = fopen(temp, "wb");
+  if (file == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Failed to open checkpoint file %s.", temp);
+    return (-1);
   }
-  qsort(observed_bigram_array, ALPHABET_SIZE * ALPHABET_SIZE, sizeof(struct BigramFrequency), compareBigramFrequencies);
+  int written = fwrite(&record, sizeof(record), 1, file) == 1;
+  if (fclose(file) != 0 || !written || rename(temp, path) != 0) {
+    logMessage(LOG_ERROR_LEVEL, "Failed to write checkpoint file %s.", path);
+    remove(temp);
+    return (-1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &search->last_checkpoint);
+  return (0);
+}
 
-  // Sort Trigram Frequencies in Descending Order
-  struct TrigramFrequency observed_trigram_array[ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE];
-  index = 0;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : loadSubsCheckpoint
+// Description  : Restores the search state from its checkpoint file, if one
+//                exists for this ciphertext and passes validation (keys and
+//                matchings are permutations, the observed frequencies are
+//                those of this ciphertext, the counters are in the range of
+//                their phase). The restored key is scored again rather than
+//                trusting the recorded score.
+//
+// Inputs       : search - the substitution search (freshly initialized)
+// Outputs      : 1 if the state was restored, 0 otherwise
+int loadSubsCheckpoint(struct SubsSearch *search) {
+  struct SubsCheckpointRecord record;
+  char path[CHECKPOINT_PREFIX + 32];
+
+  subsCheckpointPath(search, path, sizeof(path));
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return (0);
+  }
+  int read = fread(&record, sizeof(record), 1, file) == 1;
+  fclose(file);
+
+  // Check the record belongs to this ciphertext and holds a valid key
+  int max_increment = (record.phase == SUBS_PHASE_MONOGRAM) ? 0
+                      : (record.phase == SUBS_PHASE_BIGRAM) ? SUBS_BIGRAM_INCREMENTS
+                                                            : SUBS_TRIGRAM_INCREMENTS;
+  int valid = read && memcmp(record.magic, CHECKPOINT_MAGIC, sizeof(record.magic)) == 0 &&
+              record.version == CHECKPOINT_VERSION && record.clen == (uint32_t)search->clen &&
+              record.fingerprint == search->fingerprint &&
+              record.phase >= SUBS_PHASE_MONOGRAM && record.phase <= SUBS_PHASE_DONE &&
+              record.letter >= 0 && record.letter < ALPHABET_SIZE &&
+              record.increment_distance >= 0 && record.increment_distance <= max_increment &&
+              record.attempts >= 0 && record.attempts <= search->tuning->max_attempts * 3 &&
+              record.updates >= 0 && record.updates <= search->clen && record.evaluations >= 0;
+  double frequency_of[ALPHABET_SIZE];
+  int used_key[ALPHABET_SIZE] = {0}, used_match[ALPHABET_SIZE] = {0}, used_observed[ALPHABET_SIZE] = {0};
   for (int i = 0; i < ALPHABET_SIZE; i++) {
-    for (int j = 0; j < ALPHABET_SIZE; j++) {
-      for (int k = 0; k < ALPHABET_SIZE; k++) {
-        // Create a trigram string (3 characters plus null terminator)
-        char trigram[4] = {i + 'A', j + 'A', k + 'A', '\0'};
-              
-        // Populate the struct
-        strcpy(observed_trigram_array[index].trigram, trigram);
-        observed_trigram_array[index].frequency = observed_trigram_frequencies[i][j][k];
+    frequency_of[search->observed_letters[i].letter - 'A'] = search->observed_letters[i].frequency;
+  }
+  for (int i = 0; i < ALPHABET_SIZE && valid; i++) {
+    valid = isupper(record.best_key[i]) && isupper(record.matches[i]) && isupper(record.observed_letters[i]) &&
+            !used_key[record.best_key[i] - 'A']++ && !used_match[record.matches[i] - 'A']++ &&
+            !used_observed[record.observed_letters[i] - 'A']++ &&
+            record.best_key[search->matching[i].self - 'A'] == record.matches[i] &&
+            isfinite(record.observed_frequencies[i]) &&
+            record.observed_frequencies[i] == frequency_of[record.observed_letters[i] - 'A'] &&
+            isfinite(record.distances[i]) && record.distances[i] >= 0;
+  }
+  if (!valid) {
+    logMessage(LOG_ERROR_LEVEL, "Ignoring invalid checkpoint file %s.", path);
+    return (0);
+  }
 
-        // Move to the next index
-        index++;
-      }
-    }
+  search->phase = record.phase;
+  search->letter = record.letter;
+  search->increment_distance = record.increment_distance;
+  search->attempts = record.attempts;
+  search->updates = record.updates;
+  search->budget->evaluations = record.evaluations;
+  memcpy(search->best_key, record.best_key, ALPHABET_SIZE);
+  search->best_key[ALPHABET_SIZE] = '\0';
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    search->observed_letters[i].letter = record.observed_letters[i];
+    search->observed_letters[i].frequency = record.observed_frequencies[i];
+    search->matching[i].match = record.matches[i];
+    search->matching[i].distance = record.distances[i];
+    search->match_slot[search->matching[i].match - 'A'] = i;
   }
-  qsort(observed_trigram_array, ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE, sizeof(struct TrigramFrequency), compareTrigramFrequencies);
 
-  // Create initial letter matching from monogram frequencies
-  int num_matches = 0;
-  struct LetterMatching matching[26];
-  for(int i = 0; i < ALPHABET_SIZE; i++) {
-    matching[i].self = my_letter_frequencies[i].letter;
-    matching[i].match = observed_letter_frequencies[i].letter;
-    double distance = fabs(my_letter_frequencies[i].frequency - observed_letter_frequencies[i].frequency);
-    if(distance < 0.0019) {
-      matching[i].distance = distance;
-      num_matches++;
-    }
-    matching[i].distance = distance;
+  // Score the restored key on this ciphertext
+  char *keys[1] = {search->best_key};
+  evaluateSubsKeys(search, keys, 1, &search->best_number);
+  if (search->best_number != record.best_number) {
+    logMessage(LOG_INFO_LEVEL, "Checkpoint key scored %d, not the recorded %d.", search->best_number,
+               record.best_number);
   }
+  logMessage(LOG_INFO_LEVEL, "Resumed substitution search from %s (phase %d).", path, search->phase);
+  return (1);
+}
 
-  // Construct key from current matching
-  char best_key[ALPHABET_SIZE + 1];
-
-  char curr_letter = 'A';
-  while (curr_letter <= 'Z') {
-    int curr_index = 0;
-    // Find the index of the current letter in the observed alphabet
-    while (matching[curr_index].self != curr_letter) {
-      curr_index++;
-    }
-    // Map the observed letter to the key
-    best_key[curr_letter - 'A'] = matching[curr_index].match;
-    curr_letter++;
-  }
-  best_key[ALPHABET_SIZE] = '\0';
-  cs642Decrypt(CIPHER_SUBS, best_key, 26, plaintext, plen, ciphertext, clen);
-  
-  // Loop Variables
-
-  // Attempt Various Key Possibilities
-  int attempts = 0;
-  //int key_attempts = 0;
-  int bestNumber = getNumberWordsFromDict(plaintext);
-  int increment_distance = 0;
-  int updates = 0;
-  printf("ENTER MONOGRAM LOGIC...\n");
-  printf("KEY: %s SIMILARITY: %d\n", best_key, bestNumber);
-
-  // Utilize the initial matching to pseudo-randomly form keys from individual letter frequencies
-  while(bestNumber < 480 && attempts < MAX_ATTEMPTS * 3) {
-    for(int i = 0; i < 26 - 1; i++) {
-      double max_freq = observed_letter_frequencies[i].frequency;
-      int max_freq_idx = i;
-      // Find largest char-frequency pair from i-26
-      for(int j = i + 1; j < 26; j++) {
-        if(observed_letter_frequencies[j].frequency > max_freq || (fabs(observed_letter_frequencies[j].frequency - max_freq) < 0.0019 + (0.001 * increment_distance) && rand() % 2 == 0)) { // Arbitrarily swap similar frequency characters
-          max_freq = observed_letter_frequencies[j].frequency;
-          max_freq_idx = j;
+// Saves a checkpoint if checkpoints are enabled and the interval has passed
+void maybeSaveSubsCheckpoint(struct SubsSearch *search) {
+  if (search->checkpointed && elapsedSince(&search->last_checkpoint) >= subs_checkpoint.interval) {
+    saveSubsCheckpoint(search);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ConfigureSUBSCheckpoint
+// Description  : Sets up checkpointing of the substitution searches
+//
+// Inputs       : prefix - checkpoint file prefix (NULL disables checkpoints)
+//                interval - seconds between checkpoints
+//                resume - resume searches from existing checkpoints
+// Outputs      : 0 if successful, -1 if failure
+int cs642ConfigureSUBSCheckpoint(const char *prefix, double interval, int resume) {
+  if (prefix == NULL) {
+    subs_checkpoint.enabled = 0;
+    subs_checkpoint.resume = 0;
+    return (0);
+  }
+  if (strlen(prefix) >= sizeof(subs_checkpoint.prefix) || interval < 0) {
+    return (-1);
+  }
+  strcpy(subs_checkpoint.prefix, prefix);
+  subs_checkpoint.interval = interval;
+  subs_checkpoint.resume = resume;
+  subs_checkpoint.enabled = 1;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ConfigureSUBSBeam
+// Description  : Selects the engine of cs642PerformSUBSCryptanalysis
+//
+// Inputs       : width - the beam width to use the beam search (0 = swap search)
+// Outputs      : 0 if successful, -1 if failure
+int cs642ConfigureSUBSBeam(int width) {
+  if (width < 0 || width > SUBS_BEAM_MAX) {
+    return (-1);
+  }
+  subs_beam_width = width;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ConfigureSUBSPortfolio
+// Description  : Makes cs642PerformSUBSCryptanalysis race a portfolio of engines
+//
+// Inputs       : engines - the engines to race (0 = no portfolio)
+// Outputs      : 0 if successful, -1 if failure
+int cs642ConfigureSUBSPortfolio(int engines) {
+  if (engines < 0 || engines > PORTFOLIO_ENGINES) {
+    return (-1);
+  }
+  subs_portfolio = engines;
+  return (0);
+}
+
+// Copies a schedule, giving the fields left 0 their default. Returns 0 if
+// successful, -1 if a field is negative or the temperatures rise.
+int resolveAnnealSchedule(const cs642AnnealSchedule *schedule, cs642AnnealSchedule *resolved) {
+  *resolved = (schedule != NULL) ? *schedule : (cs642AnnealSchedule){0, 0, 0, 0, 0};
+  resolved->start_temperature = (resolved->start_temperature != 0) ? resolved->start_temperature
+                                                                   : ANNEAL_START_TEMPERATURE;
+  resolved->end_temperature = (resolved->end_temperature != 0) ? resolved->end_temperature : ANNEAL_END_TEMPERATURE;
+  resolved->steps = (resolved->steps != 0) ? resolved->steps : ANNEAL_STEPS;
+  resolved->restarts = (resolved->restarts != 0) ? resolved->restarts : ANNEAL_RESTARTS;
+  if (resolved->start_temperature < 0 || resolved->end_temperature < 0 || resolved->steps < 0 ||
+      resolved->restarts < 0 || resolved->end_temperature > resolved->start_temperature) {
+    return (-1);
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ConfigureSUBSAnneal
+// Description  : Makes cs642PerformSUBSCryptanalysis use the annealing engine
+//
+// Inputs       : schedule - the cooling schedule (NULL = no annealing, 0
+//                           fields = default)
+// Outputs      : 0 if successful, -1 if failure
+int cs642ConfigureSUBSAnneal(const cs642AnnealSchedule *schedule) {
+  if (schedule == NULL) {
+    subs_anneal = 0;
+    return (0);
+  }
+  cs642AnnealSchedule resolved;
+  if (resolveAnnealSchedule(schedule, &resolved)) {
+    return (-1);
+  }
+  subs_anneal_schedule = resolved;
+  subs_anneal = 1;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : subsMonogramPhase
+// Description  : Utilizes the initial matching to pseudo-randomly form keys
+//                from individual letter frequencies. Keys do not depend on
+//                earlier results, so a batch is formed and scored at once and
+//                the results are applied in order.
+//
+// Inputs       : search - the substitution search
+// Outputs      : 1 if the phase met its own stop condition, 0 if cut short
+int subsMonogramPhase(struct SubsSearch *search) {
+  struct LetterFrequency *observed_letter_frequencies = search->observed_letters;
+  struct LetterFrequency *my_letter_frequencies = search->expected_letters;
+  int increment_distance = search->increment_distance;
+
+  while(search->best_number < 480 && search->attempts < search->tuning->max_attempts * 3 && !search->budget->exhausted) {
+    maybeSaveSubsCheckpoint(search);
+    int count = search->tuning->max_attempts * 3 - search->attempts;
+    if (count > EVALUATION_BATCH) {
+      count = EVALUATION_BATCH;
+    }
+
+    struct LetterMatching new_matching[EVALUATION_BATCH][ALPHABET_SIZE];
+    char new_keys[EVALUATION_BATCH][ALPHABET_SIZE + 1];
+    char *keys[EVALUATION_BATCH];
+    for (int c = 0; c < count; c++) {
+      for(int i = 0; i < 26 - 1; i++) {
+        double max_freq = observed_letter_frequencies[i].frequency;
+        int max_freq_idx = i;
+        // Find largest char-frequency pair from i-26
+        for(int j = i + 1; j < 26; j++) {
+          if(observed_letter_frequencies[j].frequency > max_freq || (fabs(observed_letter_frequencies[j].frequency - max_freq) < search->tuning->match_distance + (0.001 * increment_distance) && rand() % 2 == 0)) { // Arbitrarily swap similar frequency characters
+            max_freq = observed_letter_frequencies[j].frequency;
+            max_freq_idx = j;
+          }
         }
+
+        // Swap found largest frequency to ith position
+        double temp_freq = observed_letter_frequencies[i].frequency;
+        double temp_letter = observed_letter_frequencies[i].letter;
+        observed_letter_frequencies[i].frequency = max_freq;
+        observed_letter_frequencies[i].letter = observed_letter_frequencies[max_freq_idx].letter;
+        observed_letter_frequencies[max_freq_idx].frequency = temp_freq;
+        observed_letter_frequencies[max_freq_idx].letter = temp_letter;
       }
-      
-      // Swap found largest frequency to ith position
-      double temp_freq = observed_letter_frequencies[i].frequency;
-      double temp_letter = observed_letter_frequencies[i].letter;
-      observed_letter_frequencies[i].frequency = max_freq;
-      observed_letter_frequencies[i].letter = observed_letter_frequencies[max_freq_idx].letter;
-      observed_letter_frequencies[max_freq_idx].frequency = temp_freq;
-      observed_letter_frequencies[max_freq_idx].letter = temp_letter;
-    }
-
-    // Form New Matching With Rearranged Expected Frequencies
-    struct LetterMatching new_matching[26];
-    for(int i = 0; i < ALPHABET_SIZE; i++) {
-      new_matching[i].self = my_letter_frequencies[i].letter;
-      new_matching[i].match = observed_letter_frequencies[i].letter;
-      double distance = fabs(my_letter_frequencies[i].frequency - observed_letter_frequencies[i].frequency);
-      new_matching[i].distance = distance;
-    }
-
-    // Form New Key From New Matching
-    char new_key[ALPHABET_SIZE + 1];
-
-    char curr_letter = 'A';
-    while (curr_letter <= 'Z') {
-      int curr_index = 0;
-      // Find the index of the current letter in the observed alphabet
-      while (new_matching[curr_index].self != curr_letter) {
-        curr_index++;
-      }
-      // Map the observed letter to the key
-      new_key[curr_letter - 'A'] = new_matching[curr_index].match;
-      curr_letter++;
-    }
-    new_key[ALPHABET_SIZE] = '\0';
-
-    // Update the best key if the current attempt is better
-    cs642Decrypt(CIPHER_SUBS, new_key, 26, plaintext, plen, ciphertext, clen);
-    int currentNumber = getNumberWordsFromDict(plaintext);
-
-    
-    //printf("NEW KEY: %s SIMILARITY: %d\n", new_key, currentNumber);
-    if (currentNumber > bestNumber) {
-      // Update Best Number and Key
-      bestNumber = currentNumber;
-      strcpy(best_key, new_key);
-
-      // Update Matches
-      for(int i = 0; i < ALPHABET_SIZE; i++) {
-        matching[i].distance = new_matching[i].distance;
-        matching[i].self = new_matching[i].self;
-        matching[i].match = new_matching[i].match;
-      }
-
-      // Increment Updates
-      updates++;
-    }
-    attempts++;
-  }
-
-  printf("ATTEMPTS: %d\n", attempts);
-  printf("UPDATES: %d\n", updates);
-  printf("KEY: %s SIMILARITY: %d\n", best_key, bestNumber);
-  /*for(int i = 0; i < ALPHABET_SIZE; i++){
-    printf("%c: %c %f\n", matching[i].self, matching[i].match, matching[i].distance);
-  }*/
-  printf("ENTER BIGRAM LOGIC...\n");
-  // Reset Attempts and Updates
-  updates = 0;
-  attempts = 0;
-
-  /**** BIGRAM LOGIC ****/
-  // Match Letters By Bigram Frequency
-  while(bestNumber < 500 && increment_distance < 5) {
-    // For each unmatched character
-    for(int curr_idx = 0; curr_idx < ALPHABET_SIZE; curr_idx++) {
-      if(matching[curr_idx].distance > 0.001 * pow(10, -1 * increment_distance)) { // If character uunmatched, traverse bigrams
-        //printf("HELLO\n");
-        for(int i = 0; observed_bigram_array[i].frequency > 0.001 * pow(10, -1 * increment_distance); i++) { 
-          //printf("%d\n", i);
-          // Find bigrams to which character belongs and get other letter
-          char paired_letter;  // Stores paired letter of bigram
-          int bigram_idx = -1; // Tracks location of letter in bigram
-          if(matching[curr_idx].self == observed_bigram_array[i].bigram[0]) {
-            paired_letter = observed_bigram_array[i].bigram[1];
-            bigram_idx = 0;
-          } 
-          else if (matching[curr_idx].self == observed_bigram_array[i].bigram[1]) {
-            paired_letter = observed_bigram_array[i].bigram[0];
-            bigram_idx = 1;
-          }
 
-          // Get matching information of paired letter
-          int pair_idx = -1;
-          for(int j = 0; j < ALPHABET_SIZE; j++) {
-            if(matching[j].self == paired_letter) {
-              pair_idx = j;
-              break;
-            }
-          }
+      // Form New Matching With Rearranged Expected Frequencies
+      for(int i = 0; i < ALPHABET_SIZE; i++) {
+        new_matching[c][i].self = my_letter_frequencies[i].letter;
+        new_matching[c][i].match = observed_letter_frequencies[i].letter;
+        new_matching[c][i].distance = fabs(my_letter_frequencies[i].frequency - observed_letter_frequencies[i].frequency);
+      }
 
-          // Construct Key Candidate
-          char new_key[ALPHABET_SIZE + 1];
-          strcpy(new_key, best_key);
-          int swap_idx = 0;
-          double freq_of_bigram = 0;
-
-          // Check if paired letter matched
-          if(matching[pair_idx].distance < 0.0019 + (INCREMENT_VALUE * increment_distance)) { // Paired matched --> set letter to correspond
-            // Get new letter to match
-            char new_match = bigramArray[i].bigram[bigram_idx];
-            freq_of_bigram = bigramArray[i].frequency;
-            // Find letter currently matching to the new match and swap in key with current letter
-            for(int j = 0; j < ALPHABET_SIZE; j++) {
-              if(matching[j].match == new_match) {
-                swap_idx = j;
-                break;
-              }
-            }
-            // Swap Only in Key
-            new_key[matching[curr_idx].self - 'A'] = matching[swap_idx].match;
-            new_key[matching[swap_idx].self - 'A'] = matching[curr_idx].match;
-          }
+      // Form New Key From New Matching
+      for(int i = 0; i < ALPHABET_SIZE; i++) {
+        new_keys[c][new_matching[c][i].self - 'A'] = new_matching[c][i].match;
+      }
+      new_keys[c][ALPHABET_SIZE] = '\0';
+      keys[c] = new_keys[c];
+    }
 
-          // Update the best key if the current attempt is better
-          cs642Decrypt(CIPHER_SUBS, new_key, 26, plaintext, plen, ciphertext, clen);
-          //printf("%d %f: PLAIN: %s\n", attempts, getPercentageWordsFromDict(plaintext), plaintext);
-          int currentNumber = getNumberWordsFromDict(plaintext);
-          //printf("NEW KEY: %s SIMILARITY: %d\n", new_key, currentNumber);
-          if (currentNumber > bestNumber) {
-            // Update Best Number and Key
-            bestNumber = currentNumber;
-            strcpy(best_key, new_key);
-
-            // Retain Swap in Struct
-            char temp = matching[curr_idx].match;
-            matching[curr_idx].match = matching[swap_idx].match;
-            matching[swap_idx].match = temp;
-
-            double temp_dist = matching[curr_idx].distance;
-            matching[curr_idx].distance = matching[swap_idx].distance * freq_of_bigram;
-            matching[swap_idx].distance = temp_dist;
-
-            matching[pair_idx].distance = matching[pair_idx].distance * freq_of_bigram;
-            // Increment Updates
-            updates++;
-            printf("BEST KEY: %s SIMILARITY: %d INCREMENT: %d\n", best_key, bestNumber, increment_distance);
-          }
+    // Score the batch, then update the best key with each better attempt in order
+    int scores[EVALUATION_BATCH];
+    evaluateSubsKeys(search, keys, count, scores);
+    for (int c = 0; c < count && search->best_number < 480; c++) {
+      //printf("NEW KEY: %s SIMILARITY: %d\n", new_keys[c], scores[c]);
+      if (scores[c] > search->best_number) {
+        // Update Best Number and Key
+        search->best_number = scores[c];
+        memcpy(search->best_key, new_keys[c], sizeof(search->best_key));
+
+        // Update Matches
+        for(int i = 0; i < ALPHABET_SIZE; i++) {
+          search->matching[i] = new_matching[c][i];
+          search->match_slot[search->matching[i].match - 'A'] = i;
         }
+
+        // Increment Updates
+        search->updates++;
       }
+      search->attempts++;
     }
-    increment_distance++; 
-  }
-  
-  printf("ATTEMPTS: %d\n", attempts);
-  printf("UPDATES: %d\n", updates);
-  printf("KEY: %s SIMILARITY: %d\n", best_key, bestNumber);
-  printf("ENTER TRIGRAM LOGIC...\n");
-
-  // Reset Attempts and Updates
-  updates = 0;
-  attempts = 0;
-  increment_distance = 0;
-
-  /**** TRIGRAM LOGIC ****/
-  while (bestNumber < 550 && increment_distance < 3) {
-      // For each unmatched character
-      for (int curr_idx = 0; curr_idx < ALPHABET_SIZE; curr_idx++) {
-          if (matching[curr_idx].distance > 0.001 * pow(10, -1 * increment_distance)) { // If character unmatched, traverse trigrams
-              for (int i = 0; observed_trigram_array[i].frequency > 0.001 * pow(10, -1 * increment_distance); i++) {
-                  // Find trigrams to which character belongs
-                  char paired_letters[2];  // Stores paired letters of trigram
-                  int trigram_idx = -1; // Tracks location of letter in trigram
-                  if (matching[curr_idx].self == observed_trigram_array[i].trigram[0]) {
-                      paired_letters[0] = observed_trigram_array[i].trigram[1];
-                      paired_letters[1] = observed_trigram_array[i].trigram[2];
-                      trigram_idx = 0;
-                  } 
-                  else if (matching[curr_idx].self == observed_trigram_array[i].trigram[1]) {
-                      paired_letters[0] = observed_trigram_array[i].trigram[0];
-                      paired_letters[1] = observed_trigram_array[i].trigram[2];
-                      trigram_idx = 1;
-                  } 
-                  else if (matching[curr_idx].self == observed_trigram_array[i].trigram[2]) {
-                      paired_letters[0] = observed_trigram_array[i].trigram[0];
-                      paired_letters[1] = observed_trigram_array[i].trigram[1];
-                      trigram_idx = 2;
-                  }
-
-                  // Get matching information of paired letters
-                  int pair_indices[2] = {-1, -1};
-                  for (int j = 0; j < ALPHABET_SIZE; j++) {
-                      if (matching[j].self == paired_letters[0]) {
-                          pair_indices[0] = j;
-                      }
-                      if (matching[j].self == paired_letters[1]) {
-                          pair_indices[1] = j;
-                      }
-                      if (pair_indices[0] != -1 && pair_indices[1] != -1) {
-                          break;
-                      }
-                  }
-
-                  // Construct Key Candidate
-                  char new_key[ALPHABET_SIZE + 1];
-                  strcpy(new_key, best_key);
-                  int swap_idx = 0;
-                  double freq_of_trigram = 0;
-
-                  // Check if paired letters matched and if the frequency is significant
-                  if (matching[pair_indices[0]].distance < 0.0019 + (INCREMENT_VALUE * increment_distance) &&
-                      matching[pair_indices[1]].distance < 0.0019 + (INCREMENT_VALUE * increment_distance) ) { // 0.0019
-                      // Get new letter to match
-                      char new_match = trigramArray[i].trigram[trigram_idx];
-                      freq_of_trigram = trigramArray[i].frequency;
-
-                      for(int j = 0; j < ALPHABET_SIZE; j++) {
-                        if(matching[j].match == new_match) {
-                          swap_idx = j;
-                          break;
-                        }
-                      }
-                      // Swap Only in Key
-                      new_key[matching[curr_idx].self - 'A'] = matching[swap_idx].match;
-                      new_key[matching[swap_idx].self - 'A'] = matching[curr_idx].match;
-
-                      // Update the best key if the current attempt is better
-                      cs642Decrypt(CIPHER_SUBS, new_key, 26, plaintext, plen, ciphertext, clen);
-                      int currentNumber = getNumberWordsFromDict(plaintext);
-                      //printf("NEW KEY: %s SIMILARITY: %d\n", new_key, currentNumber);
-                      if (currentNumber > bestNumber) {
-                          // Update Best Number and Key
-                          bestNumber = currentNumber;
-                          strcpy(best_key, new_key);
-
-                          // Retain Swap in Struct
-                          char temp = matching[curr_idx].match;
-                          matching[curr_idx].match = matching[swap_idx].match;
-                          matching[swap_idx].match = temp;
-
-                          double temp_dist = matching[curr_idx].distance;
-                          matching[curr_idx].distance = matching[swap_idx].distance * freq_of_trigram;
-                          //matching[swap_idx].distance = temp_dist * freq_of_bigram;
-                          matching[swap_idx].distance = temp_dist;
-
-                          matching[pair_indices[0]].distance = matching[pair_indices[0]].distance * freq_of_trigram;
-                          matching[pair_indices[1]].distance = matching[pair_indices[1]].distance * freq_of_trigram;
-
-                          // Increment Updates
-                          updates++;
-                          printf("BEST KEY: %s SIMILARITY: %d INCREMENT: %d\n", best_key, bestNumber, increment_distance);
-                      }
-                  }
-              }
-          }
+  }
+  return (search->best_number >= 480 || search->attempts >= search->tuning->max_attempts * 3);
+}
+
+// Collects up to EVALUATION_BATCH swap candidates for the letter in slot
+// curr_idx, starting at *rank of the observed n-gram ranking of the given
+// order (2 or 3). *rank is left after the last n-gram examined.
+int collectSwapCandidates(struct SubsSearch *search, int order, int curr_idx, int *rank, struct SwapCandidate *batch) {
+  const struct NgramRanking *observed = &search->observed_ngrams[order - 2];
+  const struct NgramRanking *expected = (order == 2) ? localModel()->bigram_ranking : localModel()->trigram_ranking;
+  struct LetterMatching *matching = search->matching;
+  double threshold = 0.001 * pow(10, -1 * search->increment_distance);
+  double matched = search->tuning->match_distance + (search->tuning->increment_value * search->increment_distance);
+  int self = matching[curr_idx].self - 'A';
+  int count = 0;
+
+  for (; *rank < observed->size && rankedFrequency(observed, *rank) > threshold && count < EVALUATION_BATCH; (*rank)++) {
+    // Find n-grams to which character belongs
+    int letters[3], expected_letters[3];
+    for (int j = order - 1, ngram = observed->index[*rank], model = expected->index[*rank]; j >= 0; j--) {
+      letters[j] = ngram % ALPHABET_SIZE;
+      expected_letters[j] = model % ALPHABET_SIZE;
+      ngram /= ALPHABET_SIZE;
+      model /= ALPHABET_SIZE;
+    }
+    int ngram_idx = -1; // Tracks location of letter in n-gram
+    for (int j = 0; j < order && ngram_idx < 0; j++) {
+      if (letters[j] == self) {
+        ngram_idx = j;
       }
-      increment_distance++; // Increase matching threshold (be stricter on matches)
-      //attempts++;
+    }
+    if (ngram_idx < 0) { // Character not in n-gram, nothing to swap
+      continue;
+    }
+
+    // Get matching information of paired letters (the others, in order) and check they are matched
+    int pair_indices[2];
+    int pairs = 0, pairs_matched = 1;
+    for (int j = 0; j < order; j++) {
+      if (j != ngram_idx) {
+        pair_indices[pairs] = search->self_slot[letters[j]];
+        pairs_matched = pairs_matched && matching[pair_indices[pairs]].distance < matched;
+        pairs++;
+      }
+    }
+    if (!pairs_matched) {
+      continue;
+    }
+
+    // Get new letter to match from the expected n-gram of equal rank and find
+    // the letter currently matching it (a swap with itself changes nothing)
+    int swap_idx = search->match_slot[expected_letters[ngram_idx]];
+    if (swap_idx == curr_idx || (search->pinned & (1u << swap_idx))) {
+      continue;
+    }
+
+    // Construct Key Candidate (swap only in key)
+    struct SwapCandidate *candidate = &batch[count++];
+    memcpy(candidate->key, search->best_key, sizeof(candidate->key));
+    candidate->key[matching[curr_idx].self - 'A'] = matching[swap_idx].match;
+    candidate->key[matching[swap_idx].self - 'A'] = matching[curr_idx].match;
+    candidate->rank = *rank;
+    candidate->swap_idx = swap_idx;
+    candidate->pair_indices[0] = pair_indices[0];
+    candidate->pair_indices[1] = (order == 3) ? pair_indices[1] : -1;
+    candidate->frequency = rankedFrequency(expected, *rank);
   }
-  printf("ATTEMPTS: %d\n", attempts);
-  printf("UPDATES: %d\n", updates);
-  printf("KEY: %s SIMILARITY: %d\n", best_key, bestNumber);
-  for(int i = 0; i < ALPHABET_SIZE; i++){
-    printf("%c: %f\n", matching[i].self, matching[i].distance);
+  return count;
+}
+
+// Makes a scored swap candidate the best key and retains the swap in the matching
+void acceptSwapCandidate(struct SubsSearch *search, int curr_idx, struct SwapCandidate *candidate, int score) {
+  struct LetterMatching *matching = search->matching;
+  int swap_idx = candidate->swap_idx;
+
+  // Update Best Number and Key
+  search->best_number = score;
+  memcpy(search->best_key, candidate->key, sizeof(search->best_key));
+
+  // Retain Swap in Struct
+  char temp = matching[curr_idx].match;
+  matching[curr_idx].match = matching[swap_idx].match;
+  matching[swap_idx].match = temp;
+  search->match_slot[matching[curr_idx].match - 'A'] = curr_idx;
+  search->match_slot[matching[swap_idx].match - 'A'] = swap_idx;
+
+  double temp_dist = matching[curr_idx].distance;
+  matching[curr_idx].distance = matching[swap_idx].distance * candidate->frequency;
+  matching[swap_idx].distance = temp_dist;
+
+  for (int p = 0; p < 2 && candidate->pair_indices[p] >= 0; p++) {
+    matching[candidate->pair_indices[p]].distance = matching[candidate->pair_indices[p]].distance * candidate->frequency;
   }
-  cs642Decrypt(CIPHER_SUBS, best_key, 26, plaintext, plen, ciphertext, clen);
 
-  strcpy(key, best_key);
-  // Return success
-  return 1;
+  // Increment Updates
+  search->updates++;
+  logMessage(CipherVerboseLevel, "Best key %s: %d words (increment %d).", search->best_key, search->best_number,
+             search->increment_distance);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : cs642StudentCleanUp
-// Description  : This is a clean up function called at the end of the
-//                cryptanalysis of the different ciphers. Use it if you need to
-//                release memory you allocated in cs642StudentInit() for
-//                instance.
+// Function     : subsNgramPhase
+// Description  : Matches letters by bigram (order 2) or trigram (order 3)
+//                frequency. Candidates for a letter are built against the
+//                current best key and scored a batch at a time; the first
+//                improvement is kept and collection restarts right after it,
+//                so the result is the same as scoring them one by one.
 //
-// Inputs       : void
-// Outputs      : 0 if successful, -1 if failure
+// Inputs       : search - the substitution search
+//                order - the n-gram order (2 or 3)
+//                target - the score at which the phase stops
+//                max_increment - the number of threshold increments to try
+// Outputs      : 1 if the phase met its own stop condition, 0 if cut short
+int subsNgramPhase(struct SubsSearch *search, int order, int target, int max_increment) {
+  while (search->best_number < target && search->increment_distance < max_increment) {
+    // For each unmatched character (resuming at the saved letter)
+    for (int curr_idx = search->letter; curr_idx < ALPHABET_SIZE; curr_idx++) {
+      search->letter = curr_idx;
+      maybeSaveSubsCheckpoint(search);
+      if (search->matching[curr_idx].distance > 0.001 * pow(10, -1 * search->increment_distance)) { // If character unmatched, traverse n-grams
+        int rank = 0;
+        for (;;) {
+          struct SwapCandidate batch[EVALUATION_BATCH];
+          int count = collectSwapCandidates(search, order, curr_idx, &rank, batch);
+          if (count == 0) {
+            break; // Every candidate of the letter tried
+          }
+
+          // Update the best key with the first better attempt; later ones were built from the old key
+          char *keys[EVALUATION_BATCH];
+          int scores[EVALUATION_BATCH];
+          for (int c = 0; c < count; c++) {
+            keys[c] = batch[c].key;
+          }
+          if (search->budget->exhausted && !memoHoldsKeys(search, keys, count)) {
+            return (0); // Leave the cursor on the letter being worked on
+          }
+          evaluateSubsKeys(search, keys, count, scores);
+          for (int c = 0; c < count; c++) {
+            if (scores[c] > search->best_number) {
+              acceptSwapCandidate(search, curr_idx, &batch[c], scores[c]);
+              rank = batch[c].rank + 1;
+              break;
+            }
+          }
+        }
+      }
+    }
+    search->letter = 0;
+    search->increment_distance++; // Increase matching threshold (be stricter on matches)
+  }
+  return (1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runSubsPhases
+// Description  : Runs the search from its current phase through the monogram,
+//                bigram and trigram phases until it converges or the budget
+//                runs out (the phase is only advanced when one meets its own
+//                stop condition, even if that took the last evaluation)
+//
+// Inputs       : search - the substitution search
+// Outputs      : void
+void runSubsPhases(struct SubsSearch *search) {
+  if (search->phase == SUBS_PHASE_MONOGRAM) {
+    logMessage(CipherVerboseLevel, "Monogram phase from key %s: %d words.", search->best_key, search->best_number);
+
+    /**** MONOGRAM LOGIC ****/
+    cs642ProfileBegin(CS642_PROFILE_SUBS_MONOGRAM);
+    int completed = subsMonogramPhase(search);
+    cs642ProfileEnd(CS642_PROFILE_SUBS_MONOGRAM);
+
+    logMessage(CipherVerboseLevel, "Phase ended with key %s: %d words (%d attempts, %d updates).", search->best_key,
+               search->best_number, search->attempts, search->updates);
+    if (completed) {
+      // Reset Attempts and Updates
+      search->updates = 0;
+      search->attempts = 0;
+      search->phase = SUBS_PHASE_BIGRAM;
+    }
+  }
+
+  if (search->phase == SUBS_PHASE_BIGRAM) {
+    logMessage(CipherVerboseLevel, "Bigram phase from key %s: %d words.", search->best_key, search->best_number);
+
+    /**** BIGRAM LOGIC ****/
+    cs642ProfileBegin(CS642_PROFILE_SUBS_BIGRAM);
+    int completed = subsNgramPhase(search, 2, 500, SUBS_BIGRAM_INCREMENTS);
+    cs642ProfileEnd(CS642_PROFILE_SUBS_BIGRAM);
+
+    logMessage(CipherVerboseLevel, "Phase ended with key %s: %d words (%d attempts, %d updates).", search->best_key,
+               search->best_number, search->attempts, search->updates);
+    if (completed) {
+      // Reset Attempts and Updates
+      search->updates = 0;
+      search->attempts = 0;
+      search->increment_distance = 0;
+      search->letter = 0;
+      search->phase = SUBS_PHASE_TRIGRAM;
+    }
+  }
+
+  if (search->phase == SUBS_PHASE_TRIGRAM) {
+    logMessage(CipherVerboseLevel, "Trigram phase from key %s: %d words.", search->best_key, search->best_number);
+
+    /**** TRIGRAM LOGIC ****/
+    cs642ProfileBegin(CS642_PROFILE_SUBS_TRIGRAM);
+    int completed = subsNgramPhase(search, 3, 550, SUBS_TRIGRAM_INCREMENTS);
+    cs642ProfileEnd(CS642_PROFILE_SUBS_TRIGRAM);
+
+    logMessage(CipherVerboseLevel, "Phase ended with key %s: %d words (%d attempts, %d updates).", search->best_key,
+               search->best_number, search->attempts, search->updates);
+    if (completed) {
+      search->phase = SUBS_PHASE_DONE;
+    }
+  }
+  logMessage(LOG_INFO_LEVEL, "Substitution search: %ld evaluations, %ld memo hits.", search->budget->evaluations,
+             search->budget->memo_hits);
+  if (levelEnabled(CipherVerboseLevel)) {
+    char distances[ALPHABET_SIZE * 16] = "";
+    for (int i = 0, used = 0; i < ALPHABET_SIZE; i++) {
+      used += snprintf(distances + used, sizeof(distances) - used, " %c:%.6f", search->matching[i].self,
+                       search->matching[i].distance);
+    }
+    logMessage(CipherVerboseLevel, "Matching distances:%s", distances);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runSUBSCryptanalysis
+// Description  : Performs the monogram, bigram and trigram substitution search
+//                until it converges or the budget runs out
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the best key found
+//                budget - the search budget (updated as keys are evaluated)
+//                converged - the place to put whether every phase completed (or NULL)
+// Outputs      : the dictionary score of the best key
+int runSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
+                         int plen, char *key, struct SubsSearchBudget *budget, int *converged) {
+  struct SubsSearch search;
+  initSubsSearch(&search, ciphertext, clen, budget);
+  search.checkpointed = subs_checkpoint.enabled; // The beam, annealing, portfolio, crib and session searches never save
+  if (search.checkpointed && subs_checkpoint.resume) {
+    loadSubsCheckpoint(&search);
+  }
+
+  runSubsPhases(&search);
+
+  // Keep the state of a cut short search, drop the checkpoint of a finished one
+  if (search.checkpointed) {
+    if (search.phase == SUBS_PHASE_DONE) {
+      char path[CHECKPOINT_PREFIX + 32];
+      subsCheckpointPath(&search, path, sizeof(path));
+      remove(path);
+    } else {
+      saveSubsCheckpoint(&search);
+    }
+  }
+  cs642Decrypt(CIPHER_SUBS, search.best_key, 26, plaintext, plen, ciphertext, clen);
+
+  strcpy(key, search.best_key);
+  if (converged != NULL) {
+    *converged = (search.phase == SUBS_PHASE_DONE);
+  }
+  freeSubsSearch(&search);
+  return search.best_number;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysis
+// Description  : This is the function to cryptanalyze the substitution cipher
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
+                                  int plen, char *key) {
+  if (subs_portfolio > 0) {
+    return (cs642PerformSUBSCryptanalysisPortfolio(ciphertext, clen, plaintext, plen, key, subs_portfolio) ? -1 : 1);
+  }
+  if (subs_anneal) {
+    return (cs642PerformSUBSCryptanalysisAnneal(ciphertext, clen, plaintext, plen, key, &subs_anneal_schedule,
+                                                NULL) ? -1 : 1);
+  }
+  if (subs_beam_width > 0) {
+    return (cs642PerformSUBSCryptanalysisBeam(ciphertext, clen, plaintext, plen, key, subs_beam_width) ? -1 : 1);
+  }
+
+  // Nothing configured: the engine the tuning profile chose for this length
+  const cs642Tuning *tuning = cs642GetTuning(clen);
+  if (tuning->subs_engine == CS642_SUBS_PORTFOLIO) {
+    return (cs642PerformSUBSCryptanalysisPortfolio(ciphertext, clen, plaintext, plen, key,
+                                                   tuning->portfolio_engines) ? -1 : 1);
+  }
+  if (tuning->subs_engine == CS642_SUBS_ANNEAL) {
+    cs642AnnealSchedule schedule = {0, 0, tuning->anneal_steps, tuning->anneal_restarts, 0};
+    return (cs642PerformSUBSCryptanalysisAnneal(ciphertext, clen, plaintext, plen, key, &schedule, NULL) ? -1 : 1);
+  }
+  if (tuning->subs_engine == CS642_SUBS_BEAM) {
+    return (cs642PerformSUBSCryptanalysisBeam(ciphertext, clen, plaintext, plen, key, tuning->beam_width) ? -1 : 1);
+  }
+
+  struct SubsSearchBudget budget;
+  initSubsSearchBudget(&budget, NULL);
+  runSUBSCryptanalysis(ciphertext, clen, plaintext, plen, key, &budget, NULL);
+
+  // Return success
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysisBudget
+// Description  : Anytime variant of the substitution cryptanalysis that stops
+//                once a time or evaluation budget is spent and reports the best
+//                key found so far
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+//                limits - the time/evaluation budget (NULL = unlimited)
+//                result - the place to put the score and convergence (or NULL)
+// Outputs      : 0 if the search converged, 1 if it was cut short
+int cs642PerformSUBSCryptanalysisBudget(char *ciphertext, int clen, char *plaintext,
+                                        int plen, char *key, const cs642SubsBudget *limits,
+                                        cs642SubsResult *result) {
+  struct SubsSearchBudget budget;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  initSubsSearchBudget(&budget, limits);
+  int converged = 0;
+  int score = runSUBSCryptanalysis(ciphertext, clen, plaintext, plen, key, &budget, &converged);
+
+  if (result != NULL) {
+    double seconds = elapsedSince(&start);
+    result->score = score;
+    result->evaluations = budget.evaluations;
+    result->memo_hits = budget.memo_hits;
+    result->converged = converged;
+    result->evaluations_per_second = (seconds > 0) ? budget.evaluations / seconds : 0.0;
+  }
+  return (converged ? 0 : 1);
+}
+
+// Struct to represent a partial substitution key of the beam search
+struct BeamState {
+  uint8_t plain[ALPHABET_SIZE]; // Plaintext letter of each ciphertext letter (CS642_KERNEL_NONLETTER = unassigned)
+  uint32_t used;                // Plaintext letters already assigned (bit mask)
+  double score;                 // Log-likelihood of the n-grams whose letters are all assigned
+};
+
+// Struct to represent one letter assignment extending a beam state
+struct BeamExpansion {
+  double score; // Score of the extended state
+  int parent;   // Beam state extended
+  int plain;    // Plaintext letter given to the ciphertext letter of this depth
+};
+
+// Struct to represent an observed n-gram scored once its last letter is assigned
+struct BeamNgram {
+  uint8_t letters[3]; // Ciphertext letter codes
+  uint8_t length;     // 2 or 3
+  uint32_t count;     // Occurrences in the ciphertext
+};
+
+// Function to order beam expansions by descending score (ties by parent, then letter)
+int compareBeamExpansions(const void *a, const void *b) {
+  const struct BeamExpansion *expansionA = (const struct BeamExpansion *)a;
+  const struct BeamExpansion *expansionB = (const struct BeamExpansion *)b;
+  if (expansionA->score != expansionB->score) {
+    return (expansionB->score > expansionA->score) ? 1 : -1;
+  }
+  if (expansionA->parent != expansionB->parent) {
+    return expansionA->parent - expansionB->parent;
+  }
+  return expansionA->plain - expansionB->plain;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : beamSearchSUBSKey
+// Description  : Grows partial keys one ciphertext letter at a time, in
+//                descending ciphertext frequency, scoring each assignment only
+//                on the letters and n-grams it completes and keeping the best
+//                width states at every depth. The complete keys are reranked
+//                by their dictionary score.
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                width - the beam width
+//                counts - the ciphertext letter and n-gram counts
+//                cancel - set by another thread to stop the search (or NULL)
+//                key - the place to put the best key found
+// Outputs      : 0 if successful, -1 if failure or cancelled
+int beamSearchSUBSKey(char *ciphertext, int clen, int width, const cs642TextCounts *counts, const int *cancel,
+                      char *key) {
+  const uint32_t *letter_counts = counts->letters, *bigrams = counts->bigrams, *trigrams = counts->trigrams;
+  const struct LanguageModel *model = localModel();
+  // Assign ciphertext letters in descending frequency (ties alphabetically)
+  int order[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    order[i] = i;
+  }
+  for (int i = 1; i < ALPHABET_SIZE; i++) {
+    for (int j = i; j > 0 && letter_counts[order[j]] > letter_counts[order[j - 1]]; j--) {
+      int swap = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = swap;
+    }
+  }
+  int depth_of_letter[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    depth_of_letter[order[i]] = i;
+  }
+
+  // Group the observed n-grams by the depth that completes them
+  int ngram_count = 0;
+  for (int i = 0; i < BIGRAM_SPACE; i++) {
+    ngram_count += (bigrams[i] > 0);
+  }
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    ngram_count += (trigrams[i] > 0);
+  }
+  size_t ngram_bytes = sizeof(struct BeamNgram) * (ngram_count + 1), state_bytes = sizeof(struct BeamState) * width;
+  size_t expansion_bytes = sizeof(struct BeamExpansion) * width * ALPHABET_SIZE;
+  size_t candidate_bytes = sizeof(char[ALPHABET_SIZE + 1]) * width, batch_bytes = (size_t)EVALUATION_BATCH * (clen + 1);
+  cs642Arena *arena = cs642ScratchArena();
+  if (cs642ArenaReserve(arena, 2 * ARENA_BLOCK(ngram_bytes) + 2 * ARENA_BLOCK(state_bytes) +
+                                   ARENA_BLOCK(expansion_bytes) + ARENA_BLOCK(candidate_bytes) +
+                                   ARENA_BLOCK(batch_bytes))) {
+    return (-1);
+  }
+  struct BeamNgram *observed = cs642ArenaAlloc(arena, ngram_bytes);
+  struct BeamNgram *ngrams = cs642ArenaAlloc(arena, ngram_bytes);
+  struct BeamState *states = cs642ArenaAlloc(arena, state_bytes);
+  struct BeamState *next = cs642ArenaAlloc(arena, state_bytes);
+  struct BeamExpansion *expansions = cs642ArenaAlloc(arena, expansion_bytes);
+  char (*candidates)[ALPHABET_SIZE + 1] = cs642ArenaAlloc(arena, candidate_bytes);
+  char *plaintexts = cs642ArenaAlloc(arena, batch_bytes);
+  if (observed == NULL || ngrams == NULL || states == NULL || next == NULL || expansions == NULL ||
+      candidates == NULL || plaintexts == NULL) {
+    cs642ArenaReset(arena);
+    return (-1);
+  }
+  int depth_start[ALPHABET_SIZE + 1] = {0};
+  uint8_t ngram_depth[ngram_count + 1];
+  ngram_count = 0;
+  for (int i = 0; i < BIGRAM_SPACE; i++) {
+    if (bigrams[i] > 0) {
+      observed[ngram_count++] = (struct BeamNgram){{i / ALPHABET_SIZE, i % ALPHABET_SIZE, 0}, 2, bigrams[i]};
+    }
+  }
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    if (trigrams[i] > 0) {
+      observed[ngram_count++] = (struct BeamNgram){{i / BIGRAM_SPACE, (i / ALPHABET_SIZE) % ALPHABET_SIZE,
+                                                  i % ALPHABET_SIZE}, 3, trigrams[i]};
+    }
+  }
+  for (int i = 0; i < ngram_count; i++) {
+    int depth = 0;
+    for (int j = 0; j < observed[i].length; j++) {
+      depth = (depth_of_letter[observed[i].letters[j]] > depth) ? depth_of_letter[observed[i].letters[j]] : depth;
+    }
+    ngram_depth[i] = depth;
+    depth_start[depth + 1]++;
+  }
+  int cursor[ALPHABET_SIZE];
+  for (int d = 0; d < ALPHABET_SIZE; d++) {
+    depth_start[d + 1] += depth_start[d];
+    cursor[d] = depth_start[d];
+  }
+  for (int i = 0; i < ngram_count; i++) {
+    ngrams[cursor[ngram_depth[i]]++] = observed[i];
+  }
+
+  // Start from the empty key and extend every state by every free letter
+  int live = 1;
+  memset(states[0].plain, CS642_KERNEL_NONLETTER, ALPHABET_SIZE);
+  states[0].used = 0;
+  states[0].score = 0.0;
+  int cancelled = 0;
+  for (int d = 0; d < ALPHABET_SIZE && !cancelled; d++) {
+    if (cancel != NULL && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+      cancelled = 1;
+      break;
+    }
+    int cipher = order[d], extended = 0;
+    for (int s = 0; s < live; s++) {
+      uint8_t plain[ALPHABET_SIZE];
+      memcpy(plain, states[s].plain, ALPHABET_SIZE);
+      for (int p = 0; p < ALPHABET_SIZE; p++) {
+        if (states[s].used & (1u << p)) {
+          continue;
+        }
+        plain[cipher] = p;
+        double score = states[s].score + letter_counts[cipher] * log(letter_frequencies[p] + 1e-6);
+        for (int n = depth_start[d]; n < depth_start[d + 1]; n++) {
+          const uint8_t *letters = ngrams[n].letters;
+          if (ngrams[n].length == 2) {
+            score += ngrams[n].count * model->bigram_log_probs[BIGRAM_INDEX(plain[letters[0]], plain[letters[1]])];
+          } else {
+            score += ngrams[n].count *
+                     model->trigram_log_probs[TRIGRAM_INDEX(plain[letters[0]], plain[letters[1]], plain[letters[2]])];
+          }
+        }
+        expansions[extended++] = (struct BeamExpansion){score, s, p};
+      }
+    }
+
+    // Keep the best width extensions
+    qsort(expansions, extended, sizeof(struct BeamExpansion), compareBeamExpansions);
+    live = (extended < width) ? extended : width;
+    for (int e = 0; e < live; e++) {
+      next[e] = states[expansions[e].parent];
+      next[e].plain[cipher] = expansions[e].plain;
+      next[e].used |= 1u << expansions[e].plain;
+      next[e].score = expansions[e].score;
+    }
+    struct BeamState *swap = states;
+    states = next;
+    next = swap;
+  }
+
+  // Rerank the complete keys by their dictionary score
+  char *keys[SUBS_BEAM_MAX];
+  int scores[SUBS_BEAM_MAX];
+  for (int s = 0; s < live && !cancelled; s++) {
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+      candidates[s][states[s].plain[c]] = c + 'A';
+    }
+    candidates[s][ALPHABET_SIZE] = '\0';
+    keys[s] = candidates[s];
+  }
+  if (!cancelled) {
+    for (int first = 0; first < live; first += EVALUATION_BATCH) {
+      int lanes = (live - first < EVALUATION_BATCH) ? live - first : EVALUATION_BATCH;
+      decryptSubsBatch(ciphertext, clen, keys + first, lanes, plaintexts, clen + 1);
+      for (int k = 0; k < lanes; k++) {
+        scores[first + k] = getNumberWordsFromDict(plaintexts + k * (clen + 1));
+      }
+    }
+    int best = 0;
+    for (int s = 1; s < live; s++) {
+      if (scores[s] > scores[best]) {
+        best = s;
+      }
+    }
+    strcpy(key, keys[best]);
+  }
+  cs642ArenaReset(arena);
+  return (cancelled ? -1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysisBeam
+// Description  : Deterministic substitution cryptanalysis: a beam search over
+//                partial keys followed by the bigram/trigram refinement phases
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+//                width - the beam width (0 = SUBS_BEAM_WIDTH)
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformSUBSCryptanalysisBeam(char *ciphertext, int clen, char *plaintext,
+                                      int plen, char *key, int width) {
+  if (width == 0) {
+    width = SUBS_BEAM_WIDTH;
+  }
+  if (width < 1 || width > SUBS_BEAM_MAX) {
+    return (-1);
+  }
+  ensureNgramModel();
+
+  // Count Letters, Bigrams and Trigrams in Ciphertext
+  cs642TextCounts counts;
+  countCiphertext(&counts, ciphertext, clen);
+
+  char beam_key[ALPHABET_SIZE + 1];
+  cs642ProfileBegin(CS642_PROFILE_SUBS_BEAM);
+  int failed = beamSearchSUBSKey(ciphertext, clen, width, &counts, NULL, beam_key);
+  cs642ProfileEnd(CS642_PROFILE_SUBS_BEAM);
+  if (failed) {
+    return (-1);
+  }
+
+  // Polish the beam key with the (deterministic) n-gram swap phases
+  struct SubsSearchBudget budget;
+  struct SubsSearch search;
+  initSubsSearchBudget(&budget, NULL);
+  prepareSubsSearch(&search, ciphertext, clen, &budget, &counts, beam_key);
+  runSubsPhases(&search);
+  cs642Decrypt(CIPHER_SUBS, search.best_key, ALPHABET_SIZE, plaintext, plen, ciphertext, clen);
+  strcpy(key, search.best_key);
+  freeSubsSearch(&search);
+  return (0);
+}
+
+// Struct to represent an observed trigram of the annealing engine
+struct AnnealTrigram {
+  uint8_t letters[3]; // Ciphertext letter codes
+  uint32_t count;     // Occurrences in the ciphertext
+};
+
+// Struct to hold the ciphertext trigrams, indexed by the letters they contain
+struct AnnealModel {
+  struct AnnealTrigram *trigrams;  // Distinct observed trigrams
+  int trigram_count;               // Number of distinct trigrams
+  int *touching;                   // Trigrams containing each letter, letter by letter
+  int touching_start[ALPHABET_SIZE + 1]; // First entry of each letter in touching
+  int present[ALPHABET_SIZE];      // Ciphertext letters that occur, in alphabetical order
+  int present_count;               // Number of letters that occur
+  double temperature_scale;        // Ciphertext trigrams / 1000 (the schedule's unit)
+  const float *log_probs;          // Trigram log-probabilities of the building thread's model
+};
+
+// Metropolis acceptance thresholds: entry b holds e^-x for the x of bin b,
+// scaled to the 32-bit range of the generator
+static uint32_t anneal_acceptance[ANNEAL_TABLE_SIZE];
+static pthread_once_t anneal_acceptance_once = PTHREAD_ONCE_INIT;
+
+// Fills the acceptance table (the only exp() calls of the engine)
+void buildAnnealAcceptance(void) {
+  for (int b = 0; b < ANNEAL_TABLE_SIZE; b++) {
+    double x = (b + 0.5) * ANNEAL_TABLE_RANGE / ANNEAL_TABLE_SIZE;
+    anneal_acceptance[b] = (uint32_t)(exp(-x) * UINT32_MAX);
+  }
+}
+
+// Returns the next value of a xorshift64* generator (never seeded with 0)
+static inline uint64_t annealRandom(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (*state * 0x2545F4914F6CDD1DULL);
+}
+
+// Returns the arena reservation the annealing tables of a ciphertext need
+size_t annealModelBytes(const cs642TextCounts *counts) {
+  int distinct = 0;
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    distinct += (counts->trigrams[i] > 0);
+  }
+  return (ARENA_BLOCK(sizeof(struct AnnealTrigram) * (distinct + 1)) + ARENA_BLOCK(sizeof(int) * (3 * distinct + 1)));
+}
+
+// Indexes the observed trigrams of the ciphertext by letter, in tables borrowed
+// from the calling thread's arena (released by the caller's reset). Returns 0
+// if successful, -1 if the tables cannot be borrowed.
+int buildAnnealModel(const cs642TextCounts *counts, struct AnnealModel *model) {
+  int distinct = 0;
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    distinct += (counts->trigrams[i] > 0);
+  }
+  memset(model, 0x00, sizeof(struct AnnealModel));
+  cs642Arena *arena = cs642ScratchArena();
+  if (cs642ArenaReserve(arena, annealModelBytes(counts))) {
+    return (-1);
+  }
+  model->trigrams = cs642ArenaAlloc(arena, sizeof(struct AnnealTrigram) * (distinct + 1));
+  model->touching = cs642ArenaAlloc(arena, sizeof(int) * (3 * distinct + 1));
+  if (model->trigrams == NULL || model->touching == NULL) {
+    return (-1);
+  }
+
+  // List each trigram once under every distinct letter it contains
+  int t = 0;
+  for (int i = 0; i < TRIGRAM_SPACE; i++) {
+    if (counts->trigrams[i] > 0) {
+      uint8_t a = i / BIGRAM_SPACE, b = (i / ALPHABET_SIZE) % ALPHABET_SIZE, c = i % ALPHABET_SIZE;
+      model->trigrams[t] = (struct AnnealTrigram){{a, b, c}, counts->trigrams[i]};
+      model->touching_start[a + 1]++;
+      model->touching_start[b + 1] += (b != a);
+      model->touching_start[c + 1] += (c != a && c != b);
+      t++;
+    }
+  }
+  int cursor[ALPHABET_SIZE];
+  for (int l = 0; l < ALPHABET_SIZE; l++) {
+    model->touching_start[l + 1] += model->touching_start[l];
+    cursor[l] = model->touching_start[l];
+  }
+  for (t = 0; t < distinct; t++) {
+    const uint8_t *letters = model->trigrams[t].letters;
+    model->touching[cursor[letters[0]]++] = t;
+    if (letters[1] != letters[0]) {
+      model->touching[cursor[letters[1]]++] = t;
+    }
+    if (letters[2] != letters[0] && letters[2] != letters[1]) {
+      model->touching[cursor[letters[2]]++] = t;
+    }
+  }
+
+  for (int l = 0; l < ALPHABET_SIZE; l++) {
+    if (counts->letters[l] > 0) {
+      model->present[model->present_count++] = l;
+    }
+  }
+  model->trigram_count = distinct;
+  model->temperature_scale = (counts->total_trigrams > 0) ? counts->total_trigrams / 1000.0 : 1.0;
+  model->log_probs = localModel()->trigram_log_probs;
+  return (0);
+}
+
+// Returns the log-likelihood of the trigrams containing letter x or y under a
+// partial decryption (trigrams with both are counted once)
+static inline double annealTouching(const struct AnnealModel *model, const uint8_t *plain, int x, int y) {
+  double score = 0.0;
+  for (int n = model->touching_start[x]; n < model->touching_start[x + 1]; n++) {
+    const struct AnnealTrigram *trigram = &model->trigrams[model->touching[n]];
+    score += trigram->count * model->log_probs[TRIGRAM_INDEX(plain[trigram->letters[0]], plain[trigram->letters[1]],
+                                                             plain[trigram->letters[2]])];
+  }
+  for (int n = model->touching_start[y]; n < model->touching_start[y + 1]; n++) {
+    const struct AnnealTrigram *trigram = &model->trigrams[model->touching[n]];
+    if (trigram->letters[0] == x || trigram->letters[1] == x || trigram->letters[2] == x) {
+      continue;
+    }
+    score += trigram->count * model->log_probs[TRIGRAM_INDEX(plain[trigram->letters[0]], plain[trigram->letters[1]],
+                                                             plain[trigram->letters[2]])];
+  }
+  return (score);
+}
+
+// Returns the log-likelihood of every observed trigram under a decryption
+double annealScore(const struct AnnealModel *model, const uint8_t *plain) {
+  double score = 0.0;
+  for (int t = 0; t < model->trigram_count; t++) {
+    const uint8_t *letters = model->trigrams[t].letters;
+    score += model->trigrams[t].count *
+             model->log_probs[TRIGRAM_INDEX(plain[letters[0]], plain[letters[1]], plain[letters[2]])];
+  }
+  return (score);
+}
+
+// Fills a key matching the ciphertext letters to the model letters by rank of
+// frequency (the start of the first restart)
+void frequencyMatchedKey(const uint32_t *letters, uint8_t *plain) {
+  // Rank the model letters (kept in A-Z order) by descending frequency
+  struct LetterFrequency expected[ALPHABET_SIZE];
+  memcpy(expected, letter_frequencies_struct, sizeof(expected));
+  qsort(expected, ALPHABET_SIZE, sizeof(struct LetterFrequency), compareLetterFrequencies);
+
+  int order[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    order[i] = i;
+  }
+  for (int i = 1; i < ALPHABET_SIZE; i++) {
+    for (int j = i; j > 0 && letters[order[j]] > letters[order[j - 1]]; j--) {
+      int swap = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = swap;
+    }
+  }
+  for (int rank = 0; rank < ALPHABET_SIZE; rank++) {
+    plain[order[rank]] = expected[rank].letter - 'A';
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : annealSUBSKey
+// Description  : Simulated annealing over key swaps. Each step swaps the
+//                plaintext letters of two ciphertext letters, rescoring only
+//                the trigrams that contain them, and keeps the swap if it
+//                improves the trigram log-likelihood or passes the Metropolis
+//                test (a table lookup against the generator, no exp()). The
+//                temperature cools geometrically over the steps.
+//
+// Inputs       : model - the indexed ciphertext trigrams
+//                schedule - the cooling schedule (restarts are the caller's)
+//                random - the generator state
+//                cancel - set by another thread to stop the search (or NULL)
+//                pinned - ciphertext letters whose plaintext letter is fixed
+//                         (bit mask, e.g. by a crib)
+//                plain - the starting key (plaintext letter of each ciphertext
+//                        letter), replaced by the best key visited
+//                evaluations - the place to add the swaps evaluated to
+// Outputs      : 0 if successful, -1 if cancelled
+int annealSUBSKey(const struct AnnealModel *model, const cs642AnnealSchedule *schedule, uint64_t *random,
+                  const int *cancel, uint32_t pinned, uint8_t *plain, long *evaluations) {
+  pthread_once(&anneal_acceptance_once, buildAnnealAcceptance);
+  double cooling = pow(schedule->start_temperature / schedule->end_temperature, 1.0 / schedule->steps);
+  double inverse_temperature = 1.0 / (schedule->start_temperature * model->temperature_scale);
+  double table_scale = ANNEAL_TABLE_SIZE / ANNEAL_TABLE_RANGE;
+  uint8_t current[ALPHABET_SIZE];
+  memcpy(current, plain, ALPHABET_SIZE);
+  double score = annealScore(model, current), best = score;
+  int free_letters[ALPHABET_SIZE], present = 0;
+  for (int l = 0; l < model->present_count; l++) {
+    if (!(pinned & (1u << model->present[l]))) {
+      free_letters[present++] = model->present[l];
+    }
+  }
+
+  for (long step = 0; step < schedule->steps && present > 1; step++) {
+    if (cancel != NULL && step % ANNEAL_CANCEL_CHECK == 0 && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+      return (-1);
+    }
+
+    // Two distinct ciphertext letters and the acceptance draw from one value
+    uint64_t draw = annealRandom(random);
+    int i = (int)((draw & 0xFFFF) % present), j = (int)(((draw >> 16) & 0xFFFF) % (present - 1));
+    int x = free_letters[i], y = free_letters[(j >= i) ? j + 1 : j];
+
+    double before = annealTouching(model, current, x, y);
+    uint8_t swap = current[x];
+    current[x] = current[y];
+    current[y] = swap;
+    double delta = annealTouching(model, current, x, y) - before;
+    (*evaluations)++;
+
+    // Metropolis test: a worse key survives with probability e^(delta / T)
+    double bin = -delta * inverse_temperature * table_scale;
+    if (delta >= 0 || (bin < ANNEAL_TABLE_SIZE && (uint32_t)(draw >> 32) < anneal_acceptance[(int)bin])) {
+      score += delta;
+      if (score > best) {
+        best = score;
+        memcpy(plain, current, ALPHABET_SIZE);
+      }
+    } else {
+      current[y] = current[x];
+      current[x] = swap;
+    }
+    inverse_temperature *= cooling;
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysisAnneal
+// Description  : Substitution cryptanalysis by simulated annealing of the
+//                trigram log-likelihood, stopping at the first restart whose
+//                key is confirmed by the dictionary
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+//                schedule - the cooling schedule (NULL or 0 fields = default)
+//                result - the place to put the score and speed (or NULL)
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformSUBSCryptanalysisAnneal(char *ciphertext, int clen, char *plaintext,
+                                        int plen, char *key, const cs642AnnealSchedule *schedule,
+                                        cs642SubsResult *result) {
+  cs642AnnealSchedule resolved;
+  if (resolveAnnealSchedule(schedule, &resolved)) {
+    return (-1);
+  }
+  schedule = &resolved;
+  ensureNgramModel();
+  cs642ProfileBegin(CS642_PROFILE_SUBS_ANNEAL);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  cs642TextCounts counts;
+  struct AnnealModel model;
+  countCiphertext(&counts, ciphertext, clen);
+  if (buildAnnealModel(&counts, &model)) {
+    cs642ArenaReset(cs642ScratchArena());
+    cs642ProfileEnd(CS642_PROFILE_SUBS_ANNEAL);
+    return (-1);
+  }
+
+  // Restart from the frequency matching, then from random keys, until a key is confirmed
+  uint64_t random = (schedule->seed != 0) ? schedule->seed
+                                          : (uint64_t)start.tv_nsec * 0x9E3779B97F4A7C15ULL + start.tv_sec;
+  random = (random != 0) ? random : FNV_OFFSET;
+  uint8_t plain[ALPHABET_SIZE], best_plain[ALPHABET_SIZE];
+  double best_confidence = -1.0;
+  long evaluations = 0;
+  for (int restart = 0; restart < schedule->restarts && best_confidence < PORTFOLIO_CONFIDENCE; restart++) {
+    if (restart == 0) {
+      frequencyMatchedKey(counts.letters, plain);
+    } else {
+      for (int i = 0; i < ALPHABET_SIZE; i++) {
+        plain[i] = i;
+      }
+      for (int i = ALPHABET_SIZE - 1; i > 0; i--) {
+        int j = (int)(annealRandom(&random) % (i + 1));
+        uint8_t swap = plain[i];
+        plain[i] = plain[j];
+        plain[j] = swap;
+      }
+    }
+    annealSUBSKey(&model, schedule, &random, NULL, 0, plain, &evaluations);
+
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+      key[plain[c]] = c + 'A';
+    }
+    key[ALPHABET_SIZE] = '\0';
+    cs642Decrypt(CIPHER_SUBS, key, ALPHABET_SIZE, plaintext, plen, ciphertext, clen);
+    double confidence = confirmPlaintext(plaintext, clen);
+    if (confidence > best_confidence) {
+      best_confidence = confidence;
+      memcpy(best_plain, plain, ALPHABET_SIZE);
+    }
+  }
+  for (int c = 0; c < ALPHABET_SIZE; c++) {
+    key[best_plain[c]] = c + 'A';
+  }
+  key[ALPHABET_SIZE] = '\0';
+  cs642Decrypt(CIPHER_SUBS, key, ALPHABET_SIZE, plaintext, plen, ciphertext, clen);
+
+  double seconds = elapsedSince(&start);
+  logMessage(LOG_INFO_LEVEL, "Annealing: %ld evaluations in %.3fs (%.0f per second), confidence %.2f.",
+             evaluations, seconds, (seconds > 0) ? evaluations / seconds : 0.0, best_confidence);
+  if (result != NULL) {
+    result->score = getNumberWordsFromDict(plaintext);
+    result->evaluations = evaluations;
+    result->memo_hits = 0;
+    result->converged = (best_confidence >= PORTFOLIO_CONFIDENCE);
+    result->evaluations_per_second = (seconds > 0) ? evaluations / seconds : 0.0;
+  }
+  cs642ArenaReset(cs642ScratchArena());
+  cs642ProfileEnd(CS642_PROFILE_SUBS_ANNEAL);
+  return (0);
+}
+
+// Kinds of engine a portfolio can race
+enum PortfolioEngineKind {
+  PORTFOLIO_SWAP = 0,  // Monogram/bigram/trigram swap search (randomized)
+  PORTFOLIO_BEAM = 1,  // Beam search polished by the n-gram phases
+  PORTFOLIO_ANNEAL = 2 // One annealing run (default schedule) polished by the n-gram phases
+};
+
+// Struct to describe an engine of the portfolio
+struct PortfolioEngine {
+  int kind;  // Kind of engine (enum PortfolioEngineKind)
+  int width; // Beam width (beam engines)
+};
+
+// Default portfolio, in order of expected latency: annealing and a narrow beam
+// answer most long texts quickly, the swap search and the wide beam cover
+// inputs they misjudge
+static const struct PortfolioEngine portfolio_engines[PORTFOLIO_ENGINES] = {
+  {PORTFOLIO_ANNEAL, 0},
+  {PORTFOLIO_BEAM, 16},
+  {PORTFOLIO_SWAP, 0},
+  {PORTFOLIO_BEAM, 256},
+};
+
+// Struct to hold the ciphertext statistics and the result shared by a portfolio
+struct Portfolio {
+  char *ciphertext;                          // Ciphertext being analyzed
+  int clen;                                  // Length of the ciphertext
+  cs642TextCounts counts;                    // Ciphertext statistics, counted once for every engine
+  int cancel;                                // Set once a result is confirmed
+  pthread_mutex_t lock;                      // Protects the result below
+  char best_key[ALPHABET_SIZE + 1];          // Confirmed key, or the best so far
+  double best_confidence;                    // Confirmation share of best_key (-1 = none)
+  int winner;                                // Engine that produced best_key
+};
+
+// Struct to hand an engine its portfolio
+struct PortfolioTask {
+  struct Portfolio *portfolio;
+  int engine;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runPortfolioEngine
+// Description  : Runs one engine of a portfolio, stopping early once another
+//                engine has confirmed a key, and reports its own key
+//
+// Inputs       : arg - the task (portfolio and engine)
+// Outputs      : NULL
+void *runPortfolioEngine(void *arg) {
+  struct PortfolioTask *task = (struct PortfolioTask *)arg;
+  struct Portfolio *portfolio = task->portfolio;
+  const struct PortfolioEngine *engine = &portfolio_engines[task->engine];
+  char *warm_key = NULL, beam_key[ALPHABET_SIZE + 1]; // Warm start of the swap phases (beam or annealing key)
+
+  if (engine->kind == PORTFOLIO_BEAM) {
+    if (beamSearchSUBSKey(portfolio->ciphertext, portfolio->clen, engine->width, &portfolio->counts,
+                          &portfolio->cancel, beam_key)) {
+      cs642ReleaseScratchArena();
+      return (NULL);
+    }
+    warm_key = beam_key;
+  } else if (engine->kind == PORTFOLIO_ANNEAL) {
+    cs642AnnealSchedule schedule;
+    resolveAnnealSchedule(NULL, &schedule);
+    struct AnnealModel model;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t random = ((uint64_t)now.tv_nsec * 0x9E3779B97F4A7C15ULL) | 1;
+    uint8_t plain[ALPHABET_SIZE];
+    long evaluations = 0;
+    if (buildAnnealModel(&portfolio->counts, &model)) {
+      cs642ReleaseScratchArena();
+      return (NULL);
+    }
+    frequencyMatchedKey(portfolio->counts.letters, plain);
+    int cancelled = annealSUBSKey(&model, &schedule, &random, &portfolio->cancel, 0, plain, &evaluations);
+    cs642ArenaReset(cs642ScratchArena()); // The swap phases below borrow their own scratch
+    if (cancelled) {
+      cs642ReleaseScratchArena();
+      return (NULL);
+    }
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+      beam_key[plain[c]] = c + 'A';
+    }
+    beam_key[ALPHABET_SIZE] = '\0';
+    warm_key = beam_key;
+  }
+
+  struct SubsSearchBudget budget;
+  struct SubsSearch search;
+  initSubsSearchBudget(&budget, NULL);
+  budget.cancel = &portfolio->cancel;
+  prepareSubsSearch(&search, portfolio->ciphertext, portfolio->clen, &budget, &portfolio->counts, warm_key);
+  runSubsPhases(&search);
+
+  // Confirm the key on its decryption (reusing the search scratch)
+  char *keys[1] = {search.best_key};
+  decryptSubsBatch(portfolio->ciphertext, portfolio->clen, keys, 1, search.plaintexts, portfolio->clen + 1);
+  double confidence = confirmPlaintext(search.plaintexts, portfolio->clen);
+
+  pthread_mutex_lock(&portfolio->lock);
+  if (portfolio->best_confidence < PORTFOLIO_CONFIDENCE && confidence > portfolio->best_confidence) {
+    strcpy(portfolio->best_key, search.best_key);
+    portfolio->best_confidence = confidence;
+    portfolio->winner = task->engine;
+    if (confidence >= PORTFOLIO_CONFIDENCE) {
+      __atomic_store_n(&portfolio->cancel, 1, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&portfolio->lock);
+
+  freeSubsSearch(&search);
+  cs642ReleaseScratchArena();
+  return (NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysisPortfolio
+// Description  : Races several substitution engines over the same ciphertext
+//                statistics on separate threads. The first key whose
+//                plaintext passes confirmation wins and the other engines
+//                are cancelled; if none passes, the most confident key is used.
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+//                engines - the number of engines to race (0 = all)
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformSUBSCryptanalysisPortfolio(char *ciphertext, int clen, char *plaintext,
+                                           int plen, char *key, int engines) {
+  if (engines == 0) {
+    engines = PORTFOLIO_ENGINES;
+  }
+  if (engines < 1 || engines > PORTFOLIO_ENGINES) {
+    return (-1);
+  }
+  struct Portfolio *portfolio = calloc(1, sizeof(struct Portfolio));
+  if (portfolio == NULL) {
+    return (-1);
+  }
+  ensureNgramModel();
+
+  // Count the ciphertext statistics once for every engine
+  portfolio->ciphertext = ciphertext;
+  portfolio->clen = clen;
+  countCiphertext(&portfolio->counts, ciphertext, clen);
+  pthread_mutex_init(&portfolio->lock, NULL);
+  portfolio->best_confidence = -1.0;
+  portfolio->winner = -1;
+
+  // Race the engines
+  pthread_t threads[PORTFOLIO_ENGINES];
+  struct PortfolioTask tasks[PORTFOLIO_ENGINES];
+  int started[PORTFOLIO_ENGINES] = {0};
+  for (int e = 0; e < engines; e++) {
+    tasks[e] = (struct PortfolioTask){portfolio, e};
+    started[e] = (pthread_create(&threads[e], NULL, runPortfolioEngine, &tasks[e]) == 0);
+    if (!started[e]) {
+      runPortfolioEngine(&tasks[e]); // Run it here if no thread is available
+    }
+  }
+  for (int e = 0; e < engines; e++) {
+    if (started[e]) {
+      pthread_join(threads[e], NULL);
+    }
+  }
+
+  int failed = (portfolio->winner < 0);
+  if (!failed) {
+    logMessage(LOG_INFO_LEVEL, "Portfolio engine %d won (confidence %.2f).", portfolio->winner,
+               portfolio->best_confidence);
+    cs642Decrypt(CIPHER_SUBS, portfolio->best_key, ALPHABET_SIZE, plaintext, plen, ciphertext, clen);
+    strcpy(key, portfolio->best_key);
+  }
+  pthread_mutex_destroy(&portfolio->lock);
+  free(portfolio);
+  return (failed ? -1 : 0);
+}
+
+// Returns the number of letters of a crib, writing its letter codes
+int cribCodes(const char *crib, int len, uint8_t *codes) {
+  int letters = 0;
+  cs642GetKernels()->letter_codes(crib, len, codes);
+  for (int j = 0; j < len; j++) {
+    letters += (codes[j] < ALPHABET_SIZE);
+  }
+  return (letters);
+}
+
+// Writes the shift (ciphertext - crib letter) of every crib position placed at
+// an offset, returning 0 if the letters and non-letters of the crib line up
+// with the ciphertext. The loop has no data-dependent branch, so it vectorizes.
+static inline int cribShifts(const uint8_t *codes, const uint8_t *crib, int len, uint8_t *shifts) {
+  int misaligned = 0;
+  for (int j = 0; j < len; j++) {
+    int shift = codes[j] - crib[j];
+    shifts[j] = (uint8_t)(shift + ((shift < 0) ? ALPHABET_SIZE : 0));
+    misaligned |= (codes[j] == CS642_KERNEL_NONLETTER) != (crib[j] == CS642_KERNEL_NONLETTER);
+  }
+  return (misaligned);
+}
+
+// Fills the key letters of a period fixed by a crib placed at offset, if its
+// shifts agree on every column. Returns the number of columns fixed, or -1 if
+// they disagree.
+int cribPeriodKey(const uint8_t *crib, const uint8_t *shifts, int len, int offset, int period, char *key) {
+  uint8_t column_shift[VIGE_MAX_PERIOD];
+  int fixed = 0;
+  memset(column_shift, CS642_KERNEL_NONLETTER, sizeof(column_shift));
+  for (int j = 0, column = offset % period; j < len; j++, column = (column + 1 == period) ? 0 : column + 1) {
+    if (crib[j] == CS642_KERNEL_NONLETTER) {
+      continue;
+    }
+    if (column_shift[column] == CS642_KERNEL_NONLETTER) {
+      column_shift[column] = shifts[j];
+      key[column] = shifts[j] + 'A';
+      fixed++;
+    } else if (column_shift[column] != shifts[j]) {
+      return (-1);
+    }
+  }
+  return (fixed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cribShiftKey
+// Description  : Slides a crib across a ROTX or Vigenere ciphertext in one
+//                pass. At each offset where the crib lines up, the shifts it
+//                implies are checked for consistency with every candidate
+//                period (1 for ROTX, 6-11 by descending index of coincidence
+//                for Vigenere); columns the crib does not reach are taken
+//                from the column statistics. The first key whose decryption
+//                is accepted by the dictionary (or, for texts too short for
+//                that, is mostly dictionary words) wins. Candidates are decrypted
+//                into scratch, so plen only has to hold clen characters.
+//
+// Inputs       : cipher - CIPHER_ROTX or CIPHER_VIGE
+//                ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                crib - the crib
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in (letters 'A' + shift)
+// Outputs      : the length of the key, 0 if no placement checks out, -1 if failure
+int cribShiftKey(int cipher, char *ciphertext, int clen, const char *crib, char *plaintext, int plen, char *key) {
+  int len = (int)strlen(crib);
+  if (len == 0 || len > clen || plen < clen) {
+    return (0);
+  }
+  cs642Arena *arena = cs642ScratchArena();
+  char *scratch = NULL;
+  uint8_t *codes = NULL;
+  if (cs642ArenaReserve(arena, ARENA_BLOCK(clen + 1) + ARENA_BLOCK(clen + 2 * len)) ||
+      (scratch = cs642ArenaAlloc(arena, clen + 1)) == NULL || (codes = cs642ArenaAlloc(arena, clen + 2 * len)) == NULL) {
+    cs642ArenaReset(arena);
+    return (-1);
+  }
+  uint8_t *crib_codes = codes + clen, *shifts = crib_codes + len;
+  cs642GetKernels()->letter_codes(ciphertext, clen, codes);
+  if (cribCodes(crib, len, crib_codes) == 0) {
+    cs642ArenaReset(arena);
+    return (0);
+  }
+
+  // Candidate periods, and the statistical key of each for the columns a crib misses
+  int periods[VIGE_PERIODS], count = 1;
+  char statistical[VIGE_PERIODS][VIGE_MAX_PERIOD + 1];
+  struct VigenereColumnTable table;
+  if (cipher == CIPHER_VIGE) {
+    buildVigenereColumnTable(ciphertext, clen, &table);
+    rankVigenerePeriods(&table, periods);
+    for (int p = 0; p < VIGE_PERIODS; p++) {
+      deriveVigenereKey(&table, periods[p], statistical[p]);
+    }
+    count = VIGE_PERIODS;
+  } else {
+    periods[0] = 1;
+  }
+
+  int found = 0, verifications = 0;
+  for (int offset = 0; offset + len <= clen && !found && verifications < CRIB_MAX_PLACEMENTS; offset++) {
+    if (cribShifts(codes + offset, crib_codes, len, shifts)) {
+      continue;
+    }
+    for (int p = 0; p < count && !found && verifications < CRIB_MAX_PLACEMENTS; p++) {
+      char candidate[VIGE_MAX_PERIOD + 1];
+      if (cipher == CIPHER_VIGE) {
+        memcpy(candidate, statistical[p], periods[p] + 1);
+      } else {
+        candidate[1] = '\0';
+      }
+      if (cribPeriodKey(crib_codes, shifts, len, offset, periods[p], candidate) < 0) {
+        continue;
+      }
+      char *keys[1] = {candidate};
+      decryptShiftBatch(ciphertext, clen, keys, &periods[p], 1, scratch, clen + 1);
+      verifications++;
+      if (getNumberWordsFromDict(scratch) > cs642GetTuning(clen)->word_threshold ||
+          confirmPlaintext(scratch, clen) >= VIGE_CONFIRMATION) {
+        memcpy(plaintext, scratch, (plen > clen) ? clen + 1 : clen);
+        memcpy(key, candidate, periods[p] + 1);
+        found = periods[p];
+      }
+    }
+  }
+  cs642ArenaReset(arena);
+  return (found);
+}
+
+// Matches a crib placed at offset against a substitution ciphertext, filling
+// the ciphertext letter of each crib letter (key[plain] = cipher, others
+// untouched). Returns the number of letters fixed, or -1 if the placement
+// contradicts itself (a letter with two images, or misaligned non-letters).
+int cribSubsKey(const uint8_t *codes, const uint8_t *crib, int len, char *key) {
+  uint8_t cipher_of[ALPHABET_SIZE], plain_of[ALPHABET_SIZE];
+  int fixed = 0;
+  memset(cipher_of, CS642_KERNEL_NONLETTER, sizeof(cipher_of));
+  memset(plain_of, CS642_KERNEL_NONLETTER, sizeof(plain_of));
+  for (int j = 0; j < len; j++) {
+    if ((codes[j] == CS642_KERNEL_NONLETTER) != (crib[j] == CS642_KERNEL_NONLETTER)) {
+      return (-1);
+    }
+    if (crib[j] == CS642_KERNEL_NONLETTER) {
+      continue;
+    }
+    if (cipher_of[crib[j]] == CS642_KERNEL_NONLETTER && plain_of[codes[j]] == CS642_KERNEL_NONLETTER) {
+      cipher_of[crib[j]] = codes[j];
+      plain_of[codes[j]] = crib[j];
+      key[crib[j]] = codes[j] + 'A';
+      fixed++;
+    } else if (cipher_of[crib[j]] != codes[j]) {
+      return (-1);
+    }
+  }
+  return (fixed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cribSubsSearch
+// Description  : Slides a crib across a substitution ciphertext. Each
+//                placement whose letter pattern is consistent pins the crib
+//                letters, and one annealing run places the others around them;
+//                the first key the dictionary confirms wins. If none is
+//                confirmed, the best placement seeds the matching of the
+//                bigram/trigram phases with its crib letters pinned (never
+//                swapped) as a last attempt. Candidates are decrypted into
+//                scratch, so plen only has to hold clen characters.
+//
+// Inputs       : ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                crib - the crib
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in
+// Outputs      : 26 if a placement checks out, 0 if none does, -1 if failure
+int cribSubsSearch(char *ciphertext, int clen, const char *crib, char *plaintext, int plen, char *key) {
+  int len = (int)strlen(crib);
+  if (len == 0 || len > clen || plen < clen) {
+    return (0);
+  }
+  cs642TextCounts counts;
+  struct AnnealModel model;
+  countCiphertext(&counts, ciphertext, clen);
+
+  // Scratch, letter codes and annealing tables are reserved together
+  cs642Arena *arena = cs642ScratchArena();
+  char *scratch = NULL;
+  uint8_t *codes = NULL;
+  if (cs642ArenaReserve(arena, ARENA_BLOCK(clen + 1) + ARENA_BLOCK(clen + len) + annealModelBytes(&counts)) ||
+      (scratch = cs642ArenaAlloc(arena, clen + 1)) == NULL || (codes = cs642ArenaAlloc(arena, clen + len)) == NULL) {
+    cs642ArenaReset(arena);
+    return (-1);
+  }
+  uint8_t *crib_codes = codes + clen;
+  cs642GetKernels()->letter_codes(ciphertext, clen, codes);
+  if (cribCodes(crib, len, crib_codes) == 0 || buildAnnealModel(&counts, &model)) {
+    cs642ArenaReset(arena);
+    return (0);
+  }
+  cs642AnnealSchedule schedule;
+  resolveAnnealSchedule(NULL, &schedule);
+  uint64_t random = fingerprintText(ciphertext, clen) | 1;
+
+  // Anneal around each consistent placement until one is confirmed
+  int found = 0, placements = 0;
+  double best_score = -DBL_MAX;
+  char best_key[ALPHABET_SIZE + 1] = {0};
+  uint32_t best_pinned = 0;
+  for (int offset = 0; offset + len <= clen && !found && placements < CRIB_MAX_PLACEMENTS; offset++) {
+    char crib_key[ALPHABET_SIZE] = {0};
+    if (cribSubsKey(codes + offset, crib_codes, len, crib_key) <= 0) {
+      continue;
+    }
+    placements++;
+
+    // Pin the crib letters, giving the others the frequency matching of what is left
+    uint8_t plain[ALPHABET_SIZE];
+    int taken[ALPHABET_SIZE] = {0};
+    uint32_t pinned = 0;
+    frequencyMatchedKey(counts.letters, plain);
+    for (int p = 0; p < ALPHABET_SIZE; p++) {
+      if (crib_key[p] != 0) {
+        int c = crib_key[p] - 'A';
+        for (int other = 0; other < ALPHABET_SIZE; other++) {
+          if (plain[other] == p) { // Trade places with the letter that had p
+            plain[other] = plain[c];
+            break;
+          }
+        }
+        plain[c] = p;
+        taken[p] = 1;
+        pinned |= 1u << c;
+      }
+    }
+    long evaluations = 0;
+    annealSUBSKey(&model, &schedule, &random, NULL, pinned, plain, &evaluations);
+    double score = annealScore(&model, plain);
+
+    char candidate[ALPHABET_SIZE + 1];
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+      candidate[plain[c]] = c + 'A';
+    }
+    candidate[ALPHABET_SIZE] = '\0';
+    char *keys[1] = {candidate};
+    decryptSubsBatch(ciphertext, clen, keys, 1, scratch, clen + 1);
+    if (confirmPlaintext(scratch, clen) >= PORTFOLIO_CONFIDENCE) {
+      memcpy(plaintext, scratch, (plen > clen) ? clen + 1 : clen);
+      strcpy(key, candidate);
+      found = ALPHABET_SIZE;
+    } else if (score > best_score) {
+      best_score = score;
+      strcpy(best_key, candidate);
+      best_pinned = 0;
+      for (int p = 0; p < ALPHABET_SIZE; p++) {
+        best_pinned |= (uint32_t)taken[p] << p;
+      }
+    }
+  }
+  cs642ArenaReset(arena); // The search below borrows its own scratch
+
+  // Last attempt: the swap phases from the best placement, crib letters pinned in the matching
+  if (!found && placements > 0) {
+    struct SubsSearchBudget budget;
+    struct SubsSearch search;
+    initSubsSearchBudget(&budget, NULL);
+    prepareSubsSearch(&search, ciphertext, clen, &budget, &counts, best_key);
+    for (int p = 0; p < ALPHABET_SIZE; p++) {
+      if (best_pinned & (1u << p)) {
+        search.pinned |= 1u << search.self_slot[p];
+        search.matching[search.self_slot[p]].distance = 0.0;
+      }
+    }
+    runSubsPhases(&search);
+    char *keys[1] = {search.best_key};
+    decryptSubsBatch(ciphertext, clen, keys, 1, search.plaintexts, clen + 1);
+    if (confirmPlaintext(search.plaintexts, clen) >= PORTFOLIO_CONFIDENCE) {
+      memcpy(plaintext, search.plaintexts, (plen > clen) ? clen + 1 : clen);
+      strcpy(key, search.best_key);
+      found = ALPHABET_SIZE;
+    }
+    freeSubsSearch(&search);
+  }
+  return (found);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformCryptanalysisCrib
+// Description  : Cryptanalyzes a cipher knowing a probable plaintext fragment.
+//                Placements of the crib give the key directly (ROTX and
+//                Vigenere) or pin letters of the substitution search; if none
+//                checks out, the statistical analysis of the cipher is used.
+//
+// Inputs       : cipher - the cipher (a cs642Cipher)
+//                ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                crib - the probable plaintext fragment (spaces included)
+//                plaintext - the place to put the plaintext in
+//                plen - the length of the plaintext
+//                key - the place to put the key in (ROTX: the shift in key[0])
+// Outputs      : the length of the key, -1 if failure
+int cs642PerformCryptanalysisCrib(int cipher, char *ciphertext, int clen, const char *crib,
+                                  char *plaintext, int plen, char *key) {
+  if (cipher < CIPHER_ROTX || cipher > CIPHER_SUBS) {
+    return (-1);
+  }
+  int keylen = 0;
+  if (crib != NULL && cipher == CIPHER_SUBS) {
+    ensureNgramModel();
+    keylen = cribSubsSearch(ciphertext, clen, crib, plaintext, plen, key);
+  } else if (crib != NULL) {
+    keylen = cribShiftKey(cipher, ciphertext, clen, crib, plaintext, plen, key);
+    if (keylen > 0 && cipher == CIPHER_ROTX) {
+      key[0] -= 'A';
+    }
+  }
+  if (keylen != 0) {
+    return (keylen);
+  }
+
+  // No placement checked out: fall back on the statistics alone
+  if (cipher == CIPHER_ROTX) {
+    return (cs642PerformROTXCryptanalysis(ciphertext, clen, plaintext, plen, (uint8_t *)key) ? -1 : 1);
+  }
+  if (cipher == CIPHER_VIGE) {
+    return (cs642PerformVIGECryptanalysis(ciphertext, clen, plaintext, plen, key) ? -1 : (int)strlen(key));
+  }
+  return ((cs642PerformSUBSCryptanalysis(ciphertext, clen, plaintext, plen, key) < 0) ? -1 : ALPHABET_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CribSelfTest
+// Description  : Encrypts a known passage under each cipher and checks the
+//                crib placements (not the statistical fallback) recover it,
+//                writing into a plaintext buffer of exactly clen characters
+//
+// Inputs       : void
+// Outputs      : 0 if successful, -1 if failure
+int cs642CribSelfTest(void) {
+  static const char passage[] =
+      "ALICE WAS BEGINNING TO GET VERY TIRED OF SITTING BY HER SISTER ON THE BANK AND OF HAVING NOTHING TO DO "
+      "ONCE OR TWICE SHE HAD PEEPED INTO THE BOOK HER SISTER WAS READING BUT IT HAD NO PICTURES OR "
+      "CONVERSATIONS IN IT AND WHAT IS THE USE OF A BOOK THOUGHT ALICE WITHOUT PICTURES OR CONVERSATIONS SO "
+      "SHE WAS CONSIDERING IN HER OWN MIND AS WELL AS SHE COULD FOR THE HOT DAY MADE HER FEEL VERY SLEEPY AND "
+      "STUPID WHETHER THE PLEASURE OF MAKING A DAISY CHAIN WOULD BE WORTH THE TROUBLE OF GETTING UP AND "
+      "PICKING THE DAISIES";
+  static const char crib[] = "PEEPED INTO THE BOOK";
+  char rotx_key = 7, vige_key[] = "LANTERN", subs_key[] = "QWERTYUIOPASDFGHJKLZXCVBNM";
+  char *keys[CIPHER_UNK] = {&rotx_key, vige_key, subs_key};
+  int keylens[CIPHER_UNK] = {1, (int)strlen(vige_key), ALPHABET_SIZE};
+  int clen = (int)strlen(passage), failures = 0;
+
+  ensureNgramModel();
+  for (int cipher = CIPHER_ROTX; cipher <= CIPHER_SUBS; cipher++) {
+    char text[sizeof(passage)], ciphertext[sizeof(passage)], key[ALPHABET_SIZE + 1] = {0};
+    char *plaintext = malloc(clen); // No room for a terminator, as the driver and pipeline pass
+    if (plaintext == NULL) {
+      return (-1);
+    }
+    memcpy(text, passage, sizeof(passage)); // Encrypting works on the plaintext in place
+    cs642Encrypt(cipher, keys[cipher], keylens[cipher], text, clen, ciphertext, sizeof(ciphertext));
+    int keylen = (cipher == CIPHER_SUBS) ? cribSubsSearch(ciphertext, clen, crib, plaintext, clen, key)
+                                         : cribShiftKey(cipher, ciphertext, clen, crib, plaintext, clen, key);
+    if (keylen <= 0 || memcmp(plaintext, passage, clen)) {
+      logMessage(LOG_ERROR_LEVEL, "Crib self-test failed for cipher %d.", cipher);
+      failures++;
+    }
+    free(plaintext);
+  }
+  if (failures == 0) {
+    logMessage(LOG_OUTPUT_LEVEL, "Crib self-test passed.");
+  }
+  return (failures ? -1 : 0);
+}
+
+// Joins messages into one space separated text (NULL if it cannot be allocated).
+// The spaces keep n-grams and dictionary words from spanning two messages.
+char *joinMessages(char **messages, const int *lens, int count, int *total) {
+  *total = 0;
+  for (int i = 0; i < count; i++) {
+    *total += lens[i] + 1;
+  }
+  char *joined = malloc(*total + 1);
+  if (joined == NULL) {
+    return (NULL);
+  }
+  int offset = 0;
+  for (int i = 0; i < count; i++) {
+    memcpy(joined + offset, messages[i], lens[i]);
+    joined[offset + lens[i]] = ' ';
+    offset += lens[i] + 1;
+  }
+  joined[--(*total)] = '\0'; // Drop the trailing separator
+  return (joined);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformVIGECryptanalysisMulti
+// Description  : Cryptanalyzes several Vigenere messages encrypted under the
+//                same key. The column histograms of every message (aligned by
+//                message start) are pooled, each period is solved once, and
+//                the keys are scored on all the messages together.
+//
+// Inputs       : ciphertexts - the messages to analyze
+//                clens - the length of each message
+//                count - the number of messages
+//                plaintexts - the places to put the plaintexts in
+//                plens - the length of each plaintext
+//                key - the place to put the key in
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformVIGECryptanalysisMulti(char **ciphertexts, const int *clens, int count,
+                                       char **plaintexts, const int *plens, char *key) {
+  if (count < 1) {
+    return (-1);
+  }
+
+  // Pool the letter counts of every message
+  struct VigenereColumnTable table;
+  memset(&table, 0x00, sizeof(struct VigenereColumnTable));
+  for (int i = 0; i < count; i++) {
+    accumulateVigenereColumnTable(ciphertexts[i], clens[i], &table, 0); // Every message starts at the first key letter
+  }
+  int periods[VIGE_PERIODS];
+  rankVigenerePeriods(&table, periods);
+
+  // Score each period's key on the pooled decryption, keeping the best
+  int total = count - 1;
+  for (int i = 0; i < count; i++) {
+    total += clens[i];
+  }
+  char *joined = malloc(total + 1);
+  if (joined == NULL) {
+    return (-1);
+  }
+  const cs642Tuning *tuning = cs642GetTuning(total); // The band of the pooled length
+  int best_score = -1;
+  for (int attempt = 0; attempt < VIGE_PERIODS && best_score <= tuning->word_threshold; attempt++) {
+    char candidate[VIGE_MAX_PERIOD + 1];
+    if (periods[attempt] < tuning->vige_min_period || periods[attempt] > tuning->vige_max_period) {
+      continue;
+    }
+    deriveVigenereKey(&table, periods[attempt], candidate);
+
+    int offset = 0;
+    for (int i = 0; i < count; i++) {
+      cs642Decrypt(CIPHER_VIGE, candidate, periods[attempt], joined + offset, clens[i], ciphertexts[i], clens[i]);
+      offset += clens[i];
+      joined[offset++] = ' '; // Separate the messages
+    }
+    joined[total] = '\0';
+
+    int score = getNumberWordsFromDict(joined);
+    offerCandidate(candidate, periods[attempt], score, joined);
+    if (score > best_score) {
+      best_score = score;
+      strcpy(key, candidate);
+    }
+  }
+  free(joined);
+
+  // Decrypt every message with the key
+  for (int i = 0; i < count; i++) {
+    cs642Decrypt(CIPHER_VIGE, key, strlen(key), plaintexts[i], plens[i], ciphertexts[i], clens[i]);
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformSUBSCryptanalysisMulti
+// Description  : Cryptanalyzes several substitution messages encrypted under
+//                the same key. The messages are searched as one text, so the
+//                letter and n-gram counts and the dictionary scores are pooled,
+//                and the key found decrypts every message.
+//
+// Inputs       : ciphertexts - the messages to analyze
+//                clens - the length of each message
+//                count - the number of messages
+//                plaintexts - the places to put the plaintexts in
+//                plens - the length of each plaintext
+//                key - the place to put the key in
+// Outputs      : 0 if successful, -1 if failure
+int cs642PerformSUBSCryptanalysisMulti(char **ciphertexts, const int *clens, int count,
+                                       char **plaintexts, const int *plens, char *key) {
+  if (count < 1) {
+    return (-1);
+  }
+  int total;
+  char *joined = joinMessages(ciphertexts, clens, count, &total);
+  char *joined_plaintext = calloc(total + 1, 1);
+  if (joined == NULL || joined_plaintext == NULL) {
+    free(joined);
+    free(joined_plaintext);
+    return (-1);
+  }
+
+  struct SubsSearchBudget budget;
+  initSubsSearchBudget(&budget, NULL);
+  runSUBSCryptanalysis(joined, total, joined_plaintext, total, key, &budget, NULL);
+  free(joined);
+  free(joined_plaintext);
+
+  // Decrypt every message with the key
+  for (int i = 0; i < count; i++) {
+    cs642Decrypt(CIPHER_SUBS, key, ALPHABET_SIZE, plaintexts[i], plens[i], ciphertexts[i], clens[i]);
+  }
+  return (0);
+}
+
+// Struct to hold the running statistics of an online analysis session
+struct cs642Session {
+  int cipher;                               // Cipher of the session (a cs642Cipher)
+  char *text;                               // Ciphertext received so far (NUL-terminated)
+  int length;                               // Characters received
+  int capacity;                             // Bytes allocated for text
+  cs642TextCounts counts;                   // Running letter and n-gram counts
+  struct VigenereColumnTable columns;       // Running column histograms of every period
+  char key[ALPHABET_SIZE + 1];              // Best key so far
+  int keylen;                               // Length of the key (0 until the first refinement)
+  uint64_t random;                          // Annealing generator state (substitution)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CreateSession
+// Description  : Creates an online analysis session for a cipher
+//
+// Inputs       : cipher - the cipher (a cs642Cipher)
+// Outputs      : the session, or NULL if failure
+cs642Session *cs642CreateSession(int cipher) {
+  if (cipher < CIPHER_ROTX || cipher > CIPHER_SUBS) {
+    return (NULL);
+  }
+  cs642Session *session = calloc(1, sizeof(cs642Session));
+  if (session == NULL) {
+    return (NULL);
+  }
+  session->cipher = cipher;
+  session->random = FNV_OFFSET;
+  cs642InitTextCounts(&session->counts);
+  return (session);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642SessionAppend
+// Description  : Appends a chunk of ciphertext to a session, adding it to the
+//                running letter, n-gram and column counts (the cost depends
+//                only on the chunk)
+//
+// Inputs       : session - the session
+//                chunk - the ciphertext chunk
+//                len - the length of the chunk
+// Outputs      : 0 if successful, -1 if failure
+int cs642SessionAppend(cs642Session *session, const char *chunk, int len) {
+  if (len < 0) {
+    return (-1);
+  }
+
+  // Keep the text (doubling the buffer so appends stay amortized constant)
+  if (session->length + len + 1 > session->capacity) {
+    int capacity = (session->capacity > 0) ? session->capacity : CODE_BLOCK;
+    while (capacity < session->length + len + 1) {
+      capacity *= 2;
+    }
+    char *grown = realloc(session->text, capacity);
+    if (grown == NULL) {
+      return (-1);
+    }
+    session->text = grown;
+    session->capacity = capacity;
+  }
+  memcpy(session->text + session->length, chunk, len);
+
+  // Add the chunk to the running statistics, continuing from the previous chunk
+  if (cs642CountText(&session->counts, chunk, len, 0)) {
+    return (-1);
+  }
+  accumulateVigenereColumnTable(chunk, len, &session->columns, session->length);
+  session->length += len;
+  session->text[session->length] = '\0';
+  return (0);
+}
+
+// Derives the key of a Vigenere session: the periods of the tuning band by
+// descending index of coincidence, until the decryption of the most recent
+// SESSION_WINDOW characters is confirmed (else the most convincing one)
+static int refineSessionVigenere(cs642Session *session) {
+  const cs642Tuning *tuning = cs642GetTuning(session->length);
+  int start = (session->length > SESSION_WINDOW) ? session->length - SESSION_WINDOW : 0;
+  int len = session->length - start;
+  cs642Arena *arena = cs642ScratchArena();
+  char *decrypted;
+  if (cs642ArenaReserve(arena, len + 1) || (decrypted = cs642ArenaAlloc(arena, len + 1)) == NULL) {
+    return (-1);
+  }
+
+  int periods[VIGE_PERIODS], found = 0;
+  double best_confidence = -1.0;
+  rankVigenerePeriods(&session->columns, periods);
+  for (int attempt = 0; attempt < VIGE_PERIODS && !found; attempt++) {
+    int period = periods[attempt];
+    char candidate[VIGE_MAX_PERIOD + 1], rotated[VIGE_MAX_PERIOD + 1];
+    if (period < tuning->vige_min_period || period > tuning->vige_max_period) {
+      continue;
+    }
+    deriveVigenereKey(&session->columns, period, candidate);
+
+    // The window starts at column start % period of the key
+    for (int i = 0; i < period; i++) {
+      rotated[i] = candidate[(start + i) % period];
+    }
+    rotated[period] = '\0';
+    cs642Decrypt(CIPHER_VIGE, rotated, period, decrypted, len + 1, session->text + start, len);
+    double confidence = confirmPlaintext(decrypted, len);
+    found = getNumberWordsFromDict(decrypted) > tuning->word_threshold || confidence >= VIGE_CONFIRMATION;
+    if (found || confidence > best_confidence) {
+      memcpy(session->key, candidate, period + 1);
+      session->keylen = period;
+      best_confidence = confidence;
+    }
+  }
+  cs642ArenaReset(arena);
+  return ((session->keylen > 0) ? 0 : -1);
+}
+
+// Refines the key of a substitution session by annealing the trigram
+// likelihood of the running counts (the cost does not grow with the text),
+// starting cool from the previous key, or from the frequency matching and
+// random keys the first time
+static int refineSessionSubstitution(cs642Session *session, const cs642SubsBudget *limits) {
+  cs642AnnealSchedule schedule;
+  struct AnnealModel model;
+  resolveAnnealSchedule(NULL, &schedule);
+  ensureNgramModel();
+  if (buildAnnealModel(&session->counts, &model)) {
+    cs642ArenaReset(cs642ScratchArena());
+    return (-1);
+  }
+
+  int warm = (session->keylen > 0), runs = warm ? SESSION_WARM_RUNS : schedule.restarts;
+  long evaluations = 0;
+  long most = (limits != NULL && limits->max_evaluations > 0) ? limits->max_evaluations : LONG_MAX;
+  double best_score = -INFINITY;
+  uint8_t plain[ALPHABET_SIZE], best_plain[ALPHABET_SIZE];
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int run = 0; run < runs && evaluations < most; run++) {
+    cs642AnnealSchedule trial = schedule;
+    if (run == 0 && warm) {
+      for (int p = 0; p < ALPHABET_SIZE; p++) {
+        plain[session->key[p] - 'A'] = p;
+      }
+      trial.start_temperature = SESSION_WARM_TEMPERATURE;
+    } else if (run == 0) {
+      frequencyMatchedKey(session->counts.letters, plain);
+    } else {
+      for (int i = 0; i < ALPHABET_SIZE; i++) {
+        plain[i] = i;
+      }
+      for (int i = ALPHABET_SIZE - 1; i > 0; i--) {
+        int j = (int)(annealRandom(&session->random) % (i + 1));
+        uint8_t swap = plain[i];
+        plain[i] = plain[j];
+        plain[j] = swap;
+      }
+    }
+    if (trial.steps > most - evaluations) {
+      trial.steps = most - evaluations;
+    }
+    annealSUBSKey(&model, &trial, &session->random, NULL, 0, plain, &evaluations);
+    double score = annealScore(&model, plain);
+    if (score > best_score) {
+      best_score = score;
+      memcpy(best_plain, plain, ALPHABET_SIZE);
+    }
+    if (limits != NULL && limits->time_limit > 0 && elapsedSince(&start) >= limits->time_limit) {
+      break;
+    }
+  }
+  cs642ArenaReset(cs642ScratchArena());
+
+  for (int c = 0; c < ALPHABET_SIZE; c++) {
+    session->key[best_plain[c]] = c + 'A';
+  }
+  session->key[ALPHABET_SIZE] = '\0';
+  session->keylen = ALPHABET_SIZE;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642SessionRefine
+// Description  : Refines the key of a session from its running statistics.
+//                ROTX and VIGE keys are re-derived from the histograms (VIGE
+//                periods of the tuning band, confirmed on the most recent
+//                text). A substitution key is annealed from the previous one
+//                on the running trigram counts.
+//
+// Inputs       : session - the session
+//                limits - the budget of a substitution refinement (NULL = none)
+//                key - the place to put the key in (ROTX: the shift in key[0])
+//                plaintext - the place to put the whole plaintext in (or NULL)
+//                plen - the length of the plaintext buffer
+// Outputs      : the length of the key, -1 if failure
+int cs642SessionRefine(cs642Session *session, const cs642SubsBudget *limits, char *key,
+                       char *plaintext, int plen) {
+  if (session->length == 0) {
+    return (-1);
+  }
+
+  if (session->cipher == CIPHER_ROTX) {
+    // Best shift of the whole histogram by chi-squared
+    double observed_letter_frequencies[ALPHABET_SIZE];
+    uint32_t total = 0;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      total += session->counts.letters[i];
+    }
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      observed_letter_frequencies[i] = (total > 0) ? session->counts.letters[i] / (double)total : 0.0;
+    }
+    session->key[0] = findBestKey(observed_letter_frequencies, letter_frequencies);
+    session->keylen = 1;
+  } else if (session->cipher == CIPHER_VIGE) {
+    if (refineSessionVigenere(session)) {
+      return (-1);
+    }
+  } else if (refineSessionSubstitution(session, limits)) {
+    return (-1);
+  }
+
+  // Report the key and, if asked for, the plaintext of everything received
+  memcpy(key, session->key, session->keylen);
+  if (session->cipher != CIPHER_ROTX) {
+    key[session->keylen] = '\0';
+  }
+  if (plaintext != NULL) {
+    if (session->cipher == CIPHER_ROTX) {
+      char shift[2] = {session->key[0] + 'A', '\0'};
+      int period = 1;
+      char *keys[1] = {shift};
+      if (plen < session->length + 1) {
+        return (-1);
+      }
+      decryptShiftBatch(session->text, session->length, keys, &period, 1, plaintext, session->length + 1);
+    } else {
+      cs642Decrypt(session->cipher, session->key, session->keylen, plaintext, plen, session->text, session->length);
+    }
+  }
+  return (session->keylen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642DestroySession
+// Description  : Releases an online analysis session
+//
+// Inputs       : session - the session (may be NULL)
+// Outputs      : void
+void cs642DestroySession(cs642Session *session) {
+  if (session != NULL) {
+    free(session->text);
+    free(session);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PerformCryptanalysisTopK
+// Description  : Runs the analysis of a cipher once with a bounded heap
+//                collecting every key it scores, and returns the k best
+//                distinct keys (substitution ciphers use the swap search,
+//                whatever engine is configured)
+//
+// Inputs       : cipher - the cipher (a cs642Cipher)
+//                ciphertext - the ciphertext to analyze
+//                clen - the length of the ciphertext
+//                candidates - the place to put the candidates (k entries)
+//                k - the number of candidates wanted
+// Outputs      : the number of candidates filled, -1 if failure
+int cs642PerformCryptanalysisTopK(int cipher, char *ciphertext, int clen,
+                                  cs642Candidate *candidates, int k) {
+  if (k < 1 || cipher < CIPHER_ROTX || cipher > CIPHER_SUBS) {
+    return (-1);
+  }
+  char *plaintext = calloc(clen + 1, 1);
+  char key[CS642_CANDIDATE_KEY + 1] = {0};
+  if (plaintext == NULL) {
+    return (-1);
+  }
+
+  cs642CandidateHeap heap;
+  cs642InitCandidateHeap(&heap, candidates, k);
+  candidate_sink = &heap;
+  if (cipher == CIPHER_ROTX) {
+    cs642PerformROTXCryptanalysis(ciphertext, clen, plaintext, clen, (uint8_t *)key);
+  } else if (cipher == CIPHER_VIGE) {
+    cs642PerformVIGECryptanalysis(ciphertext, clen, plaintext, clen, key);
+  } else {
+    // Always the swap search: it scores every key on this thread, while the
+    // portfolio and annealing engines score on other threads or by n-grams
+    struct SubsSearchBudget budget;
+    initSubsSearchBudget(&budget, NULL);
+    runSUBSCryptanalysis(ciphertext, clen, plaintext, clen, key, &budget, NULL);
+  }
+  candidate_sink = NULL;
+
+  free(plaintext);
+  return (cs642SortCandidates(&heap));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642StudentCleanUp
+// Description  : This is a clean up function called at the end of the
+//                cryptanalysis of the different ciphers. Use it if you need to
+//                release memory you allocated in cs642StudentInit() for
+//                instance.
+//
+// Inputs       : void
+// Outputs      : 0 if successful, -1 if failure
 int cs642StudentCleanUp(void) {
 
-  // ADD CODE HERE IF NEEDED
+  // Release the model replicas and the dictionary copy
+  releaseModelReplicas();
+  free(dictionary.block);
+  memset(&dictionary, 0x00, sizeof(dictionary));
+  cs642DestroyTrie(word_trie);
+  word_trie = NULL;
+
+  // Release this thread's scratch arena
+  cs642ReleaseScratchArena();
 
   // Return successfully
   return (0);
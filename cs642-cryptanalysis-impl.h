@@ -9,6 +9,63 @@
 
 // Include Files
 
+// Defines
+#define CS642_CANDIDATE_KEY 26     // Longest candidate key (substitution)
+#define CS642_CANDIDATE_PREVIEW 64 // Plaintext characters kept per candidate
+
+//
+// Type definitions
+
+// Define struct and type for a ranked candidate key
+struct cs642Candidate {
+  char key[CS642_CANDIDATE_KEY + 1];         // Key (ROTX: 'A' + shift)
+  int keylen;                                // Length of the key
+  int score;                                 // Dictionary words found with the key
+  char preview[CS642_CANDIDATE_PREVIEW + 1]; // Start of the plaintext
+};
+typedef struct cs642Candidate cs642Candidate;
+
+// Define struct and type for the budget of an anytime substitution analysis
+struct cs642SubsBudget {
+  double time_limit;    // Wall-clock seconds before the search stops (0 = none)
+  long max_evaluations; // Key evaluations before the search stops (0 = none)
+};
+typedef struct cs642SubsBudget cs642SubsBudget;
+
+// Define struct and type for the outcome of an anytime substitution analysis
+struct cs642SubsResult {
+  int score;        // Dictionary words found with the returned key
+  long evaluations; // Key evaluations performed
+  long memo_hits;   // Revisited keys whose score came from the memo
+  int converged;    // 1 if every phase reached its own stop condition
+  double evaluations_per_second; // Key evaluations per second of search
+};
+typedef struct cs642SubsResult cs642SubsResult;
+
+// Define struct and type for the cooling schedule of the annealing engine.
+// Temperatures are in nats per 1000 ciphertext trigrams, so one schedule fits
+// texts of any length. Fields left 0 take their default.
+struct cs642AnnealSchedule {
+  double start_temperature; // Temperature of the first step
+  double end_temperature;   // Temperature of the last step (geometric cooling)
+  long steps;               // Key swaps proposed per restart
+  int restarts;             // Restarts at most (stops at the first confirmed key)
+  uint64_t seed;            // Generator seed (0 = seeded from the clock)
+};
+typedef struct cs642AnnealSchedule cs642AnnealSchedule;
+
+// Define type for an online analysis session (opaque)
+typedef struct cs642Session cs642Session;
+
+// Define struct and type for the breakdown of the language model build time
+struct cs642ModelTimings {
+  double dictionary_copy; // Seconds spent copying the dictionary
+  double letter_model;    // Seconds spent on the letter frequencies
+  double ngram_model;     // Seconds spent on the bigram/trigram tables (0 until first use)
+  double word_trie;       // Seconds spent on the segmenter's word trie (0 until first use)
+};
+typedef struct cs642ModelTimings cs642ModelTimings;
+
 //
 // Implementation functions
 
@@ -16,6 +73,10 @@ int cs642StudentInit(void);
 // This is a function that is called before any cryptanalysis occurs. Use it if
 // you need to initialize some datastructures you may be reusing across ciphers.
 
+int cs642GetModelTimings(cs642ModelTimings *timings);
+// This function reports where the language model construction time went. The
+// bigram/trigram tables are built lazily by the first substitution analysis.
+
 int cs642PerformROTXCryptanalysis(char *ciphertext, int clen, char *plaintext,
                                   int plen, uint8_t *key);
 // This is the function to cryptanalyze the ROT X cipher
@@ -28,6 +89,145 @@ int cs642PerformSUBSCryptanalysis(char *ciphertext, int clen, char *plaintext,
                                   int plen, char *key);
 // This is the function to cryptanalyze the substitution cipher
 
+int cs642PerformSUBSCryptanalysisBudget(char *ciphertext, int clen,
+                                        char *plaintext, int plen, char *key,
+                                        const cs642SubsBudget *limits,
+                                        cs642SubsResult *result);
+// This is the anytime variant of the substitution cryptanalysis. It stops once
+// the time or evaluation budget is spent, leaves the best key found so far in
+// key/plaintext, and returns 0 if the search converged or 1 if it was cut short.
+
+int cs642PerformSUBSCryptanalysisBeam(char *ciphertext, int clen,
+                                      char *plaintext, int plen, char *key,
+                                      int width);
+// This is a deterministic substitution cryptanalysis that grows partial keys
+// with a beam search (width states per letter, 0 = default) and refines the
+// best one with the bigram/trigram phases. Returns 0 if successful, -1 if not.
+
+int cs642ConfigureSUBSBeam(int width);
+// This function makes cs642PerformSUBSCryptanalysis use the beam search with
+// the given width (0 restores the swap search). Returns 0, or -1 if invalid.
+
+int cs642PerformSUBSCryptanalysisAnneal(char *ciphertext, int clen,
+                                        char *plaintext, int plen, char *key,
+                                        const cs642AnnealSchedule *schedule,
+                                        cs642SubsResult *result);
+// This is a substitution cryptanalysis by simulated annealing over key swaps
+// (schedule NULL = default), reporting its evaluations per second in result
+// (unless NULL). Returns 0 if successful, -1 if not.
+
+int cs642ConfigureSUBSAnneal(const cs642AnnealSchedule *schedule);
+// This function makes cs642PerformSUBSCryptanalysis anneal with the given
+// schedule (NULL restores the other engines). Returns 0, or -1 if invalid.
+
+int cs642PerformSUBSCryptanalysisPortfolio(char *ciphertext, int clen,
+                                           char *plaintext, int plen,
+                                           char *key, int engines);
+// This function races several substitution engines (0 = all of them) on
+// separate threads. The first key whose plaintext is confirmed by the
+// dictionary wins and cancels the others. Returns 0 if successful, -1 if not.
+
+int cs642ConfigureSUBSPortfolio(int engines);
+// This function makes cs642PerformSUBSCryptanalysis race this many engines
+// (0 restores the single engine). Returns 0, or -1 if invalid.
+
+int cs642PerformVIGECryptanalysisMulti(char **ciphertexts, const int *clens,
+                                       int count, char **plaintexts,
+                                       const int *plens, char *key);
+// This function cryptanalyzes several Vigenere messages encrypted under one key
+// (each starting at the first key letter), pooling their statistics, and
+// decrypts every message with the key found
+
+int cs642PerformSUBSCryptanalysisMulti(char **ciphertexts, const int *clens,
+                                       int count, char **plaintexts,
+                                       const int *plens, char *key);
+// This function cryptanalyzes several substitution messages encrypted under one
+// key, pooling their statistics, and decrypts every message with the key found
+
+cs642Session *cs642CreateSession(int cipher);
+// This function creates an online analysis session for a cipher (a cs642Cipher)
+// to which ciphertext can be appended as it arrives
+
+int cs642SessionAppend(cs642Session *session, const char *chunk, int len);
+// This function appends a ciphertext chunk to a session, updating its running
+// statistics at a cost proportional to the chunk
+
+int cs642SessionRefine(cs642Session *session, const cs642SubsBudget *limits,
+                       char *key, char *plaintext, int plen);
+// This function refines the session key from the running statistics, warm
+// starting substitution searches from the previous key (bounded by limits). It
+// puts the key in key (ROTX: the shift in key[0]) and, unless plaintext is
+// NULL, the plaintext of everything received. Returns the key length, or -1.
+
+void cs642DestroySession(cs642Session *session);
+// This function releases an online analysis session
+
+int cs642PerformCryptanalysisCrib(int cipher, char *ciphertext, int clen,
+                                  const char *crib, char *plaintext, int plen,
+                                  char *key);
+// This function cryptanalyzes a cipher (a cs642Cipher) knowing that crib, a
+// probable plaintext fragment (spaces included), occurs in the plaintext. The
+// crib is slid across the ciphertext: consistent placements give the ROTX or
+// Vigenere key directly and pin crib letters of the substitution search. If no
+// placement checks out (or crib is NULL) the statistics alone are used. Puts
+// the key in key (ROTX: the shift in key[0]) and returns its length, or -1.
+
+int cs642CribSelfTest(void);
+// This function checks the crib placements of every cipher recover a known
+// passage into a plaintext buffer of clen characters. The dictionary must be
+// loaded (cs642StudentInit). Returns 0 if successful, -1 if failure.
+
+int cs642PerformCryptanalysisTopK(int cipher, char *ciphertext, int clen,
+                                   cs642Candidate *candidates, int k);
+// This function runs the analysis of a cipher (a cs642Cipher) once and returns
+// the k best distinct keys it scored, by descending score, with a plaintext
+// preview of each. Substitution ciphers are always analyzed by the swap search
+// (the other engines do not score their keys by dictionary words on the
+// calling thread). Returns the number of candidates filled, -1 on failure.
+
+int cs642ConfigureSUBSCheckpoint(const char *prefix, double interval,
+                                 int resume);
+// This function sets up checkpointing of the substitution searches. Each search
+// saves its state to <prefix>.<ciphertext hash> every interval seconds and when
+// its budget runs out, and removes the file when it finishes. With resume set,
+// a search whose checkpoint exists continues from it. A NULL prefix disables it.
+
+int cs642ScoreSUBSKeys(char *ciphertext, int clen, char **keys, int count,
+                       int *scores);
+// This function scores several substitution keys (26 letters each) against a
+// ciphertext, decrypting a batch of keys per pass over the ciphertext.
+
+int cs642ScoreShiftKeys(char *ciphertext, int clen, char **keys,
+                        const int *keylens, int count, int *scores);
+// This function scores several ROTX (length 1) or Vigenere (length 6-11) keys,
+// written as letters 'A' + shift, in the same batched way.
+
+double cs642ScoreSegmentation(const char *text, int len, double cutoff,
+                              int *words, int *covered);
+// This function scores a text without spaces by its most likely split into
+// dictionary words (a Viterbi pass over a trie of the dictionary), putting the
+// number of words and of letters inside them in words and covered. Scoring may
+// stop once the text cannot reach cutoff (-INFINITY = never), in which case a
+// bound below cutoff is returned and the counts are zero. NAN on failure.
+
+int cs642AttachModelReplica(void);
+// This function makes the calling thread read the language model (dictionary
+// index and n-gram tables) from a replica on its own memory node, copying the
+// replica on this thread if it is the first of the node. Pin the thread first.
+// Returns the node, or -1 if failure (the shared model is used then).
+
+int cs642ConfigureModelReplicas(int mode);
+// This function sets when cs642AttachModelReplica replicates: -1 never, 0 on
+// hosts with several memory nodes (the default), 1 always.
+
+struct cs642TextCounts;
+void cs642AttachTextCounts(const char *ciphertext, int clen,
+                           const struct cs642TextCounts *counts);
+// This function hands the calling thread the letter and n-gram counts of a
+// ciphertext (see cs642-cryptanalysis-counts.h), made before its analysis. The
+// substitution analyses of that exact text (same pointer and length) copy
+// them instead of counting it again. Pass NULL counts to detach them.
+
 int cs642StudentCleanUp(void);
 // This is a clean up function called at the end of the cryptanalysis of the
 // different ciphers. Use it if you need to release  memory you allocated in
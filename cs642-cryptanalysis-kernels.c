@@ -0,0 +1,589 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-kernels.c
+//  Description    : These are the analysis kernels of the cs642 first project
+//                   (letter coding, histogramming, chi-squared and the batch
+//                   decrypts) in scalar, AVX2, AVX-512 and NEON variants. The
+//                   best variant the CPU supports is picked at startup, so one
+//                   binary runs at full speed on both x86_64 and aarch64.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Project Include Files
+#include "cs642-cryptanalysis-kernels.h"
+
+// Defines
+#define ALPHABET_SIZE CS642_KERNEL_ALPHABET
+#define LANE_GROUP 8 // Lanes whose tables are held in registers at once
+#define SELFTEST_LANES 11
+
+// Functions
+
+// Returns the letter code (0-25) of a character of either case
+static inline uint8_t letterCode(char c) {
+  uint8_t d = (uint8_t)(((uint8_t)c | 0x20) - 'a');
+  return (d < ALPHABET_SIZE) ? d : CS642_KERNEL_NONLETTER;
+}
+
+//
+// Scalar kernels (reference results for every other variant)
+
+static void scalarLetterCodes(const char *text, int len, uint8_t *codes) {
+  for (int i = 0; i < len; i++) {
+    codes[i] = letterCode(text[i]);
+  }
+}
+
+static void scalarHistogram(const char *text, int len, uint32_t counts[ALPHABET_SIZE]) {
+  for (int i = 0; i < len; i++) {
+    uint8_t code = letterCode(text[i]);
+    if (code < ALPHABET_SIZE) {
+      counts[code]++;
+    }
+  }
+}
+
+static double scalarChiSquared(const double *observed, const double *expected) {
+  double chiSquared = 0.0;
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    chiSquared += ((observed[i] - expected[i]) * (observed[i] - expected[i])) / expected[i];
+  }
+  return chiSquared;
+}
+
+// Streams the ciphertext once, writing every lane for each character
+static void scalarSubstitute(const char *ciphertext, int clen, const char (*tables)[ALPHABET_SIZE],
+                             int count, char *plaintexts, int stride) {
+  for (int i = 0; i < clen; i++) {
+    char c = ciphertext[i];
+    if (c >= 'A' && c <= 'Z') {
+      for (int k = 0; k < count; k++) {
+        plaintexts[k * stride + i] = tables[k][c - 'A'];
+      }
+    } else { // Preserve Spaces in Plaintext
+      for (int k = 0; k < count; k++) {
+        plaintexts[k * stride + i] = c;
+      }
+    }
+  }
+}
+
+static void scalarShift(const char *ciphertext, int clen, const uint8_t (*patterns)[CS642_SHIFT_PATTERN],
+                        const int *periods, int count, char *plaintexts, int stride) {
+  int columns[count];
+  memset(columns, 0x00, sizeof(columns));
+  for (int i = 0; i < clen; i++) {
+    char c = ciphertext[i];
+    for (int k = 0; k < count; k++) {
+      plaintexts[k * stride + i] = (c >= 'A' && c <= 'Z') ? (c - 'A' + patterns[k][columns[k]]) % ALPHABET_SIZE + 'A' : c;
+      if (++columns[k] == periods[k]) {
+        columns[k] = 0;
+      }
+    }
+  }
+}
+
+static const cs642Kernels scalar_kernels = {
+  "scalar", scalarLetterCodes, scalarHistogram, scalarChiSquared, scalarSubstitute, scalarShift
+};
+
+#if defined(__x86_64__)
+
+//
+// AVX2 kernels (32 characters per step)
+
+#define AVX2_TARGET __attribute__((target("avx2,popcnt")))
+
+AVX2_TARGET static void avx2LetterCodes(const char *text, int len, uint8_t *codes) {
+  const __m256i fold = _mm256_set1_epi8(0x20), base = _mm256_set1_epi8('a');
+  const __m256i last = _mm256_set1_epi8(ALPHABET_SIZE - 1), none = _mm256_set1_epi8((char)CS642_KERNEL_NONLETTER);
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i d = _mm256_sub_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i)), fold), base);
+    __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(d, last), d);
+    _mm256_storeu_si256((__m256i *)(codes + i), _mm256_blendv_epi8(none, d, letter));
+  }
+  scalarLetterCodes(text + i, len - i, codes + i);
+}
+
+AVX2_TARGET static void avx2Histogram(const char *text, int len, uint32_t counts[ALPHABET_SIZE]) {
+  const __m256i fold = _mm256_set1_epi8(0x20), base = _mm256_set1_epi8('a');
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    // Non-letters fold to codes outside 0-25, so they never compare equal
+    __m256i d = _mm256_sub_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i)), fold), base);
+    for (int l = 0; l < ALPHABET_SIZE; l++) {
+      counts[l] += _mm_popcnt_u32((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d, _mm256_set1_epi8(l))));
+    }
+  }
+  scalarHistogram(text + i, len - i, counts);
+}
+
+// The terms are computed four at a time but summed in order, as the scalar
+// kernel does, so the result is bit-identical
+AVX2_TARGET static double avx2ChiSquared(const double *observed, const double *expected) {
+  double terms[ALPHABET_SIZE];
+  int i = 0;
+  for (; i + 4 <= ALPHABET_SIZE; i += 4) {
+    __m256d e = _mm256_loadu_pd(expected + i);
+    __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(observed + i), e);
+    _mm256_storeu_pd(terms + i, _mm256_div_pd(_mm256_mul_pd(diff, diff), e));
+  }
+  for (; i < ALPHABET_SIZE; i++) {
+    terms[i] = ((observed[i] - expected[i]) * (observed[i] - expected[i])) / expected[i];
+  }
+  double chiSquared = 0.0;
+  for (i = 0; i < ALPHABET_SIZE; i++) {
+    chiSquared += terms[i];
+  }
+  return chiSquared;
+}
+
+// Looks up 26-entry tables with two 16-entry byte shuffles
+AVX2_TARGET static void avx2Substitute(const char *ciphertext, int clen, const char (*tables)[ALPHABET_SIZE],
+                                       int count, char *plaintexts, int stride) {
+  const __m256i base = _mm256_set1_epi8('A'), last = _mm256_set1_epi8(ALPHABET_SIZE - 1);
+  const __m256i fifteen = _mm256_set1_epi8(15), sixteen = _mm256_set1_epi8(16);
+  for (int first = 0; first < count; first += LANE_GROUP) {
+    int lanes = (count - first < LANE_GROUP) ? count - first : LANE_GROUP;
+    __m256i low[LANE_GROUP], high[LANE_GROUP];
+    for (int k = 0; k < lanes; k++) {
+      char padded[32] = {0};
+      memcpy(padded, tables[first + k], ALPHABET_SIZE);
+      low[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)padded));
+      high[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(padded + 16)));
+    }
+
+    int i = 0;
+    for (; i + 32 <= clen; i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(ciphertext + i));
+      __m256i d = _mm256_sub_epi8(v, base);
+      __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(d, last), d);
+      __m256i in_low = _mm256_cmpeq_epi8(_mm256_min_epu8(d, fifteen), d);
+      __m256i d_high = _mm256_sub_epi8(d, sixteen);
+      for (int k = 0; k < lanes; k++) {
+        __m256i r = _mm256_blendv_epi8(_mm256_shuffle_epi8(high[k], d_high), _mm256_shuffle_epi8(low[k], d), in_low);
+        _mm256_storeu_si256((__m256i *)(plaintexts + (first + k) * stride + i), _mm256_blendv_epi8(v, r, letter));
+      }
+    }
+    scalarSubstitute(ciphertext + i, clen - i, tables + first, lanes, plaintexts + first * stride + i, stride);
+  }
+}
+
+// Adds the pattern at the current column, then wraps with an unsigned min
+AVX2_TARGET static void avx2Shift(const char *ciphertext, int clen, const uint8_t (*patterns)[CS642_SHIFT_PATTERN],
+                                  const int *periods, int count, char *plaintexts, int stride) {
+  const __m256i base = _mm256_set1_epi8('A'), last = _mm256_set1_epi8(ALPHABET_SIZE - 1);
+  const __m256i wrap = _mm256_set1_epi8(ALPHABET_SIZE);
+  int i = 0;
+  for (; i + 32 <= clen; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(ciphertext + i));
+    __m256i d = _mm256_sub_epi8(v, base);
+    __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(d, last), d);
+    for (int k = 0; k < count; k++) {
+      __m256i s = _mm256_loadu_si256((const __m256i *)(patterns[k] + i % periods[k]));
+      __m256i t = _mm256_add_epi8(d, s);
+      __m256i r = _mm256_add_epi8(_mm256_min_epu8(t, _mm256_sub_epi8(t, wrap)), base);
+      _mm256_storeu_si256((__m256i *)(plaintexts + k * stride + i), _mm256_blendv_epi8(v, r, letter));
+    }
+  }
+
+  // Finish the tail with the patterns rotated to the current column
+  for (int k = 0; k < count; k++) {
+    scalarShift(ciphertext + i, clen - i, (const uint8_t (*)[CS642_SHIFT_PATTERN])(patterns[k] + i % periods[k]),
+                &periods[k], 1, plaintexts + k * stride + i, stride);
+  }
+}
+
+static const cs642Kernels avx2_kernels = {
+  "avx2", avx2LetterCodes, avx2Histogram, avx2ChiSquared, avx2Substitute, avx2Shift
+};
+
+//
+// AVX-512 kernels (64 characters per step, byte permutes from AVX512-VBMI)
+
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw,avx512vbmi,popcnt")))
+
+AVX512_TARGET static void avx512LetterCodes(const char *text, int len, uint8_t *codes) {
+  const __m512i fold = _mm512_set1_epi8(0x20), base = _mm512_set1_epi8('a');
+  const __m512i size = _mm512_set1_epi8(ALPHABET_SIZE), none = _mm512_set1_epi8((char)CS642_KERNEL_NONLETTER);
+  int i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i d = _mm512_sub_epi8(_mm512_or_si512(_mm512_loadu_si512(text + i), fold), base);
+    _mm512_storeu_si512(codes + i, _mm512_mask_blend_epi8(_mm512_cmplt_epu8_mask(d, size), none, d));
+  }
+  scalarLetterCodes(text + i, len - i, codes + i);
+}
+
+AVX512_TARGET static void avx512Histogram(const char *text, int len, uint32_t counts[ALPHABET_SIZE]) {
+  const __m512i fold = _mm512_set1_epi8(0x20), base = _mm512_set1_epi8('a');
+  int i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i d = _mm512_sub_epi8(_mm512_or_si512(_mm512_loadu_si512(text + i), fold), base);
+    for (int l = 0; l < ALPHABET_SIZE; l++) {
+      counts[l] += (uint32_t)_mm_popcnt_u64(_mm512_cmpeq_epi8_mask(d, _mm512_set1_epi8(l)));
+    }
+  }
+  scalarHistogram(text + i, len - i, counts);
+}
+
+AVX512_TARGET static double avx512ChiSquared(const double *observed, const double *expected) {
+  double terms[ALPHABET_SIZE];
+  int i = 0;
+  for (; i + 8 <= ALPHABET_SIZE; i += 8) {
+    __m512d e = _mm512_loadu_pd(expected + i);
+    __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(observed + i), e);
+    _mm512_storeu_pd(terms + i, _mm512_div_pd(_mm512_mul_pd(diff, diff), e));
+  }
+  for (; i < ALPHABET_SIZE; i++) {
+    terms[i] = ((observed[i] - expected[i]) * (observed[i] - expected[i])) / expected[i];
+  }
+  double chiSquared = 0.0;
+  for (i = 0; i < ALPHABET_SIZE; i++) {
+    chiSquared += terms[i];
+  }
+  return chiSquared;
+}
+
+AVX512_TARGET static void avx512Substitute(const char *ciphertext, int clen, const char (*tables)[ALPHABET_SIZE],
+                                           int count, char *plaintexts, int stride) {
+  const __m512i base = _mm512_set1_epi8('A'), size = _mm512_set1_epi8(ALPHABET_SIZE);
+  for (int first = 0; first < count; first += LANE_GROUP) {
+    int lanes = (count - first < LANE_GROUP) ? count - first : LANE_GROUP;
+    __m512i table[LANE_GROUP];
+    for (int k = 0; k < lanes; k++) {
+      char padded[64] = {0};
+      memcpy(padded, tables[first + k], ALPHABET_SIZE);
+      table[k] = _mm512_loadu_si512(padded);
+    }
+
+    int i = 0;
+    for (; i + 64 <= clen; i += 64) {
+      __m512i v = _mm512_loadu_si512(ciphertext + i);
+      __m512i d = _mm512_sub_epi8(v, base);
+      __mmask64 letter = _mm512_cmplt_epu8_mask(d, size);
+      for (int k = 0; k < lanes; k++) {
+        __m512i r = _mm512_permutexvar_epi8(d, table[k]);
+        _mm512_storeu_si512(plaintexts + (first + k) * stride + i, _mm512_mask_blend_epi8(letter, v, r));
+      }
+    }
+    scalarSubstitute(ciphertext + i, clen - i, tables + first, lanes, plaintexts + first * stride + i, stride);
+  }
+}
+
+AVX512_TARGET static void avx512Shift(const char *ciphertext, int clen, const uint8_t (*patterns)[CS642_SHIFT_PATTERN],
+                                      const int *periods, int count, char *plaintexts, int stride) {
+  const __m512i base = _mm512_set1_epi8('A'), size = _mm512_set1_epi8(ALPHABET_SIZE);
+  int i = 0;
+  for (; i + 64 <= clen; i += 64) {
+    __m512i v = _mm512_loadu_si512(ciphertext + i);
+    __m512i d = _mm512_sub_epi8(v, base);
+    __mmask64 letter = _mm512_cmplt_epu8_mask(d, size);
+    for (int k = 0; k < count; k++) {
+      __m512i t = _mm512_add_epi8(d, _mm512_loadu_si512(patterns[k] + i % periods[k]));
+      __m512i r = _mm512_add_epi8(_mm512_min_epu8(t, _mm512_sub_epi8(t, size)), base);
+      _mm512_storeu_si512(plaintexts + k * stride + i, _mm512_mask_blend_epi8(letter, v, r));
+    }
+  }
+  for (int k = 0; k < count; k++) {
+    scalarShift(ciphertext + i, clen - i, (const uint8_t (*)[CS642_SHIFT_PATTERN])(patterns[k] + i % periods[k]),
+                &periods[k], 1, plaintexts + k * stride + i, stride);
+  }
+}
+
+static const cs642Kernels avx512_kernels = {
+  "avx512", avx512LetterCodes, avx512Histogram, avx512ChiSquared, avx512Substitute, avx512Shift
+};
+
+#endif
+
+#if defined(__aarch64__)
+
+//
+// NEON kernels (16 characters per step; NEON is part of the AArch64 baseline)
+
+static void neonLetterCodes(const char *text, int len, uint8_t *codes) {
+  const uint8x16_t fold = vdupq_n_u8(0x20), base = vdupq_n_u8('a');
+  const uint8x16_t size = vdupq_n_u8(ALPHABET_SIZE), none = vdupq_n_u8(CS642_KERNEL_NONLETTER);
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t d = vsubq_u8(vorrq_u8(vld1q_u8((const uint8_t *)(text + i)), fold), base);
+    vst1q_u8(codes + i, vbslq_u8(vcltq_u8(d, size), d, none));
+  }
+  scalarLetterCodes(text + i, len - i, codes + i);
+}
+
+static void neonHistogram(const char *text, int len, uint32_t counts[ALPHABET_SIZE]) {
+  const uint8x16_t fold = vdupq_n_u8(0x20), base = vdupq_n_u8('a'), one = vdupq_n_u8(1);
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t d = vsubq_u8(vorrq_u8(vld1q_u8((const uint8_t *)(text + i)), fold), base);
+    for (int l = 0; l < ALPHABET_SIZE; l++) {
+      counts[l] += vaddvq_u8(vandq_u8(vceqq_u8(d, vdupq_n_u8(l)), one));
+    }
+  }
+  scalarHistogram(text + i, len - i, counts);
+}
+
+static double neonChiSquared(const double *observed, const double *expected) {
+  double terms[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; i += 2) {
+    float64x2_t e = vld1q_f64(expected + i);
+    float64x2_t diff = vsubq_f64(vld1q_f64(observed + i), e);
+    vst1q_f64(terms + i, vdivq_f64(vmulq_f64(diff, diff), e));
+  }
+  double chiSquared = 0.0;
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    chiSquared += terms[i];
+  }
+  return chiSquared;
+}
+
+// Looks up 26-entry tables with a two-register table lookup
+static void neonSubstitute(const char *ciphertext, int clen, const char (*tables)[ALPHABET_SIZE],
+                           int count, char *plaintexts, int stride) {
+  const uint8x16_t base = vdupq_n_u8('A'), size = vdupq_n_u8(ALPHABET_SIZE);
+  for (int first = 0; first < count; first += LANE_GROUP) {
+    int lanes = (count - first < LANE_GROUP) ? count - first : LANE_GROUP;
+    uint8x16x2_t table[LANE_GROUP];
+    for (int k = 0; k < lanes; k++) {
+      uint8_t padded[32] = {0};
+      memcpy(padded, tables[first + k], ALPHABET_SIZE);
+      table[k].val[0] = vld1q_u8(padded);
+      table[k].val[1] = vld1q_u8(padded + 16);
+    }
+
+    int i = 0;
+    for (; i + 16 <= clen; i += 16) {
+      uint8x16_t v = vld1q_u8((const uint8_t *)(ciphertext + i));
+      uint8x16_t d = vsubq_u8(v, base);
+      uint8x16_t letter = vcltq_u8(d, size);
+      for (int k = 0; k < lanes; k++) {
+        uint8x16_t r = vqtbl2q_u8(table[k], d);
+        vst1q_u8((uint8_t *)(plaintexts + (first + k) * stride + i), vbslq_u8(letter, r, v));
+      }
+    }
+    scalarSubstitute(ciphertext + i, clen - i, tables + first, lanes, plaintexts + first * stride + i, stride);
+  }
+}
+
+static void neonShift(const char *ciphertext, int clen, const uint8_t (*patterns)[CS642_SHIFT_PATTERN],
+                      const int *periods, int count, char *plaintexts, int stride) {
+  const uint8x16_t base = vdupq_n_u8('A'), size = vdupq_n_u8(ALPHABET_SIZE);
+  int i = 0;
+  for (; i + 16 <= clen; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(ciphertext + i));
+    uint8x16_t d = vsubq_u8(v, base);
+    uint8x16_t letter = vcltq_u8(d, size);
+    for (int k = 0; k < count; k++) {
+      uint8x16_t t = vaddq_u8(d, vld1q_u8(patterns[k] + i % periods[k]));
+      uint8x16_t r = vaddq_u8(vminq_u8(t, vsubq_u8(t, size)), base);
+      vst1q_u8((uint8_t *)(plaintexts + k * stride + i), vbslq_u8(letter, r, v));
+    }
+  }
+  for (int k = 0; k < count; k++) {
+    scalarShift(ciphertext + i, clen - i, (const uint8_t (*)[CS642_SHIFT_PATTERN])(patterns[k] + i % periods[k]),
+                &periods[k], 1, plaintexts + k * stride + i, stride);
+  }
+}
+
+static const cs642Kernels neon_kernels = {
+  "neon", neonLetterCodes, neonHistogram, neonChiSquared, neonSubstitute, neonShift
+};
+
+#endif
+
+//
+// Dispatch
+
+// Struct to pair a kernel variant with a check for CPU support
+struct KernelVariant {
+  const cs642Kernels *kernels; // The kernels
+  int (*supported)(void);      // Returns 1 if this CPU can run them
+};
+
+static int alwaysSupported(void) {
+  return 1;
+}
+
+#if defined(__x86_64__)
+static int avx2Supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+}
+
+static int avx512Supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("popcnt");
+}
+#endif
+
+// Variants from most to least preferred (scalar always last)
+static const struct KernelVariant kernel_variants[] = {
+#if defined(__x86_64__)
+  {&avx512_kernels, avx512Supported},
+  {&avx2_kernels, avx2Supported},
+#endif
+#if defined(__aarch64__)
+  {&neon_kernels, alwaysSupported},
+#endif
+  {&scalar_kernels, alwaysSupported},
+};
+#define KERNEL_VARIANTS ((int)(sizeof(kernel_variants) / sizeof(kernel_variants[0])))
+
+static const cs642Kernels *active_kernels = &scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// Picks the preferred supported variant, or the one named by CS642_KERNELS
+static void selectKernels(void) {
+  const char *forced = getenv("CS642_KERNELS");
+  for (int v = KERNEL_VARIANTS - 1; v >= 0; v--) {
+    if (kernel_variants[v].supported()) {
+      if (forced == NULL || strcmp(forced, kernel_variants[v].kernels->name) == 0) {
+        active_kernels = kernel_variants[v].kernels;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetKernels
+// Description  : Returns the kernels for this CPU, detecting the supported
+//                instruction sets the first time it is called
+//
+// Inputs       : void
+// Outputs      : the kernels
+const cs642Kernels *cs642GetKernels(void) {
+  pthread_once(&kernels_once, selectKernels);
+  return (active_kernels);
+}
+
+// Returns the next value of a xorshift generator (keeps rand() untouched)
+static uint32_t selfTestRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state);
+}
+
+// Compares one variant against the scalar kernels on a text of length len
+static int checkKernelVariant(const cs642Kernels *kernels, const char *text, int len, uint32_t *state) {
+  int stride = len + 1;
+  uint8_t codes[2][len + 1];
+  uint32_t counts[2][ALPHABET_SIZE];
+  char plaintexts[2][SELFTEST_LANES * stride];
+  char tables[SELFTEST_LANES][ALPHABET_SIZE];
+  uint8_t patterns[SELFTEST_LANES][CS642_SHIFT_PATTERN];
+  int periods[SELFTEST_LANES];
+  double observed[ALPHABET_SIZE], expected[ALPHABET_SIZE];
+
+  // Letter codes and histograms
+  scalar_kernels.letter_codes(text, len, codes[0]);
+  kernels->letter_codes(text, len, codes[1]);
+  memset(counts, 0x00, sizeof(counts));
+  scalar_kernels.histogram(text, len, counts[0]);
+  kernels->histogram(text, len, counts[1]);
+  if (memcmp(codes[0], codes[1], len) || memcmp(counts[0], counts[1], sizeof(counts[0]))) {
+    return (-1);
+  }
+
+  // Chi-squared must match to the last bit
+  for (int i = 0; i < ALPHABET_SIZE; i++) {
+    observed[i] = selfTestRandom(state) / 4294967296.0;
+    expected[i] = (selfTestRandom(state) + 1) / 4294967296.0;
+  }
+  double chi[2] = {scalar_kernels.chi_squared(observed, expected), kernels->chi_squared(observed, expected)};
+  if (memcmp(&chi[0], &chi[1], sizeof(double))) {
+    return (-1);
+  }
+
+  // Substitution tables (random permutations) and shift patterns (all periods)
+  for (int k = 0; k < SELFTEST_LANES; k++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+      tables[k][i] = 'A' + i;
+    }
+    for (int i = ALPHABET_SIZE - 1; i > 0; i--) {
+      int j = selfTestRandom(state) % (i + 1);
+      char temp = tables[k][i];
+      tables[k][i] = tables[k][j];
+      tables[k][j] = temp;
+    }
+    periods[k] = k + 1;
+    for (int j = 0; j < periods[k]; j++) {
+      patterns[k][j] = selfTestRandom(state) % (ALPHABET_SIZE + 1);
+    }
+    for (int j = periods[k]; j < CS642_SHIFT_PATTERN; j++) {
+      patterns[k][j] = patterns[k][j % periods[k]];
+    }
+  }
+  memset(plaintexts, 0x00, sizeof(plaintexts));
+  scalar_kernels.substitute(text, len, tables, SELFTEST_LANES, plaintexts[0], stride);
+  kernels->substitute(text, len, tables, SELFTEST_LANES, plaintexts[1], stride);
+  if (memcmp(plaintexts[0], plaintexts[1], sizeof(plaintexts[0]))) {
+    return (-1);
+  }
+  scalar_kernels.shift(text, len, patterns, periods, SELFTEST_LANES, plaintexts[0], stride);
+  kernels->shift(text, len, patterns, periods, SELFTEST_LANES, plaintexts[1], stride);
+  if (memcmp(plaintexts[0], plaintexts[1], sizeof(plaintexts[0]))) {
+    return (-1);
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642KernelSelfTest
+// Description  : Runs every variant this CPU supports on the same inputs as the
+//                scalar kernels (lengths around each vector width, mixed case,
+//                spaces, punctuation and high bytes) and checks the results
+//                are bit-identical
+//
+// Inputs       : void
+// Outputs      : 0 if successful, -1 if failure
+int cs642KernelSelfTest(void) {
+  static const int lengths[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 1000, 5003};
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz   .,'@[`{\x80\xc1\xfa";
+  uint32_t state = 0x2545F491;
+  int failures = 0;
+
+  for (int v = 0; v < KERNEL_VARIANTS; v++) {
+    if (!kernel_variants[v].supported() || kernel_variants[v].kernels == &scalar_kernels) {
+      continue;
+    }
+    int passed = 1;
+    for (int l = 0; l < (int)(sizeof(lengths) / sizeof(lengths[0])) && passed; l++) {
+      char text[lengths[l] + 1];
+      for (int i = 0; i < lengths[l]; i++) {
+        text[i] = alphabet[selfTestRandom(&state) % (sizeof(alphabet) - 1)];
+      }
+      text[lengths[l]] = '\0';
+      if (checkKernelVariant(kernel_variants[v].kernels, text, lengths[l], &state)) {
+        logMessage(LOG_ERROR_LEVEL, "Kernel self-test failed for %s (length %d).",
+                   kernel_variants[v].kernels->name, lengths[l]);
+        passed = 0;
+        failures++;
+      }
+    }
+    if (passed) {
+      logMessage(LOG_OUTPUT_LEVEL, "Kernel self-test passed for %s.", kernel_variants[v].kernels->name);
+    }
+  }
+  return (failures ? -1 : 0);
+}
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-kernels.h
+//  Description    : This is an include file for the analysis kernels and the
+//                   runtime dispatch that picks the best variant (scalar,
+//                   AVX2, AVX-512 or NEON) for the CPU the binary runs on.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+// Defines
+#define CS642_KERNEL_ALPHABET 26
+#define CS642_KERNEL_NONLETTER 0xFF // Letter code of anything but A-Z/a-z
+#define CS642_SHIFT_PATTERN 128     // Bytes in a repeated shift pattern (>= period + 64)
+
+//
+// Type definitions
+
+// Define struct and type for a set of analysis kernels
+struct cs642Kernels {
+  const char *name; // Name of the variant ("scalar", "avx2", "avx512", "neon")
+
+  void (*letter_codes)(const char *text, int len, uint8_t *codes);
+  // Writes 0-25 for each letter (either case) and CS642_KERNEL_NONLETTER
+  // for anything else
+
+  void (*histogram)(const char *text, int len, uint32_t counts[CS642_KERNEL_ALPHABET]);
+  // Adds the letter counts (either case) of text to counts
+
+  double (*chi_squared)(const double *observed, const double *expected);
+  // Returns the chi-squared statistic of 26 observed/expected frequencies
+
+  void (*substitute)(const char *ciphertext, int clen,
+                     const char (*tables)[CS642_KERNEL_ALPHABET], int count,
+                     char *plaintexts, int stride);
+  // Maps every A-Z of ciphertext through each of count tables, writing
+  // plaintext k at plaintexts + k * stride (other characters are copied)
+
+  void (*shift)(const char *ciphertext, int clen,
+                const uint8_t (*patterns)[CS642_SHIFT_PATTERN],
+                const int *periods, int count, char *plaintexts, int stride);
+  // Adds the repeated shift pattern k (shifts 0-26, period periods[k]) to
+  // every A-Z of ciphertext, writing plaintext k at plaintexts + k * stride
+};
+typedef struct cs642Kernels cs642Kernels;
+
+// There is no n-gram scoring kernel: the bigram/trigram log-likelihood sums
+// look up each n-gram through the key being scored, and the variants must add
+// the terms in order to stay bit-identical, so a vector gather saves nothing
+// over the scalar loops of the engines.
+
+//
+// Kernel functions
+
+const cs642Kernels *cs642GetKernels(void);
+// Returns the best kernels for this CPU, detected once. The CS642_KERNELS
+// environment variable can force a variant by name.
+
+int cs642KernelSelfTest(void);
+// Checks that every variant supported by this CPU gives bit-identical results
+// to the scalar kernels. Returns 0 if they all agree, -1 otherwise.
@@ -0,0 +1,472 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-pipeline.c
+//  Description    : This is the staged driver pipeline for the cs642 first
+//                   project. One stage acquires ciphertext samples and prepares
+//                   pooled buffers for them, a set of workers performs the
+//                   cryptanalysis, and a final stage verifies and logs the
+//                   results in test order. The stages are connected by bounded
+//                   queues so acquisition and verification overlap analysis.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-counts.h"
+#include "cs642-cryptanalysis-impl.h"
+#include "cs642-cryptanalysis-pipeline.h"
+#include "cs642-cryptanalysis-profile.h"
+#include "cs642-cryptanalysis-support.h"
+#include "cs642-cryptanalysis-topology.h"
+
+// Defines
+#define PIPELINE_MAX_WORKERS 64
+#define PIPELINE_EXTRA_SLOTS 2 // Pooled jobs beyond one per worker
+
+// Serializes every access to the support library's sample state (the
+// expected answer of the last sample, which each job carries and puts back
+// just before it is checked)
+static pthread_mutex_t sample_state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Struct to represent a single ciphertext test moving through the pipeline
+struct PipelineJob {
+  cs642Cipher cipher;      // Cipher of the sample
+  int test_index;          // Index of the test for this cipher
+  int sequence;            // Global order in which the job was acquired
+  char *ciphertext;        // Sample from the support library (owned by the job)
+  int clen;                // Length of the ciphertext
+  char *plaintext;         // Pooled plaintext buffer
+  int plaintext_size;      // Capacity of the pooled plaintext buffer
+  char *key;               // Pooled key buffer
+  int key_size;            // Capacity of the pooled key buffer
+  int keylen;              // Key length for the cipher
+  cs642TextCounts *counts; // Pooled counts of the ciphertext (substitution)
+  char *expected_key;      // Library answer key for the sample
+  int expected_keylen;     // Length of the answer key
+  char *expected_text;     // Library answer plaintext for the sample
+  int expected_text_len;   // Length of the answer plaintext
+  cs642Profile profile;    // Counters of the analysis (profiling mode)
+};
+
+// Struct to represent a bounded FIFO queue of jobs
+struct PipelineQueue {
+  struct PipelineJob **slots; // Ring buffer of queued jobs
+  int capacity;               // Maximum number of queued jobs
+  int head;                   // Index of the next job to pop
+  int count;                  // Number of queued jobs
+  int closed;                 // No more jobs will be pushed
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+// Struct to hold the state shared by all stages
+struct Pipeline {
+  int tests;                      // Tests per cipher
+  int workers;                    // Analysis workers
+  int total_jobs;                 // Tests across all ciphers
+  struct PipelineJob *jobs;       // Backing storage of the job pool
+  struct PipelineQueue free_jobs; // Pool of reusable jobs
+  struct PipelineQueue analyze;   // Jobs waiting for cryptanalysis
+  struct PipelineQueue verify;    // Jobs waiting for verification
+};
+
+// Struct to represent the arguments of an analysis worker
+struct PipelineWorker {
+  struct Pipeline *pipeline; // The pipeline
+  int index;                 // Position of the worker (picks its CPU)
+};
+
+// Functions
+
+// Initializes a queue able to hold capacity jobs
+static int initPipelineQueue(struct PipelineQueue *queue, int capacity) {
+  queue->slots = malloc(sizeof(struct PipelineJob *) * capacity);
+  if (queue->slots == NULL) {
+    return -1;
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->closed = 0;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return 0;
+}
+
+// Releases the resources of a queue (nothing if it was never initialized)
+static void destroyPipelineQueue(struct PipelineQueue *queue) {
+  if (queue->slots == NULL) {
+    return;
+  }
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+// Pushes a job, blocking while the queue is full
+static void pushPipelineJob(struct PipelineQueue *queue, struct PipelineJob *job) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == queue->capacity) {
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  }
+  queue->slots[(queue->head + queue->count) % queue->capacity] = job;
+  queue->count++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Pops a job, blocking while the queue is empty; NULL once closed and drained
+static struct PipelineJob *popPipelineJob(struct PipelineQueue *queue) {
+  struct PipelineJob *job = NULL;
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  if (queue->count > 0) {
+    job = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return job;
+}
+
+// Marks a queue as closed and wakes every waiting consumer
+static void closePipelineQueue(struct PipelineQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Grows a pooled buffer to at least size bytes (buffers are never shrunk)
+static int reservePipelineBuffer(char **buffer, int *capacity, int size) {
+  if (*capacity < size) {
+    char *grown = realloc(*buffer, size);
+    if (grown == NULL) {
+      return -1;
+    }
+    *buffer = grown;
+    *capacity = size;
+  }
+  memset(*buffer, 0x00, size);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : acquireStage
+// Description  : Fetches the ciphertext samples in test order, prepares a
+//                pooled job for each (counting the letters and n-grams of
+//                substitution samples ahead of their analysis) and hands it to
+//                the analysis workers.
+//
+// Inputs       : arg - the pipeline
+// Outputs      : NULL
+
+static void *acquireStage(void *arg) {
+  struct Pipeline *pipeline = arg;
+  int sequence = 0;
+
+  for (cs642Cipher cipher = CIPHER_ROTX; cipher < CIPHER_UNK; cipher++) {
+    for (int i = 0; i < pipeline->tests; i++) {
+      // Borrow a job from the pool (blocks while every job is in flight)
+      struct PipelineJob *job = popPipelineJob(&pipeline->free_jobs);
+
+      // Get the ciphertext and size the pooled buffers for it
+      job->cipher = cipher;
+      job->test_index = i;
+      job->sequence = sequence++;
+      pthread_mutex_lock(&sample_state_lock);
+      job->ciphertext = cs642GetCiphertextSample(cipher);
+      job->expected_key = cs642TestKey;
+      job->expected_keylen = cs642TestKeylen;
+      job->expected_text = cs642TestPlainText;
+      job->expected_text_len = cs642TestPlainTextLen;
+      pthread_mutex_unlock(&sample_state_lock);
+      job->clen = strlen(job->ciphertext);
+      job->keylen = cs642GetCipherKeyLength(cipher);
+      if (reservePipelineBuffer(&job->plaintext, &job->plaintext_size,
+                                job->clen + 1) ||
+          reservePipelineBuffer(&job->key, &job->key_size, job->keylen + 1)) {
+        logMessage(LOG_ERROR_LEVEL, "Pipeline buffer allocation failed.");
+        exit(-1);
+      }
+
+      // Pre-encode substitution samples into their letter and n-gram counts
+      // (one thread here, the CPUs belong to the analysis workers)
+      if (cipher == CIPHER_SUBS) {
+        if (job->counts == NULL &&
+            (job->counts = malloc(sizeof(cs642TextCounts))) == NULL) {
+          logMessage(LOG_ERROR_LEVEL, "Pipeline buffer allocation failed.");
+          exit(-1);
+        }
+        cs642InitTextCounts(job->counts);
+        if (cs642CountText(job->counts, job->ciphertext, job->clen, 1)) {
+          logMessage(LOG_ERROR_LEVEL, "Pipeline ciphertext counting failed.");
+          exit(-1);
+        }
+      }
+      pushPipelineJob(&pipeline->analyze, job);
+    }
+  }
+  closePipelineQueue(&pipeline->analyze);
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : analyzeStage
+// Description  : Worker that performs the cryptanalysis of queued jobs. It is
+//                pinned by its index first, then reads the language model from
+//                the replica of its memory node.
+//
+// Inputs       : arg - the worker
+// Outputs      : NULL
+
+static void *analyzeStage(void *arg) {
+  struct PipelineWorker *worker = arg;
+  struct Pipeline *pipeline = worker->pipeline;
+  struct PipelineJob *job;
+
+  int node = cs642PinThread(worker->index, pipeline->workers);
+  if (node < 0) {
+    logMessage(LOG_WARNING_LEVEL, "Unable to pin pipeline worker %d.", worker->index);
+  }
+  cs642AttachModelReplica();
+
+  while ((job = popPipelineJob(&pipeline->analyze)) != NULL) {
+    memset(&job->profile, 0x00, sizeof(job->profile));
+    cs642ProfileAttach(&job->profile);
+    switch (job->cipher) {
+    case CIPHER_ROTX:
+      cs642ProfileBegin(CS642_PROFILE_ROTX);
+      cs642PerformROTXCryptanalysis(job->ciphertext, job->clen, job->plaintext,
+                                    job->clen, (uint8_t *)job->key);
+      cs642ProfileEnd(CS642_PROFILE_ROTX);
+      break;
+    case CIPHER_VIGE:
+      cs642ProfileBegin(CS642_PROFILE_VIGE);
+      cs642PerformVIGECryptanalysis(job->ciphertext, job->clen, job->plaintext,
+                                    job->clen, job->key);
+      cs642ProfileEnd(CS642_PROFILE_VIGE);
+      break;
+    case CIPHER_SUBS:
+      cs642ProfileBegin(CS642_PROFILE_SUBS);
+      cs642AttachTextCounts(job->ciphertext, job->clen, job->counts);
+      cs642PerformSUBSCryptanalysis(job->ciphertext, job->clen, job->plaintext,
+                                    job->clen, job->key);
+      cs642AttachTextCounts(NULL, 0, NULL);
+      cs642ProfileEnd(CS642_PROFILE_SUBS);
+      break;
+    default:
+      logMessage(LOG_ERROR_LEVEL, "Unknown cipher (%d) in cryptanalysis.",
+                 job->cipher);
+      break;
+    }
+    cs642ProfileAttach(NULL);
+    pushPipelineJob(&pipeline->verify, job);
+  }
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : verifyStage
+// Description  : Checks the analyzed jobs in acquisition order, logs the
+//                results and returns the jobs to the pool.
+//
+// Inputs       : pipeline - the pipeline
+// Outputs      : 0 if every test succeeded (exits the program on failure)
+
+static int verifyStage(struct Pipeline *pipeline) {
+  struct PipelineJob **pending = calloc(pipeline->total_jobs,
+                                        sizeof(struct PipelineJob *));
+  if (pending == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Pipeline reorder buffer allocation failed.");
+    exit(-1);
+  }
+
+  int next = 0;
+  while (next < pipeline->total_jobs) {
+    // Hold results that finish early until their predecessors are verified
+    while (pending[next] == NULL) {
+      struct PipelineJob *done = popPipelineJob(&pipeline->verify);
+      pending[done->sequence] = done;
+    }
+    struct PipelineJob *job = pending[next];
+    pending[next] = NULL;
+
+    // Now check result against the answer captured with the sample
+    pthread_mutex_lock(&sample_state_lock);
+    cs642TestKey = job->expected_key;
+    cs642TestKeylen = job->expected_keylen;
+    cs642TestPlainText = job->expected_text;
+    cs642TestPlainTextLen = job->expected_text_len;
+    int failed = cs642CheckPlaintext(job->cipher, job->plaintext,
+                                     job->ciphertext, job->key);
+    cs642TestKey = NULL;
+    cs642TestPlainText = NULL;
+    pthread_mutex_unlock(&sample_state_lock);
+    job->expected_key = NULL;
+    job->expected_text = NULL;
+
+    if (failed) {
+      logMessage(
+          LOG_ERROR_LEVEL,
+          "Cryptanalysis %d/%d failed for cipher (%s), aborting program.",
+          job->test_index + 1, pipeline->tests,
+          cs642CipherStrings[job->cipher]);
+      exit(-1);
+    } else {
+      logMessage(LOG_OUTPUT_LEVEL,
+                 "Cryptanalysis %d/%d succeeded for cipher (%s).",
+                 job->test_index + 1, pipeline->tests,
+                 cs642CipherStrings[job->cipher]);
+    }
+    if (cs642ProfilingEnabled()) {
+      char label[64];
+      snprintf(label, sizeof(label), "%s %d/%d (%d chars)",
+               cs642CipherStrings[job->cipher], job->test_index + 1,
+               pipeline->tests, job->clen);
+      cs642LogProfile(label, &job->profile);
+    }
+
+    // Release the sample and recycle the job
+    free(job->ciphertext);
+    job->ciphertext = NULL;
+    pushPipelineJob(&pipeline->free_jobs, job);
+    next++;
+  }
+
+  free(pending);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642DefaultPipelineWorkers
+// Description  : Returns the default number of analysis workers
+//
+// Inputs       : void
+// Outputs      : the number of online CPUs (at least 1)
+
+int cs642DefaultPipelineWorkers(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    return 1;
+  }
+  return (cpus > PIPELINE_MAX_WORKERS) ? PIPELINE_MAX_WORKERS : (int)cpus;
+}
+
+// Releases the job pool and the queues (any of them may be missing)
+static void destroyPipeline(struct Pipeline *pipeline, int pool_size) {
+  if (pipeline->jobs != NULL) {
+    for (int i = 0; i < pool_size; i++) {
+      free(pipeline->jobs[i].plaintext);
+      free(pipeline->jobs[i].key);
+      free(pipeline->jobs[i].counts);
+    }
+    free(pipeline->jobs);
+    pipeline->jobs = NULL;
+  }
+  destroyPipelineQueue(&pipeline->free_jobs);
+  destroyPipelineQueue(&pipeline->analyze);
+  destroyPipelineQueue(&pipeline->verify);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642RunCryptanalysisPipeline
+// Description  : Runs the cryptanalysis tests for every cipher through the
+//                acquire -> analyze -> verify pipeline
+//
+// Inputs       : workers - the number of analysis workers
+//                tests - the number of tests per cipher
+// Outputs      : 0 if successful, -1 if failure
+
+int cs642RunCryptanalysisPipeline(int workers, int tests) {
+  struct Pipeline pipeline = {0};
+  pthread_t acquirer, analyzers[PIPELINE_MAX_WORKERS];
+  struct PipelineWorker worker_args[PIPELINE_MAX_WORKERS];
+  int pool_size, started = 0, result = 0;
+
+  // Clamp the worker count and size the job pool from it
+  if (workers < 1) {
+    workers = 1;
+  } else if (workers > PIPELINE_MAX_WORKERS) {
+    workers = PIPELINE_MAX_WORKERS;
+  }
+  pool_size = workers + PIPELINE_EXTRA_SLOTS;
+
+  pipeline.tests = tests;
+  pipeline.workers = workers;
+  pipeline.total_jobs = tests * CIPHER_UNK;
+  pipeline.jobs = calloc(pool_size, sizeof(struct PipelineJob));
+  if (pipeline.jobs == NULL ||
+      initPipelineQueue(&pipeline.free_jobs, pool_size) ||
+      initPipelineQueue(&pipeline.analyze, pool_size) ||
+      initPipelineQueue(&pipeline.verify, pool_size)) {
+    logMessage(LOG_ERROR_LEVEL, "Pipeline allocation failed.");
+    destroyPipeline(&pipeline, pool_size);
+    return (-1);
+  }
+  for (int i = 0; i < pool_size; i++) {
+    pushPipelineJob(&pipeline.free_jobs, &pipeline.jobs[i]);
+  }
+  logMessage(LOG_INFO_LEVEL, "Pipeline running with %d analysis workers.",
+             workers);
+
+  // Start the analysis stage first, so a failure leaves no samples in flight
+  for (started = 0; started < workers; started++) {
+    worker_args[started] = (struct PipelineWorker){&pipeline, started};
+    if (pthread_create(&analyzers[started], NULL, analyzeStage, &worker_args[started])) {
+      logMessage(LOG_WARNING_LEVEL,
+                 "Unable to start pipeline worker %d, continuing with %d.",
+                 started, started);
+      break;
+    }
+  }
+  if (started == 0) {
+    logMessage(LOG_ERROR_LEVEL, "No pipeline analysis workers started.");
+    destroyPipeline(&pipeline, pool_size);
+    return (-1);
+  }
+
+  // Then the acquisition stage (the idle workers are released on failure)
+  if (pthread_create(&acquirer, NULL, acquireStage, &pipeline)) {
+    logMessage(LOG_ERROR_LEVEL, "Unable to start pipeline acquisition stage.");
+    closePipelineQueue(&pipeline.analyze);
+    for (int i = 0; i < started; i++) {
+      pthread_join(analyzers[i], NULL);
+    }
+    destroyPipeline(&pipeline, pool_size);
+    return (-1);
+  }
+
+  // Verify on the calling thread, then wait for the stages to drain
+  result = verifyStage(&pipeline);
+  pthread_join(acquirer, NULL);
+  for (int i = 0; i < started; i++) {
+    pthread_join(analyzers[i], NULL);
+  }
+
+  // Clean up the pooled buffers
+  destroyPipeline(&pipeline, pool_size);
+
+  return (result);
+}
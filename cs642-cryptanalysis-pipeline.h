@@ -0,0 +1,24 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-pipeline.h
+//  Description    : This is an include file for the staged driver pipeline
+//                   that overlaps sample acquisition, cryptanalysis and
+//                   verification of the ciphertext tests.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+//
+// Pipeline functions
+
+int cs642RunCryptanalysisPipeline(int workers, int tests);
+// Runs the cryptanalysis tests for every cipher through an acquire -> analyze
+// -> verify pipeline with the given number of analysis workers. Returns 0 if
+// every test succeeded, -1 otherwise.
+
+int cs642DefaultPipelineWorkers(void);
+// Returns the default number of analysis workers (online CPUs)
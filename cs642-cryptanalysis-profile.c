@@ -0,0 +1,307 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-profile.c
+//  Description    : This is the profiling mode of the cs642 first project. It
+//                   opens one set of hardware performance counters per thread
+//                   (Linux perf_event_open) and charges the events counted
+//                   between the begin and end of a region to the ciphertext
+//                   being analyzed and to the run totals. Counters the kernel
+//                   refuses (containers, paranoid settings) are skipped and
+//                   reported as unavailable; wall-clock time always works.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Project Include Files
+#include "cs642-cryptanalysis-profile.h"
+
+// Struct to describe a hardware event
+struct ProfileEvent {
+  const char *name; // Name used in the report
+  uint32_t type;    // perf_event_attr type
+  uint64_t config;  // perf_event_attr config
+};
+
+// Struct to hold the counters and open regions of a thread
+struct ThreadCounters {
+  int fds[CS642_PROFILE_EVENTS];                                  // Counter of each event (-1 = unavailable)
+  struct timespec started[CS642_PROFILE_REGIONS];                 // When each open region began
+  uint64_t values[CS642_PROFILE_REGIONS][CS642_PROFILE_EVENTS];   // Counter values when it began
+  cs642Profile *attached;                                         // Profile of the current ciphertext
+};
+
+#if defined(__linux__)
+static const struct ProfileEvent profile_events[CS642_PROFILE_EVENTS] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"L1D misses", PERF_TYPE_HW_CACHE,
+   PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+#else
+static const struct ProfileEvent profile_events[CS642_PROFILE_EVENTS] = {
+  {"cycles", 0, 0}, {"instructions", 0, 0}, {"L1D misses", 0, 0}, {"LLC misses", 0, 0}, {"branch misses", 0, 0},
+};
+#endif
+
+static const char *profile_region_names[CS642_PROFILE_REGIONS] = {
+  "ROTX", "VIGE", "SUBS", "SUBS monogram", "SUBS bigram", "SUBS trigram", "SUBS beam", "SUBS anneal",
+};
+
+static int profiling_enabled = 0;
+static int event_available[CS642_PROFILE_EVENTS];
+static cs642Profile profile_totals;
+static pthread_mutex_t profile_totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Per-thread counters, closed by the key destructor when a worker exits
+static pthread_key_t counters_key;
+static pthread_once_t counters_key_once = PTHREAD_ONCE_INIT;
+
+// Functions
+
+// Opens a counter of an event for the calling thread (-1 if not allowed)
+static int openCounter(const struct ProfileEvent *event) {
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0x00, sizeof(attr));
+  attr.type = event->type;
+  attr.size = sizeof(attr);
+  attr.config = event->config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return ((int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+  (void)event;
+  return (-1);
+#endif
+}
+
+// Reads a counter, scaled up for the time it was multiplexed out
+static uint64_t readCounter(int fd) {
+#if defined(__linux__)
+  uint64_t data[3]; // Value, time enabled, time running
+  if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+    return (0);
+  }
+  return ((data[2] < data[1]) ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0]);
+#else
+  (void)fd;
+  return (0);
+#endif
+}
+
+// Closes the counters of a thread
+static void destroyCounters(void *arg) {
+  struct ThreadCounters *counters = (struct ThreadCounters *)arg;
+  if (counters != NULL) {
+#if defined(__linux__)
+    for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+      if (counters->fds[e] >= 0) {
+        close(counters->fds[e]);
+      }
+    }
+#endif
+    free(counters);
+  }
+}
+
+// Creates the thread-specific key holding the counters
+static void createCountersKey(void) {
+  pthread_key_create(&counters_key, destroyCounters);
+}
+
+// Returns the calling thread's counters, opening them the first time
+static struct ThreadCounters *threadCounters(void) {
+  pthread_once(&counters_key_once, createCountersKey);
+  struct ThreadCounters *counters = pthread_getspecific(counters_key);
+  if (counters == NULL) {
+    counters = calloc(1, sizeof(struct ThreadCounters));
+    if (counters == NULL || pthread_setspecific(counters_key, counters)) {
+      free(counters);
+      return (NULL);
+    }
+    for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+      counters->fds[e] = event_available[e] ? openCounter(&profile_events[e]) : -1;
+    }
+  }
+  return (counters);
+}
+
+// Adds the counts of a region to a profile
+static void addRegionCounts(cs642ProfileCounts *counts, double seconds, const uint64_t *events) {
+  counts->calls++;
+  counts->seconds += seconds;
+  for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+    counts->events[e] += events[e];
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642EnableProfiling
+// Description  : Turns the profiling mode on after checking which hardware
+//                events the kernel lets this process count
+//
+// Inputs       : void
+// Outputs      : the number of events available
+int cs642EnableProfiling(void) {
+  int available = 0;
+  for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+    int fd = openCounter(&profile_events[e]);
+    event_available[e] = (fd >= 0);
+    available += event_available[e];
+#if defined(__linux__)
+    if (fd >= 0) {
+      close(fd);
+    }
+#endif
+  }
+  profiling_enabled = 1;
+  return (available);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ProfilingEnabled
+// Description  : Reports whether the profiling mode is on
+//
+// Inputs       : void
+// Outputs      : 1 if profiling, 0 otherwise
+int cs642ProfilingEnabled(void) {
+  return (profiling_enabled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ProfileAttach
+// Description  : Directs the regions of the calling thread to a profile
+//
+// Inputs       : profile - the profile of the current ciphertext (or NULL)
+// Outputs      : void
+void cs642ProfileAttach(cs642Profile *profile) {
+  if (!profiling_enabled) {
+    return;
+  }
+  struct ThreadCounters *counters = threadCounters();
+  if (counters != NULL) {
+    counters->attached = profile;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ProfileBegin
+// Description  : Records the clock and counter values at the start of a region
+//
+// Inputs       : region - the region (a cs642ProfileRegion)
+// Outputs      : void
+void cs642ProfileBegin(int region) {
+  if (!profiling_enabled) {
+    return;
+  }
+  struct ThreadCounters *counters = threadCounters();
+  if (counters == NULL) {
+    return;
+  }
+  for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+    counters->values[region][e] = (counters->fds[e] >= 0) ? readCounter(counters->fds[e]) : 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &counters->started[region]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642ProfileEnd
+// Description  : Charges the time and events since the start of a region to
+//                the attached profile and the run totals
+//
+// Inputs       : region - the region (a cs642ProfileRegion)
+// Outputs      : void
+void cs642ProfileEnd(int region) {
+  if (!profiling_enabled) {
+    return;
+  }
+  struct ThreadCounters *counters = threadCounters();
+  if (counters == NULL) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t events[CS642_PROFILE_EVENTS];
+  for (int e = 0; e < CS642_PROFILE_EVENTS; e++) {
+    events[e] = (counters->fds[e] >= 0) ? readCounter(counters->fds[e]) - counters->values[region][e] : 0;
+  }
+  double seconds = (now.tv_sec - counters->started[region].tv_sec) +
+                   (now.tv_nsec - counters->started[region].tv_nsec) / 1e9;
+
+  if (counters->attached != NULL) {
+    addRegionCounts(&counters->attached->regions[region], seconds, events);
+  }
+  pthread_mutex_lock(&profile_totals_lock);
+  addRegionCounts(&profile_totals.regions[region], seconds, events);
+  pthread_mutex_unlock(&profile_totals_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetProfileTotals
+// Description  : Copies the run totals of every region
+//
+// Inputs       : totals - the place to put the totals
+// Outputs      : void
+void cs642GetProfileTotals(cs642Profile *totals) {
+  pthread_mutex_lock(&profile_totals_lock);
+  *totals = profile_totals;
+  pthread_mutex_unlock(&profile_totals_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642LogProfile
+// Description  : Logs one line per region entered: calls, time, every
+//                available event, and the instructions per cycle
+//
+// Inputs       : label - what the profile covers (e.g. "SUBS 2/3", "total")
+//                profile - the profile
+// Outputs      : void
+void cs642LogProfile(const char *label, const cs642Profile *profile) {
+  for (int r = 0; r < CS642_PROFILE_REGIONS; r++) {
+    const cs642ProfileCounts *counts = &profile->regions[r];
+    if (counts->calls == 0) {
+      continue;
+    }
+
+    char line[512];
+    int used = snprintf(line, sizeof(line), "Profile %s, %s: %d call(s), %.4fs", label,
+                        profile_region_names[r], counts->calls, counts->seconds);
+    for (int e = 0; e < CS642_PROFILE_EVENTS && used < (int)sizeof(line); e++) {
+      if (event_available[e]) {
+        used += snprintf(line + used, sizeof(line) - used, ", %s %llu", profile_events[e].name,
+                         (unsigned long long)counts->events[e]);
+      } else {
+        used += snprintf(line + used, sizeof(line) - used, ", %s n/a", profile_events[e].name);
+      }
+    }
+    if (event_available[0] && event_available[1] && counts->events[0] > 0 && used < (int)sizeof(line)) {
+      snprintf(line + used, sizeof(line) - used, ", IPC %.2f", counts->events[1] / (double)counts->events[0]);
+    }
+    logMessage(LOG_OUTPUT_LEVEL, "%s", line);
+  }
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-profile.h
+//  Description    : This is an include file for the profiling mode that reads
+//                   the hardware performance counters around every engine and
+//                   substitution search phase.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+// Defines
+#define CS642_PROFILE_EVENTS 5 // Cycles, instructions, L1D misses, LLC misses, branch misses
+
+//
+// Type definitions
+
+// Regions of the analysis that are profiled (engines, then search phases)
+enum cs642ProfileRegion {
+  CS642_PROFILE_ROTX = 0,
+  CS642_PROFILE_VIGE = 1,
+  CS642_PROFILE_SUBS = 2,
+  CS642_PROFILE_SUBS_MONOGRAM = 3,
+  CS642_PROFILE_SUBS_BIGRAM = 4,
+  CS642_PROFILE_SUBS_TRIGRAM = 5,
+  CS642_PROFILE_SUBS_BEAM = 6,
+  CS642_PROFILE_SUBS_ANNEAL = 7,
+  CS642_PROFILE_REGIONS = 8
+};
+
+// Define struct and type for the counts accumulated in one region
+struct cs642ProfileCounts {
+  int calls;                              // Times the region was entered
+  double seconds;                         // Wall-clock time spent in it
+  uint64_t events[CS642_PROFILE_EVENTS];  // Hardware events counted in it
+};
+typedef struct cs642ProfileCounts cs642ProfileCounts;
+
+// Define struct and type for the profile of a ciphertext (or of a whole run)
+struct cs642Profile {
+  cs642ProfileCounts regions[CS642_PROFILE_REGIONS];
+};
+typedef struct cs642Profile cs642Profile;
+
+//
+// Profile functions
+
+int cs642EnableProfiling(void);
+// Turns the profiling mode on. Returns the number of hardware events the
+// kernel lets us count (0 if none, e.g. in a container: wall-clock time is
+// then the only thing reported).
+
+int cs642ProfilingEnabled(void);
+// Returns whether the profiling mode is on
+
+void cs642ProfileAttach(cs642Profile *profile);
+// Makes the calling thread add its regions to profile (NULL detaches) on top
+// of the run totals
+
+void cs642ProfileBegin(int region);
+// Starts counting a region on the calling thread (regions may nest)
+
+void cs642ProfileEnd(int region);
+// Stops counting a region on the calling thread
+
+void cs642GetProfileTotals(cs642Profile *totals);
+// Copies the totals of every region across all threads so far
+
+void cs642LogProfile(const char *label, const cs642Profile *profile);
+// Logs the regions of a profile that were entered at least once
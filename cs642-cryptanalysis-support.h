@@ -41,6 +41,15 @@ extern uint32_t CipherVerboseLevel;
 extern int cs642Verbose;
 // Verbose flag
 
+extern char *cs642TestKey;
+extern int cs642TestKeylen;
+extern char *cs642TestPlainText;
+extern int cs642TestPlainTextLen;
+// Expected answer of the last sample (NOT TO BE USED BY STUDENTS). Set
+// (obfuscated) by cs642GetCiphertextSample and compared against by
+// cs642CheckPlaintext; drivers that check samples out of order put them back
+// before each check.
+
 //
 // Support functions
 
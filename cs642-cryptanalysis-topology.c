@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-topology.c
+//  Description    : This is the processor topology of the cs642 first project.
+//                   The memory nodes and their CPU lists are read from sysfs
+//                   and intersected with the CPUs the process is allowed on;
+//                   workers are pinned by position in an order that alternates
+//                   between nodes, so a parallel crack spreads over sockets
+//                   and each worker can tell which node's memory is local.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+#define _GNU_SOURCE // sched_getcpu, pthread_setaffinity_np
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-topology.h"
+
+// Defines
+#define TOPOLOGY_NODE_PATH "/sys/devices/system/node/node%d/cpulist"
+#define TOPOLOGY_LINE 4096
+
+// Global data
+static cs642Topology topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+// Functions
+
+// Reads a CPU list ("0-3,8,10-11") of a node, marking its usable CPUs; returns
+// the number marked, -1 if the node does not exist
+static int readNodeCPUs(int node, int dense, const cpu_set_t *allowed) {
+  char path[128], line[TOPOLOGY_LINE];
+  snprintf(path, sizeof(path), TOPOLOGY_NODE_PATH, node);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return (-1);
+  }
+  if (fgets(line, sizeof(line), file) == NULL) {
+    line[0] = '\0';
+  }
+  fclose(file);
+
+  int marked = 0;
+  for (char *range = strtok(line, ",\n"); range != NULL; range = strtok(NULL, ",\n")) {
+    int first, last;
+    int fields = sscanf(range, "%d-%d", &first, &last);
+    if (fields < 1) {
+      continue;
+    }
+    last = (fields == 2) ? last : first;
+    for (int cpu = first; cpu <= last && cpu < CS642_TOPOLOGY_MAX_CPUS; cpu++) {
+      if (cpu >= 0 && CPU_ISSET(cpu, allowed) && topology.cpu_node[cpu] < 0) {
+        topology.cpu_node[cpu] = (int16_t)dense;
+        marked++;
+      }
+    }
+  }
+  return (marked);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : discoverTopology
+// Description  : Reads the nodes and their usable CPUs, then lays the CPUs out
+//                round robin across the nodes (first CPU of each node, then
+//                the second, ...). Nodes without usable CPUs are left out and
+//                the rest are numbered densely.
+//
+// Inputs       : void
+// Outputs      : void
+static void discoverTopology(void) {
+  cpu_set_t allowed;
+  memset(&topology, 0x00, sizeof(topology));
+  for (int cpu = 0; cpu < CS642_TOPOLOGY_MAX_CPUS; cpu++) {
+    topology.cpu_node[cpu] = -1;
+  }
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+    CPU_ZERO(&allowed);
+    CPU_SET(0, &allowed);
+  }
+
+  for (int node = 0; node < CS642_TOPOLOGY_MAX_NODES; node++) {
+    int marked = readNodeCPUs(node, topology.nodes, &allowed);
+    if (marked > 0) {
+      topology.node_cpus[topology.nodes++] = marked;
+    }
+  }
+
+  // No NUMA description: one node of every usable CPU
+  if (topology.nodes == 0) {
+    int marked = 0;
+    for (int cpu = 0; cpu < CS642_TOPOLOGY_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        topology.cpu_node[cpu] = 0;
+        marked++;
+      }
+    }
+    topology.nodes = 1;
+    topology.node_cpus[0] = (marked > 0) ? marked : 1;
+    topology.cpu_node[0] = (marked > 0) ? topology.cpu_node[0] : 0;
+  }
+
+  // Alternate between the nodes
+  for (int round = 0; topology.cpus < CS642_TOPOLOGY_MAX_CPUS; round++) {
+    int added = 0;
+    for (int node = 0; node < topology.nodes; node++) {
+      for (int cpu = 0, seen = 0; cpu < CS642_TOPOLOGY_MAX_CPUS; cpu++) {
+        if (topology.cpu_node[cpu] == node && seen++ == round) {
+          topology.order[topology.cpus++] = (int16_t)cpu;
+          added++;
+          break;
+        }
+      }
+    }
+    if (added == 0) {
+      break;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetTopology
+// Description  : Returns the topology of the host (discovered once)
+//
+// Inputs       : void
+// Outputs      : the topology
+const cs642Topology *cs642GetTopology(void) {
+  pthread_once(&topology_once, discoverTopology);
+  return (&topology);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642LogTopology
+// Description  : Logs the nodes of the host and the CPUs of each
+//
+// Inputs       : void
+// Outputs      : void
+void cs642LogTopology(void) {
+  const cs642Topology *host = cs642GetTopology();
+  logMessage(LOG_INFO_LEVEL, "Topology: %d memory node(s), %d usable CPU(s).", host->nodes, host->cpus);
+  for (int node = 0; node < host->nodes; node++) {
+    char list[TOPOLOGY_LINE];
+    int used = 0;
+    list[0] = '\0';
+    for (int cpu = 0; cpu < CS642_TOPOLOGY_MAX_CPUS && used < (int)sizeof(list) - 8; cpu++) {
+      if (host->cpu_node[cpu] == node) {
+        used += snprintf(list + used, sizeof(list) - used, (used > 0) ? ",%d" : "%d", cpu);
+      }
+    }
+    logMessage(LOG_INFO_LEVEL, "Topology: node %d has %d CPU(s) [%s].", node, host->node_cpus[node], list);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642PinThread
+// Description  : Pins the calling worker to its CPU, or to its CPU's node when
+//                there are CPUs to spare
+//
+// Inputs       : worker - the index of the worker
+//                workers - the number of workers
+// Outputs      : the node of the worker, or -1 if failure
+int cs642PinThread(int worker, int workers) {
+  const cs642Topology *host = cs642GetTopology();
+  if (worker < 0 || host->cpus == 0) {
+    return (-1);
+  }
+  int cpu = host->order[worker % host->cpus];
+  int node = host->cpu_node[cpu];
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (workers < host->cpus) {
+    for (int other = 0; other < CS642_TOPOLOGY_MAX_CPUS; other++) {
+      if (host->cpu_node[other] == node) {
+        CPU_SET(other, &mask);
+      }
+    }
+  } else {
+    CPU_SET(cpu, &mask);
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask)) {
+    return (-1);
+  }
+  return (node);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CurrentNode
+// Description  : Returns the node the calling thread is running on
+//
+// Inputs       : void
+// Outputs      : the node (0 if unknown)
+int cs642CurrentNode(void) {
+  const cs642Topology *host = cs642GetTopology();
+  int cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= CS642_TOPOLOGY_MAX_CPUS || host->cpu_node[cpu] < 0) {
+    return (0);
+  }
+  return (host->cpu_node[cpu]);
+}
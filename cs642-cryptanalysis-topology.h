@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-topology.h
+//  Description    : This is an include file for the processor topology of the
+//                   host: the memory nodes, the CPUs this process may run on
+//                   and the node of each, so workers can be pinned and read
+//                   memory local to them.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+// Defines
+#define CS642_TOPOLOGY_MAX_NODES 64
+#define CS642_TOPOLOGY_MAX_CPUS 1024
+
+//
+// Type definitions
+
+// Define struct and type for the topology of the host
+struct cs642Topology {
+  int nodes;                               // Memory nodes (1 if the host reports none)
+  int cpus;                                // CPUs the process may run on
+  int node_cpus[CS642_TOPOLOGY_MAX_NODES]; // Usable CPUs of each node
+  int16_t cpu_node[CS642_TOPOLOGY_MAX_CPUS]; // Node of each CPU number (-1 = not usable)
+  int16_t order[CS642_TOPOLOGY_MAX_CPUS];  // Usable CPUs, alternating between nodes
+};
+typedef struct cs642Topology cs642Topology;
+
+//
+// Topology functions
+
+const cs642Topology *cs642GetTopology(void);
+// Returns the topology, reading it from the system on first use. A host
+// without a NUMA description is one node of every CPU it lets us run on.
+
+void cs642LogTopology(void);
+// Logs the nodes and their CPUs
+
+int cs642PinThread(int worker, int workers);
+// Pins the calling thread, one of workers threads, to a CPU (worker w gets the
+// w-th CPU of the order, so consecutive workers land on different nodes). If
+// there are fewer workers than CPUs the thread is pinned to every CPU of that
+// CPU's node instead, leaving room for the threads it starts. Returns the
+// node, or -1 if the thread could not be pinned.
+
+int cs642CurrentNode(void);
+// Returns the node of the CPU the calling thread is running on (0 if unknown)
@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-trie.c
+//  Description    : This is the dictionary trie of the cs642 first project. It
+//                   is built with a 26-way node per prefix, then compacted into
+//                   a breadth first array where a node keeps a mask of its
+//                   children and the index of the first one, so the whole
+//                   dictionary walks in a few cache lines per word. The
+//                   segmenter runs a Viterbi pass over it to score candidate
+//                   plaintexts that have no spaces.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-trie.h"
+
+// Defines
+#define ALPHABET_SIZE 26
+#define TRIE_INITIAL_NODES 1024
+#define TRIE_UNKNOWN_MARGIN 1.0 // An unknown letter costs this much more than the rarest word
+#define TRIE_CUTOFF_STRIDE 32   // Positions between checks of the cut-off
+
+// Struct to represent a node of the trie while it is built
+struct TrieBuildNode {
+  int32_t child[ALPHABET_SIZE]; // Node of each next letter (0 = none)
+  uint32_t count;               // Occurrences of the word ending here (0 = none)
+};
+
+// Struct to represent a node of the compact trie
+struct TrieNode {
+  uint32_t mask;  // Letters with a child (bit per letter)
+  uint32_t first; // Index of the child of the lowest letter
+  float logp;     // Log-probability of the word ending here (0 = none)
+};
+
+// Struct to hold a trie (build nodes until compacted, then compact nodes)
+struct cs642Trie {
+  struct TrieBuildNode *build; // Nodes being built (NULL once compacted)
+  int build_size;              // Build nodes in use
+  int build_capacity;          // Build nodes allocated
+  struct TrieNode *nodes;      // Compact nodes, breadth first (root first)
+  int size;                    // Compact nodes
+  int max_length;              // Longest word
+  double total;                // Occurrences of every word
+  double unknown_logp;         // Cost of a letter in no word
+};
+
+// Functions
+
+// Returns the letter code (0-25) of a character of either case, -1 otherwise
+static inline int trieLetter(char c) {
+  unsigned d = (unsigned)(((unsigned char)c | 0x20) - 'a');
+  return (d < ALPHABET_SIZE) ? (int)d : -1;
+}
+
+// Returns the compact child of a node along a letter (-1 if none)
+static inline int trieChild(const struct TrieNode *node, int letter) {
+  if (!(node->mask & (1u << letter))) {
+    return (-1);
+  }
+  return ((int)node->first + __builtin_popcount(node->mask & ((1u << letter) - 1)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CreateTrie
+// Description  : Creates an empty trie (a root build node)
+//
+// Inputs       : void
+// Outputs      : the trie, or NULL if failure
+cs642Trie *cs642CreateTrie(void) {
+  cs642Trie *trie = calloc(1, sizeof(cs642Trie));
+  if (trie == NULL) {
+    return (NULL);
+  }
+  trie->build = calloc(TRIE_INITIAL_NODES, sizeof(struct TrieBuildNode));
+  if (trie->build == NULL) {
+    free(trie);
+    return (NULL);
+  }
+  trie->build_size = 1;
+  trie->build_capacity = TRIE_INITIAL_NODES;
+  return (trie);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642TrieInsert
+// Description  : Adds a word and its count to a trie being built
+//
+// Inputs       : trie - the trie
+//                word - the word (A-Z of either case)
+//                count - the occurrences of the word
+// Outputs      : 0 if successful (or skipped), -1 if failure
+int cs642TrieInsert(cs642Trie *trie, const char *word, uint32_t count) {
+  int length = (int)strlen(word);
+  if (trie->build == NULL) {
+    return (-1);
+  }
+  if (length == 0 || count == 0) {
+    return (0);
+  }
+  for (int i = 0; i < length; i++) {
+    if (trieLetter(word[i]) < 0) {
+      return (0); // Cannot occur in text of letters
+    }
+  }
+
+  int node = 0;
+  for (int i = 0; i < length; i++) {
+    int letter = trieLetter(word[i]);
+    if (trie->build[node].child[letter] == 0) {
+      if (trie->build_size == trie->build_capacity) {
+        struct TrieBuildNode *grown = realloc(trie->build, sizeof(struct TrieBuildNode) * trie->build_capacity * 2);
+        if (grown == NULL) {
+          return (-1);
+        }
+        memset(grown + trie->build_capacity, 0x00, sizeof(struct TrieBuildNode) * trie->build_capacity);
+        trie->build = grown;
+        trie->build_capacity *= 2;
+      }
+      trie->build[node].child[letter] = trie->build_size++;
+    }
+    node = trie->build[node].child[letter];
+  }
+  trie->build[node].count += count;
+  trie->total += count;
+  trie->max_length = (length > trie->max_length) ? length : trie->max_length;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642TrieCompact
+// Description  : Lays the built trie out breadth first with contiguous
+//                children and computes the word log-probabilities
+//
+// Inputs       : trie - the trie
+// Outputs      : 0 if successful, -1 if failure
+int cs642TrieCompact(cs642Trie *trie) {
+  if (trie->build == NULL) {
+    return (-1);
+  }
+  int *order = malloc(sizeof(int) * trie->build_size); // Build node of each compact node
+  trie->nodes = malloc(sizeof(struct TrieNode) * trie->build_size);
+  if (order == NULL || trie->nodes == NULL) {
+    free(order);
+    free(trie->nodes);
+    trie->nodes = NULL;
+    return (-1);
+  }
+
+  // Breadth first: the children of a node are appended together, lowest letter first
+  double min_logp = 0.0;
+  int size = 1;
+  order[0] = 0;
+  for (int n = 0; n < size; n++) {
+    const struct TrieBuildNode *built = &trie->build[order[n]];
+    struct TrieNode *node = &trie->nodes[n];
+    node->mask = 0;
+    node->first = size;
+    node->logp = (built->count > 0) ? (float)log(built->count / trie->total) : 0.0f;
+    min_logp = (node->logp < min_logp) ? node->logp : min_logp;
+    for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+      if (built->child[letter] != 0) {
+        node->mask |= 1u << letter;
+        order[size++] = built->child[letter];
+      }
+    }
+  }
+  trie->size = size;
+  trie->unknown_logp = min_logp - TRIE_UNKNOWN_MARGIN;
+  free(order);
+  free(trie->build);
+  trie->build = NULL;
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642TrieSegment
+// Description  : Scores a text by its best segmentation into dictionary
+//                words (Viterbi over the trie). best[i] is the log-likelihood
+//                of the best segmentation of the first i characters; from
+//                each reachable i the trie is walked along the text, relaxing
+//                best[j] at every word end j.
+//
+// Inputs       : trie - the compacted trie
+//                text - the text to score
+//                len - the length of the text
+//                cutoff - the score below which the text is not worth
+//                         finishing (-INFINITY = never)
+//                result - the place to put the segmentation counts (or NULL)
+// Outputs      : the log-likelihood of the best segmentation, or a bound
+//                below cutoff if stopped early (NAN if failure)
+double cs642TrieSegment(const cs642Trie *trie, const char *text, int len, double cutoff,
+                        cs642Segmentation *result) {
+  if (trie->nodes == NULL || len < 0) {
+    return (NAN);
+  }
+  double *best = malloc(sizeof(double) * (len + 1));
+  int *words = malloc(sizeof(int) * 2 * (len + 1)), *covered = words + (len + 1);
+  if (best == NULL || words == NULL) {
+    free(best);
+    free(words);
+    return (NAN);
+  }
+  for (int i = 0; i <= len; i++) {
+    best[i] = -INFINITY;
+  }
+  best[0] = 0.0;
+  words[0] = covered[0] = 0;
+
+  int letters = 0;
+  for (int i = 0; i < len; i++) {
+    // Stop once every segmentation must pass a position that is already hopeless
+    if (i % TRIE_CUTOFF_STRIDE == 0 && i > 0 && cutoff > -INFINITY) {
+      double bound = -INFINITY;
+      for (int j = i; j <= len && j <= i + trie->max_length; j++) {
+        bound = (best[j] > bound) ? best[j] : bound;
+      }
+      if (bound < cutoff) {
+        free(best);
+        free(words);
+        return (bound);
+      }
+    }
+    if (best[i] == -INFINITY) {
+      continue;
+    }
+
+    // A non-letter is a free boundary, a letter can always be left unknown
+    int letter = trieLetter(text[i]);
+    double step = (letter < 0) ? best[i] : best[i] + trie->unknown_logp;
+    letters += (letter >= 0);
+    if (step > best[i + 1]) {
+      best[i + 1] = step;
+      words[i + 1] = words[i];
+      covered[i + 1] = covered[i];
+    }
+
+    // Every dictionary word starting here
+    for (int j = i, node = 0; j < len; j++) {
+      int next = trieLetter(text[j]);
+      node = (next < 0) ? -1 : trieChild(&trie->nodes[node], next);
+      if (node < 0) {
+        break;
+      }
+      float logp = trie->nodes[node].logp;
+      if (logp != 0.0f && best[i] + logp > best[j + 1]) {
+        best[j + 1] = best[i] + logp;
+        words[j + 1] = words[i] + 1;
+        covered[j + 1] = covered[i] + (j + 1 - i);
+      }
+    }
+  }
+
+  double score = best[len];
+  if (result != NULL) {
+    result->words = words[len];
+    result->covered = covered[len];
+    result->letters = letters;
+  }
+  free(best);
+  free(words);
+  return (score);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642DestroyTrie
+// Description  : Frees a trie
+//
+// Inputs       : trie - the trie (may be NULL)
+// Outputs      : void
+void cs642DestroyTrie(cs642Trie *trie) {
+  if (trie != NULL) {
+    free(trie->build);
+    free(trie->nodes);
+    free(trie);
+  }
+}
@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-trie.h
+//  Description    : This is an include file for the dictionary trie and the
+//                   Viterbi segmenter that scores text whose word boundaries
+//                   were stripped.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+//
+// Type definitions
+
+// Define type for a dictionary trie (opaque)
+typedef struct cs642Trie cs642Trie;
+
+// Define struct and type for the best segmentation of a text
+struct cs642Segmentation {
+  int words;   // Dictionary words in the segmentation
+  int covered; // Letters inside those words (the rest are unknown letters)
+  int letters; // Letters in the text
+};
+typedef struct cs642Segmentation cs642Segmentation;
+
+//
+// Trie functions
+
+cs642Trie *cs642CreateTrie(void);
+// Creates an empty trie, or returns NULL if it cannot be allocated
+
+int cs642TrieInsert(cs642Trie *trie, const char *word, uint32_t count);
+// Adds a word (A-Z of either case; words with anything else are skipped) that
+// occurs count times. Returns 0 if successful, -1 if failure.
+
+int cs642TrieCompact(cs642Trie *trie);
+// Freezes the trie: nodes are laid out breadth first with their children
+// contiguous (found by a 26-bit mask), and each word gets its log-probability.
+// No word can be inserted afterwards. Returns 0 if successful, -1 if failure.
+
+double cs642TrieSegment(const cs642Trie *trie, const char *text, int len,
+                        double cutoff, cs642Segmentation *result);
+// Returns the log-likelihood of the best segmentation of text into dictionary
+// words, found by dynamic programming in O(len * longest word). Non-letters
+// are free boundaries and letters in no word cost a fixed penalty. Once no
+// segmentation can reach cutoff, stops early and returns a bound below it
+// (-INFINITY = never stop). Fills result (unless NULL) when it completes.
+
+void cs642DestroyTrie(cs642Trie *trie);
+// Frees a trie (NULL is ignored)
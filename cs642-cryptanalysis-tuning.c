@@ -0,0 +1,770 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-tuning.c
+//  Description    : This is the engine tuning of the cs642 first project. The
+//                   parameters the engines used to hard-code are kept per band
+//                   of ciphertext lengths in a profile, which is built in,
+//                   loaded from a text file at startup, or calibrated: passages
+//                   of each band length are cut from a corpus, encrypted under
+//                   random keys, and the engines are timed on them under each
+//                   candidate setting.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <compsci642_log.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project Include Files
+#include "cs642-cryptanalysis-counts.h"
+#include "cs642-cryptanalysis-impl.h"
+#include "cs642-cryptanalysis-support.h"
+#include "cs642-cryptanalysis-topology.h"
+#include "cs642-cryptanalysis-tuning.h"
+
+// Defines
+#define DEFAULT_MAX_ATTEMPTS 600
+#define DEFAULT_INCREMENT_VALUE 0.0005
+#define DEFAULT_MATCH_DISTANCE 0.0019
+#define DEFAULT_WORD_THRESHOLD 400
+#define TUNING_MIN_PERIOD 6 // Periods the Vigenere column tables are built for
+#define TUNING_MAX_PERIOD 11
+#define TUNING_LINE 256
+#define CALIBRATION_MAX_SAMPLES 16
+#define CALIBRATION_SEED 0x9e3779b97f4a7c15ULL // Same passages and keys on every run
+#define CALIBRATION_COUNT_BYTES (8 << 20)       // Text counted per thread setting (slices are at least 1 MB)
+#define CALIBRATION_COUNT_REPEATS 3             // Countings timed per thread setting
+#define CALIBRATION_WORKER_ROUNDS 2             // Analyses per worker of the largest count timed
+#define CALIBRATION_WORKER_ANALYSES 48          // Fewest analyses timed per worker count
+#define CALIBRATION_MAX_WORKERS 64              // Most pipeline workers timed
+#define CALIBRATION_MARGIN 0.9                  // An equal setting must be this much faster to replace an earlier one
+
+// Built-in parameters: every band field as the engines had it hard-coded
+#define DEFAULT_TUNING                                                                                     \
+  {0, DEFAULT_MAX_ATTEMPTS, DEFAULT_INCREMENT_VALUE, DEFAULT_MATCH_DISTANCE, DEFAULT_WORD_THRESHOLD,        \
+   TUNING_MIN_PERIOD, TUNING_MAX_PERIOD, CS642_SUBS_SWAP, 0, 0, 0, 0, 0}
+
+// Struct to describe a band parameter in the profile file
+struct TuningField {
+  const char *name; // Name in the file
+  size_t offset;    // Offset in cs642Tuning
+  int real;         // Whether the field is a double (int otherwise)
+};
+
+// Struct to represent a substitution setting raced by the calibration
+struct SubsCandidate {
+  int engine;             // cs642SubsEngine
+  int max_attempts;       // Swap search parameters
+  double match_distance;
+  double increment_value;
+  int beam_width;         // Beam width (0 = default)
+  int anneal_steps;       // Annealing budget (0 = default)
+  int anneal_restarts;
+  int parallel;           // Only worth timing with several CPUs
+};
+
+// Struct to hold the calibration passages of one band and their encryptions
+struct CalibrationSet {
+  int length;                                           // Characters per passage
+  int count;                                            // Passages
+  char *plaintexts[CALIBRATION_MAX_SAMPLES];            // The passages
+  char *ciphertexts[CIPHER_UNK][CALIBRATION_MAX_SAMPLES]; // Each passage under a random key of each cipher
+};
+
+// Struct to hold the analyses shared by the workers of a throughput trial
+struct WorkerTrial {
+  const struct CalibrationSet *set; // The passages
+  int jobs;                         // Analyses to run (each cipher of each passage in turn)
+  int next;                         // Next analysis to take
+  int failed;                       // Set by a worker that could not run
+};
+
+// Global data
+static cs642TuningProfile active_profile = {0, 1, {DEFAULT_TUNING}};
+
+static const struct TuningField tuning_fields[] = {
+  {"max_attempts", offsetof(cs642Tuning, max_attempts), 0},
+  {"increment_value", offsetof(cs642Tuning, increment_value), 1},
+  {"match_distance", offsetof(cs642Tuning, match_distance), 1},
+  {"word_threshold", offsetof(cs642Tuning, word_threshold), 0},
+  {"vige_min_period", offsetof(cs642Tuning, vige_min_period), 0},
+  {"vige_max_period", offsetof(cs642Tuning, vige_max_period), 0},
+  {"subs_engine", offsetof(cs642Tuning, subs_engine), 0},
+  {"beam_width", offsetof(cs642Tuning, beam_width), 0},
+  {"anneal_steps", offsetof(cs642Tuning, anneal_steps), 0},
+  {"anneal_restarts", offsetof(cs642Tuning, anneal_restarts), 0},
+  {"portfolio_engines", offsetof(cs642Tuning, portfolio_engines), 0},
+  {"count_threads", offsetof(cs642Tuning, count_threads), 0},
+};
+#define TUNING_FIELDS (int)(sizeof(tuning_fields) / sizeof(tuning_fields[0]))
+
+// Band lengths the calibration measures (the last band covers any length)
+static const int calibration_lengths[] = {150, 400, 1000, 2500, 6000};
+#define CALIBRATION_BANDS (int)(sizeof(calibration_lengths) / sizeof(calibration_lengths[0]))
+
+// Confirmation thresholds raced for ROTX and Vigenere
+static const int calibration_thresholds[] = {400, 200, 100};
+#define CALIBRATION_THRESHOLDS (int)(sizeof(calibration_thresholds) / sizeof(calibration_thresholds[0]))
+
+// Vigenere period ranges raced (the first is the built-in one)
+static const int calibration_periods[][2] = {
+  {TUNING_MIN_PERIOD, TUNING_MAX_PERIOD}, {TUNING_MIN_PERIOD, 9}, {8, TUNING_MAX_PERIOD}, {7, 10},
+};
+#define CALIBRATION_PERIODS (int)(sizeof(calibration_periods) / sizeof(calibration_periods[0]))
+
+// Substitution settings raced (the first is the built-in one)
+static const struct SubsCandidate subs_candidates[] = {
+  {CS642_SUBS_SWAP, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 0, 0, 0},
+  {CS642_SUBS_SWAP, DEFAULT_MAX_ATTEMPTS / 2, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 0, 0, 0},
+  {CS642_SUBS_SWAP, DEFAULT_MAX_ATTEMPTS, 0.0025, 0.001, 0, 0, 0, 0},
+  {CS642_SUBS_BEAM, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 64, 0, 0, 0},
+  {CS642_SUBS_BEAM, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 256, 0, 0, 0},
+  {CS642_SUBS_ANNEAL, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 5000, 4, 0},
+  {CS642_SUBS_ANNEAL, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 0, 0, 0},
+  {CS642_SUBS_ANNEAL, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 50000, 12, 0},
+  {CS642_SUBS_PORTFOLIO, DEFAULT_MAX_ATTEMPTS, DEFAULT_MATCH_DISTANCE, DEFAULT_INCREMENT_VALUE, 0, 0, 0, 1},
+};
+#define SUBS_CANDIDATES (int)(sizeof(subs_candidates) / sizeof(subs_candidates[0]))
+
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642DefaultTuning
+// Description  : Fills the built-in parameters
+//
+// Inputs       : tuning - the place to put the parameters
+// Outputs      : void
+void cs642DefaultTuning(cs642Tuning *tuning) {
+  *tuning = (cs642Tuning)DEFAULT_TUNING;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetTuning
+// Description  : Looks up the band of a ciphertext length
+//
+// Inputs       : clen - the length of the ciphertext
+// Outputs      : the parameters of its band
+const cs642Tuning *cs642GetTuning(int clen) {
+  for (int b = 0; b < active_profile.bands - 1; b++) {
+    if (clen <= active_profile.band[b].max_length) {
+      return (&active_profile.band[b]);
+    }
+  }
+  return (&active_profile.band[active_profile.bands - 1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642GetTuningProfile
+// Description  : Returns the profile in use
+//
+// Inputs       : void
+// Outputs      : the profile
+const cs642TuningProfile *cs642GetTuningProfile(void) {
+  return (&active_profile);
+}
+
+// Returns 0 if a band holds parameters the engines accept, -1 otherwise
+static int validTuning(const cs642Tuning *tuning) {
+  if (tuning->max_length < 0 || tuning->max_attempts < 1 || tuning->increment_value < 0 ||
+      tuning->match_distance < 0 || tuning->word_threshold < 0 || tuning->vige_min_period < TUNING_MIN_PERIOD ||
+      tuning->vige_max_period > TUNING_MAX_PERIOD || tuning->vige_min_period > tuning->vige_max_period ||
+      tuning->subs_engine < 0 || tuning->subs_engine >= CS642_SUBS_ENGINES || tuning->beam_width < 0 ||
+      tuning->anneal_steps < 0 || tuning->anneal_restarts < 0 || tuning->portfolio_engines < 0 ||
+      tuning->count_threads < 0) {
+    return (-1);
+  }
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642SetTuningProfile
+// Description  : Validates and installs a profile
+//
+// Inputs       : profile - the profile (NULL = built-in)
+// Outputs      : 0 if successful, -1 if invalid
+int cs642SetTuningProfile(const cs642TuningProfile *profile) {
+  if (profile == NULL) {
+    active_profile = (cs642TuningProfile){0, 1, {DEFAULT_TUNING}};
+    return (0);
+  }
+  if (profile->workers < 0 || profile->bands < 1 || profile->bands > CS642_TUNING_MAX_BANDS) {
+    return (-1);
+  }
+  for (int b = 0; b < profile->bands; b++) {
+    int last = (b == profile->bands - 1);
+    if (validTuning(&profile->band[b]) || (!last && profile->band[b].max_length == 0) ||
+        (b > 0 && !last && profile->band[b].max_length <= profile->band[b - 1].max_length)) {
+      return (-1);
+    }
+  }
+  active_profile = *profile;
+  active_profile.band[active_profile.bands - 1].max_length = 0; // The last band takes any length
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642LoadTuningProfile
+// Description  : Reads a profile file and installs it
+//
+// Inputs       : path - the profile file
+// Outputs      : 0 if successful, -1 if failure
+int cs642LoadTuningProfile(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Unable to open tuning profile [%s].", path);
+    return (-1);
+  }
+
+  cs642TuningProfile profile = {0, 0, {{0}}};
+  char line[TUNING_LINE], name[TUNING_LINE];
+  double value;
+  int number = 0, failed = 0;
+  while (!failed && fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    if (sscanf(line, " %255s", name) != 1 || name[0] == '#') {
+      continue; // Blank line or comment
+    }
+    if (sscanf(line, " %255s %lf", name, &value) != 2) {
+      failed = 1;
+    } else if (strcmp(name, "workers") == 0) {
+      profile.workers = (int)value;
+    } else if (strcmp(name, "band") == 0) {
+      if (profile.bands == CS642_TUNING_MAX_BANDS) {
+        failed = 1;
+      } else {
+        cs642DefaultTuning(&profile.band[profile.bands]);
+        profile.band[profile.bands++].max_length = (int)value;
+      }
+    } else {
+      int f = 0;
+      while (f < TUNING_FIELDS && strcmp(tuning_fields[f].name, name) != 0) {
+        f++;
+      }
+      if (f == TUNING_FIELDS || profile.bands == 0) {
+        failed = 1; // Unknown parameter, or a parameter before the first band
+      } else if (tuning_fields[f].real) {
+        *(double *)((char *)&profile.band[profile.bands - 1] + tuning_fields[f].offset) = value;
+      } else {
+        *(int *)((char *)&profile.band[profile.bands - 1] + tuning_fields[f].offset) = (int)value;
+      }
+    }
+  }
+  fclose(file);
+
+  if (failed || cs642SetTuningProfile(&profile)) {
+    logMessage(LOG_ERROR_LEVEL, "Invalid tuning profile [%s] (line %d).", path, number);
+    return (-1);
+  }
+  logMessage(LOG_INFO_LEVEL, "Loaded tuning profile [%s] with %d band(s).", path, profile.bands);
+  return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642SaveTuningProfile
+// Description  : Writes a profile file
+//
+// Inputs       : path - the profile file
+//                profile - the profile to write
+// Outputs      : 0 if successful, -1 if failure
+int cs642SaveTuningProfile(const char *path, const cs642TuningProfile *profile) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Unable to create tuning profile [%s].", path);
+    return (-1);
+  }
+  fprintf(file, "# cs642 cryptanalysis tuning profile (band 0 = any longer ciphertext)\n");
+  fprintf(file, "workers %d\n", profile->workers);
+  for (int b = 0; b < profile->bands; b++) {
+    const cs642Tuning *tuning = &profile->band[b];
+    fprintf(file, "\nband %d\n", tuning->max_length);
+    for (int f = 0; f < TUNING_FIELDS; f++) {
+      const char *field = (const char *)tuning + tuning_fields[f].offset;
+      if (tuning_fields[f].real) {
+        fprintf(file, "%s %.6g\n", tuning_fields[f].name, *(const double *)field);
+      } else {
+        fprintf(file, "%s %d\n", tuning_fields[f].name, *(const int *)field);
+      }
+    }
+  }
+  int failed = ferror(file);
+  failed |= fclose(file);
+  return (failed ? -1 : 0);
+}
+
+// Returns the next value of a xorshift64 generator
+static uint64_t calibrationRandom(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return (*state);
+}
+
+// Returns the seconds elapsed since start
+static double secondsSince(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Reads a corpus as the samples are written: upper-case letters separated by
+// single spaces. Returns the text (caller frees) or NULL, with its length.
+static char *readCorpus(const char *path, int *length) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return (NULL);
+  }
+  size_t capacity = 1 << 16, used = 0;
+  char *text = malloc(capacity);
+  int c, space = 1;
+  while (text != NULL && (c = fgetc(file)) != EOF) {
+    if (used + 1 >= capacity) {
+      char *grown = realloc(text, capacity * 2);
+      if (grown == NULL) {
+        free(text);
+        text = NULL;
+        break;
+      }
+      text = grown;
+      capacity *= 2;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      text[used++] = (char)(c & ~0x20);
+      space = 0;
+    } else if (!space) {
+      text[used++] = ' ';
+      space = 1;
+    }
+  }
+  fclose(file);
+  if (text != NULL) {
+    text[used] = '\0';
+    *length = (int)used;
+  }
+  return (text);
+}
+
+// Releases the passages and encryptions of a set
+static void freeCalibrationSet(struct CalibrationSet *set) {
+  for (int s = 0; s < set->count; s++) {
+    free(set->plaintexts[s]);
+    for (int cipher = 0; cipher < CIPHER_UNK; cipher++) {
+      free(set->ciphertexts[cipher][s]);
+    }
+  }
+  set->count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : buildCalibrationSet
+// Description  : Cuts passages of a length from the corpus (starting on a
+//                word) and encrypts each under a random key of every cipher
+//
+// Inputs       : corpus - the normalized corpus
+//                corpus_length - its length
+//                length - the characters per passage
+//                samples - the number of passages
+//                random - the generator state
+//                set - the set to fill
+// Outputs      : 0 if successful, -1 if failure
+static int buildCalibrationSet(const char *corpus, int corpus_length, int length, int samples, uint64_t *random,
+                               struct CalibrationSet *set) {
+  memset(set, 0x00, sizeof(struct CalibrationSet));
+  set->length = length;
+  if (corpus_length < length * 2) {
+    return (-1);
+  }
+  for (int s = 0; s < samples; s++) {
+    int start = (int)(calibrationRandom(random) % (uint64_t)(corpus_length - length * 2));
+    while (corpus[start] != ' ') {
+      start++;
+    }
+    start++;
+
+    set->plaintexts[s] = calloc(length + 1, 1);
+    for (int cipher = 0; cipher < CIPHER_UNK; cipher++) {
+      set->ciphertexts[cipher][s] = calloc(length + 1, 1);
+    }
+    set->count = s + 1;
+    if (set->plaintexts[s] == NULL || set->ciphertexts[CIPHER_ROTX][s] == NULL ||
+        set->ciphertexts[CIPHER_VIGE][s] == NULL || set->ciphertexts[CIPHER_SUBS][s] == NULL) {
+      freeCalibrationSet(set);
+      return (-1);
+    }
+    memcpy(set->plaintexts[s], corpus + start, length);
+
+    // ROTX takes the shift itself, Vigenere letters 'A' + shift, substitution a permutation
+    char shift = (char)(1 + calibrationRandom(random) % 25);
+    char vigenere[TUNING_MAX_PERIOD + 1];
+    int period = TUNING_MIN_PERIOD + (int)(calibrationRandom(random) % (TUNING_MAX_PERIOD - TUNING_MIN_PERIOD + 1));
+    for (int i = 0; i < period; i++) {
+      vigenere[i] = (char)('A' + calibrationRandom(random) % 26);
+    }
+    vigenere[period] = '\0';
+    char substitution[27] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for (int i = 25; i > 0; i--) {
+      int j = (int)(calibrationRandom(random) % (uint64_t)(i + 1));
+      char swap = substitution[i];
+      substitution[i] = substitution[j];
+      substitution[j] = swap;
+    }
+    cs642Encrypt(CIPHER_ROTX, &shift, 1, set->plaintexts[s], length, set->ciphertexts[CIPHER_ROTX][s], length + 1);
+    cs642Encrypt(CIPHER_VIGE, vigenere, period, set->plaintexts[s], length, set->ciphertexts[CIPHER_VIGE][s],
+                 length + 1);
+    cs642Encrypt(CIPHER_SUBS, substitution, 26, set->plaintexts[s], length, set->ciphertexts[CIPHER_SUBS][s],
+                 length + 1);
+  }
+  return (0);
+}
+
+// Runs the engine of a cipher on a passage
+static void analyzeSample(cs642Cipher cipher, char *ciphertext, int length, char *plaintext, char *key) {
+  switch (cipher) {
+  case CIPHER_ROTX:
+    cs642PerformROTXCryptanalysis(ciphertext, length, plaintext, length, (uint8_t *)key);
+    break;
+  case CIPHER_VIGE:
+    cs642PerformVIGECryptanalysis(ciphertext, length, plaintext, length, key);
+    break;
+  default:
+    cs642PerformSUBSCryptanalysis(ciphertext, length, plaintext, length, key);
+    break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : measureCipher
+// Description  : Installs a setting as the only band and runs the engine of a
+//                cipher on every passage of a set
+//
+// Inputs       : cipher - the cipher
+//                set - the passages
+//                tuning - the setting
+//                seconds - the place to put the total time
+// Outputs      : the number of passages decrypted exactly, -1 if failure
+static int measureCipher(cs642Cipher cipher, const struct CalibrationSet *set, const cs642Tuning *tuning,
+                         double *seconds) {
+  cs642TuningProfile trial = {0, 1, {*tuning}};
+  if (cs642SetTuningProfile(&trial)) {
+    return (-1);
+  }
+  char *plaintext = malloc(set->length + 1);
+  char key[64];
+  if (plaintext == NULL) {
+    return (-1);
+  }
+
+  int solved = 0;
+  *seconds = 0.0;
+  for (int s = 0; s < set->count; s++) {
+    char *ciphertext = set->ciphertexts[cipher][s];
+    struct timespec start;
+    memset(plaintext, 0x00, set->length + 1);
+    memset(key, 0x00, sizeof(key));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    analyzeSample(cipher, ciphertext, set->length, plaintext, key);
+    *seconds += secondsSince(&start);
+    solved += (memcmp(plaintext, set->plaintexts[s], set->length) == 0);
+  }
+  free(plaintext);
+  return (solved);
+}
+
+// Returns whether a measurement beats the best so far (more solved, then
+// clearly faster, so timing noise does not displace the built-in settings)
+static int betterMeasurement(int solved, double seconds, int best_solved, double best_seconds) {
+  return (solved > best_solved || (solved == best_solved && seconds < best_seconds * CALIBRATION_MARGIN));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : calibrateBand
+// Description  : Chooses the parameters of one band: the confirmation
+//                threshold on ROTX and Vigenere, the Vigenere period range,
+//                then the substitution engine and budget
+//
+// Inputs       : set - the passages of the band
+//                tuning - the parameters to fill (max_length set by caller)
+// Outputs      : 0 if successful, -1 if failure
+static int calibrateBand(const struct CalibrationSet *set, cs642Tuning *tuning) {
+  // Confirmation threshold of the ROTX and Vigenere decryptions
+  int best_solved = -1;
+  double best_seconds = 0.0;
+  int threshold = tuning->word_threshold;
+  for (int t = 0; t < CALIBRATION_THRESHOLDS; t++) {
+    double rotx_seconds, vige_seconds;
+    tuning->word_threshold = calibration_thresholds[t];
+    int rotx = measureCipher(CIPHER_ROTX, set, tuning, &rotx_seconds);
+    int vige = measureCipher(CIPHER_VIGE, set, tuning, &vige_seconds);
+    if (rotx < 0 || vige < 0) {
+      return (-1);
+    }
+    if (betterMeasurement(rotx + vige, rotx_seconds + vige_seconds, best_solved, best_seconds)) {
+      best_solved = rotx + vige;
+      best_seconds = rotx_seconds + vige_seconds;
+      threshold = calibration_thresholds[t];
+    }
+  }
+  tuning->word_threshold = threshold;
+  logMessage(LOG_INFO_LEVEL, "Calibration %d chars: ROTX/VIGE threshold %d solves %d/%d (%.4fs).", set->length,
+             threshold, best_solved, 2 * set->count, best_seconds);
+
+  // Vigenere period range (a narrower one only wins if it loses no passage)
+  int range = 0;
+  best_solved = -1;
+  for (int r = 0; r < CALIBRATION_PERIODS; r++) {
+    cs642Tuning trial = *tuning;
+    double seconds;
+    trial.vige_min_period = calibration_periods[r][0];
+    trial.vige_max_period = calibration_periods[r][1];
+    int solved = measureCipher(CIPHER_VIGE, set, &trial, &seconds);
+    if (solved < 0) {
+      return (-1);
+    }
+    if (betterMeasurement(solved, seconds, best_solved, best_seconds)) {
+      best_solved = solved;
+      best_seconds = seconds;
+      range = r;
+    }
+  }
+  tuning->vige_min_period = calibration_periods[range][0];
+  tuning->vige_max_period = calibration_periods[range][1];
+  logMessage(LOG_INFO_LEVEL, "Calibration %d chars: VIGE periods %d-%d solve %d/%d (%.4fs).", set->length,
+             tuning->vige_min_period, tuning->vige_max_period, best_solved, set->count, best_seconds);
+
+  // Substitution engine and budget
+  int parallel = cs642GetTopology()->cpus > 1, chosen = 0;
+  best_solved = -1;
+  for (int c = 0; c < SUBS_CANDIDATES; c++) {
+    const struct SubsCandidate *candidate = &subs_candidates[c];
+    if (candidate->parallel && !parallel) {
+      continue;
+    }
+    cs642Tuning trial = *tuning;
+    double seconds;
+    trial.subs_engine = candidate->engine;
+    trial.max_attempts = candidate->max_attempts;
+    trial.match_distance = candidate->match_distance;
+    trial.increment_value = candidate->increment_value;
+    trial.beam_width = candidate->beam_width;
+    trial.anneal_steps = candidate->anneal_steps;
+    trial.anneal_restarts = candidate->anneal_restarts;
+    int solved = measureCipher(CIPHER_SUBS, set, &trial, &seconds);
+    if (solved < 0) {
+      return (-1);
+    }
+    logMessage(LOG_INFO_LEVEL, "Calibration %d chars: SUBS setting %d solves %d/%d (%.4fs).", set->length, c,
+               solved, set->count, seconds);
+    if (betterMeasurement(solved, seconds, best_solved, best_seconds)) {
+      best_solved = solved;
+      best_seconds = seconds;
+      chosen = c;
+      *tuning = trial;
+    }
+  }
+  logMessage(LOG_INFO_LEVEL, "Calibration %d chars: SUBS setting %d chosen.", set->length, chosen);
+  return (0);
+}
+
+// Returns the thread count tried after threads (powers of two, then every
+// CPU), or 0 once every count up to cpus was tried
+static int nextThreadCount(int threads, int cpus) {
+  if (threads >= cpus) {
+    return (0);
+  }
+  return ((threads * 2 < cpus) ? threads * 2 : cpus);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : calibrateCountThreads
+// Description  : Times the counting of a text large enough to be split (made
+//                by repeating the corpus) with every thread count
+//
+// Inputs       : corpus - the normalized corpus
+//                corpus_length - its length
+//                cpus - the CPUs the process may run on
+// Outputs      : the fastest thread count, -1 if failure
+static int calibrateCountThreads(const char *corpus, int corpus_length, int cpus) {
+  char *text = malloc(CALIBRATION_COUNT_BYTES);
+  cs642TextCounts *counts = malloc(sizeof(cs642TextCounts));
+  if (text == NULL || counts == NULL || corpus_length < 1) {
+    free(text);
+    free(counts);
+    return (-1);
+  }
+  for (int used = 0; used < CALIBRATION_COUNT_BYTES; used += corpus_length) {
+    int chunk = CALIBRATION_COUNT_BYTES - used;
+    memcpy(text + used, corpus, (chunk < corpus_length) ? chunk : corpus_length);
+  }
+
+  int chosen = 1;
+  double best_seconds = 0.0;
+  for (int threads = 1; threads > 0; threads = nextThreadCount(threads, cpus)) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < CALIBRATION_COUNT_REPEATS; r++) {
+      cs642InitTextCounts(counts);
+      cs642CountText(counts, text, CALIBRATION_COUNT_BYTES, threads);
+    }
+    double seconds = secondsSince(&start);
+    logMessage(LOG_INFO_LEVEL, "Calibration: counting %d MB with %d thread(s) takes %.4fs.",
+               CALIBRATION_COUNT_BYTES >> 20, threads, seconds / CALIBRATION_COUNT_REPEATS);
+    if (threads == 1 || seconds < best_seconds * CALIBRATION_MARGIN) {
+      chosen = threads;
+      best_seconds = seconds;
+    }
+  }
+  free(text);
+  free(counts);
+  return (chosen);
+}
+
+// Worker of a throughput trial: analyzes the next passage until none is left
+static void *workerTrialStage(void *arg) {
+  struct WorkerTrial *trial = arg;
+  const struct CalibrationSet *set = trial->set;
+  char *plaintext = malloc(set->length + 1);
+  char key[64];
+  if (plaintext == NULL) {
+    __atomic_store_n(&trial->failed, 1, __ATOMIC_RELAXED);
+    return (NULL);
+  }
+  int job;
+  while ((job = __atomic_fetch_add(&trial->next, 1, __ATOMIC_RELAXED)) < trial->jobs) {
+    cs642Cipher cipher = (cs642Cipher)(job % CIPHER_UNK);
+    memset(plaintext, 0x00, set->length + 1);
+    memset(key, 0x00, sizeof(key));
+    analyzeSample(cipher, set->ciphertexts[cipher][(job / CIPHER_UNK) % set->count], set->length, plaintext, key);
+  }
+  free(plaintext);
+  return (NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : calibrateWorkers
+// Description  : Times the same analyses (every cipher of every passage,
+//                repeated so the largest count keeps each worker busy) run by
+//                every number of concurrent workers, as the pipeline would
+//
+// Inputs       : set - the passages
+//                cpus - the CPUs the process may run on
+// Outputs      : the fastest number of workers, -1 if failure
+static int calibrateWorkers(const struct CalibrationSet *set, int cpus) {
+  pthread_t threads[CALIBRATION_MAX_WORKERS];
+  int analyses = CIPHER_UNK * set->count, rounds = 1;
+  if (cpus > CALIBRATION_MAX_WORKERS) {
+    cpus = CALIBRATION_MAX_WORKERS;
+  }
+  while (analyses * rounds < cpus * CALIBRATION_WORKER_ROUNDS || analyses * rounds < CALIBRATION_WORKER_ANALYSES) {
+    rounds++;
+  }
+
+  int chosen = 1;
+  double best_seconds = 0.0;
+  for (int workers = 1; workers > 0; workers = nextThreadCount(workers, cpus)) {
+    struct WorkerTrial trial = {set, analyses * rounds, 0, 0};
+    struct timespec start;
+    int started = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (started < workers && pthread_create(&threads[started], NULL, workerTrialStage, &trial) == 0) {
+      started++;
+    }
+    for (int w = 0; w < started; w++) {
+      pthread_join(threads[w], NULL);
+    }
+    double seconds = secondsSince(&start);
+    if (started < workers || trial.failed) {
+      return (-1);
+    }
+    logMessage(LOG_INFO_LEVEL, "Calibration: %d analyses with %d worker(s) take %.4fs.", trial.jobs, workers,
+               seconds);
+    if (workers == 1 || seconds < best_seconds * CALIBRATION_MARGIN) {
+      chosen = workers;
+      best_seconds = seconds;
+    }
+  }
+  return (chosen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cs642CalibrateTuning
+// Description  : Measures the engines on passages of every band length and
+//                installs the profile of the best settings
+//
+// Inputs       : corpus - the corpus file the passages are cut from
+//                samples - the passages per band (1 to 16)
+//                profile - the place to put the tuned profile
+// Outputs      : 0 if successful, -1 if failure
+int cs642CalibrateTuning(const char *corpus, int samples, cs642TuningProfile *profile) {
+  if (samples < 1 || samples > CALIBRATION_MAX_SAMPLES) {
+    return (-1);
+  }
+  int corpus_length = 0;
+  char *text = readCorpus(corpus, &corpus_length);
+  if (text == NULL) {
+    logMessage(LOG_ERROR_LEVEL, "Unable to read calibration corpus [%s].", corpus);
+    return (-1);
+  }
+
+  int cpus = cs642GetTopology()->cpus;
+  cs642TuningProfile tuned = {0, 0, {{0}}};
+  uint64_t random = CALIBRATION_SEED;
+  int failed = 0;
+  for (int b = 0; b < CALIBRATION_BANDS && !failed; b++) {
+    struct CalibrationSet set;
+    if (buildCalibrationSet(text, corpus_length, calibration_lengths[b], samples, &random, &set)) {
+      logMessage(LOG_WARNING_LEVEL, "Corpus too short for %d character passages.", calibration_lengths[b]);
+      continue;
+    }
+    cs642Tuning *tuning = &tuned.band[tuned.bands];
+    cs642DefaultTuning(tuning);
+    failed = calibrateBand(&set, tuning);
+    tuning->max_length = calibration_lengths[b];
+    tuned.bands += !failed;
+    freeCalibrationSet(&set);
+  }
+
+  // Counting threads: only texts past a slice (1 MB) are ever split, and those
+  // fall in the last band, so the others keep the default
+  if (!failed && tuned.bands > 0) {
+    int threads = calibrateCountThreads(text, corpus_length, cpus);
+    failed = (threads < 0);
+    tuned.band[tuned.bands - 1].count_threads = threads;
+  }
+
+  // Pipeline workers, timed on the tuned engines with the longest passages
+  struct CalibrationSet set;
+  if (!failed && tuned.bands > 0 && cs642SetTuningProfile(&tuned) == 0 &&
+      buildCalibrationSet(text, corpus_length, tuned.band[tuned.bands - 1].max_length, samples, &random, &set) == 0) {
+    tuned.workers = calibrateWorkers(&set, cpus);
+    failed = (tuned.workers < 0);
+    freeCalibrationSet(&set);
+  }
+  free(text);
+
+  if (failed || tuned.bands == 0 || cs642SetTuningProfile(&tuned)) {
+    cs642SetTuningProfile(NULL);
+    return (-1);
+  }
+  logMessage(LOG_INFO_LEVEL, "Calibration: %d pipeline worker(s), %d counting thread(s).", tuned.workers,
+             tuned.band[tuned.bands - 1].count_threads);
+  *profile = *cs642GetTuningProfile();
+  return (0);
+}
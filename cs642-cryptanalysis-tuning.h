@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cs642-cryptanalysis-tuning.h
+//  Description    : This is an include file for the engine tuning of the cs642
+//                   first project: the search parameters, thresholds, budgets
+//                   and thread counts the engines read, chosen by ciphertext
+//                   length from a profile, and the calibration that measures
+//                   them on this host and writes the profile.
+//
+//   Author        : Benjamin Miller
+//   Last Modified : 03 / 11 / 2024
+//
+
+// Include Files
+#include <stdint.h>
+
+// Defines
+#define CS642_TUNING_MAX_BANDS 8
+
+//
+// Type definitions
+
+// Engines cs642PerformSUBSCryptanalysis can run when nothing else is configured
+enum cs642SubsEngine {
+  CS642_SUBS_SWAP = 0,      // Frequency matching and n-gram swap search
+  CS642_SUBS_BEAM = 1,      // Beam search over partial keys
+  CS642_SUBS_ANNEAL = 2,    // Simulated annealing
+  CS642_SUBS_PORTFOLIO = 3, // Race of several engines
+  CS642_SUBS_ENGINES = 4
+};
+
+// Define struct and type for the parameters of one band of ciphertext lengths
+struct cs642Tuning {
+  int max_length;         // Longest ciphertext of the band (0 = any length)
+  int max_attempts;       // Swap search: keys tried per phase (the monogram phase tries 3x)
+  double increment_value; // Swap search: matching distance added per threshold step
+  double match_distance;  // Swap search: frequency distance under which letters match
+  int word_threshold;     // Dictionary words that confirm a ROTX/Vigenere decryption
+  int vige_min_period;    // Shortest Vigenere period tried (at least 6)
+  int vige_max_period;    // Longest Vigenere period tried (at most 11)
+  int subs_engine;        // Substitution engine (a cs642SubsEngine)
+  int beam_width;         // Beam width (0 = default)
+  int anneal_steps;       // Swaps per annealing run (0 = default)
+  int anneal_restarts;    // Annealing runs (0 = default)
+  int portfolio_engines;  // Engines raced (0 = all)
+  int count_threads;      // Threads counting the ciphertext statistics (0 = online CPUs)
+};
+typedef struct cs642Tuning cs642Tuning;
+
+// Define struct and type for a tuning profile
+struct cs642TuningProfile {
+  int workers;                              // Pipeline workers (0 = online CPUs)
+  int bands;                                // Bands in use
+  cs642Tuning band[CS642_TUNING_MAX_BANDS]; // By ascending max_length, the last of any length
+};
+typedef struct cs642TuningProfile cs642TuningProfile;
+
+//
+// Tuning functions
+
+void cs642DefaultTuning(cs642Tuning *tuning);
+// Fills the built-in parameters (those the engines use without a profile)
+
+const cs642Tuning *cs642GetTuning(int clen);
+// Returns the parameters of the band a ciphertext of clen characters falls in
+
+const cs642TuningProfile *cs642GetTuningProfile(void);
+// Returns the profile in use (the built-in one has a single band)
+
+int cs642SetTuningProfile(const cs642TuningProfile *profile);
+// Validates and installs a profile (NULL restores the built-in one). Call it
+// before any analysis starts. Returns 0 if successful, -1 if invalid.
+
+int cs642LoadTuningProfile(const char *path);
+// Reads a profile written by cs642SaveTuningProfile and installs it. Returns 0
+// if successful, -1 if the file cannot be read or is invalid.
+
+int cs642SaveTuningProfile(const char *path, const cs642TuningProfile *profile);
+// Writes a profile as text ("band <max_length>" then one "<name> <value>" line
+// per parameter). Returns 0 if successful, -1 if failure.
+
+int cs642CalibrateTuning(const char *corpus, int samples, cs642TuningProfile *profile);
+// Encrypts samples passages of each band length taken from the corpus (e.g.
+// pg11.txt) under random keys of every cipher and times the engines on them
+// under each candidate setting, keeping per band the setting that solves the
+// most samples, then the fastest. The counting threads are timed on a text of
+// several MB and the pipeline workers on concurrent analyses of the longest
+// passages, each count up to the online CPUs. The dictionary must be loaded
+// (cs642StudentInit). Installs the tuned profile and fills profile. Returns 0
+// if successful, -1 if failure.
@@ -15,19 +15,42 @@
 #include <unistd.h>
 
 // Project Include Files
+#include "cs642-cryptanalysis-counts.h"
 #include "cs642-cryptanalysis-impl.h"
+#include "cs642-cryptanalysis-kernels.h"
+#include "cs642-cryptanalysis-pipeline.h"
+#include "cs642-cryptanalysis-profile.h"
 #include "cs642-cryptanalysis-support.h"
+#include "cs642-cryptanalysis-topology.h"
+#include "cs642-cryptanalysis-tuning.h"
 
 // Defines
-#define cs642_CRYPTANALYSIS_ARGUMENTS "vuh"
+#define cs642_CRYPTANALYSIS_ARGUMENTS "vuhw:k:i:rb:pe:a:s:t:T:"
 #define cs642_CRYPTANALYSIS_USAGE                                              \
   "\n"                                                                         \
-  "  cryptanalysis -c <cipher> [-v] [-u] [-h]\n\n"                             \
+  "  cryptanalysis -c <cipher> [-v] [-u] [-h] [-w <workers>]\n"                \
+  "                [-k <prefix> [-i <seconds>] [-r]] [-b <width>] [-p]\n"       \
+  "                [-e <engines>] [-a <steps> [-s <seed>]]\n"                  \
+  "                [-t <profile> | -T <profile>]\n\n"                          \
   "  where:\n"                                                                 \
   "     -u - runs the unit test (no cipher needed)\n"                          \
   "     -v - verbose mode (display all logging messages)\n"                    \
-  "     -h - displays this help message, and returns\n\n"
+  "     -h - displays this help message, and returns\n"                         \
+  "     -w - number of analysis workers (default: online CPUs)\n"              \
+  "     -k - save substitution search checkpoints to <prefix>.<hash>\n"        \
+  "     -i - seconds between checkpoints (default: 30)\n"                      \
+  "     -r - resume substitution searches from their checkpoints\n"            \
+  "     -b - solve substitution ciphers by beam search of this width\n"        \
+  "     -p - profile every engine and search phase (hardware counters)\n"     \
+  "     -e - race this many substitution engines, first confirmed key wins\n" \
+  "     -a - solve substitution ciphers by annealing, this many swaps a run\n" \
+  "     -s - seed of the annealing generator (default: the clock)\n"           \
+  "     -t - load the engine tuning profile from this file\n"                  \
+  "     -T - calibrate the engines on this host, write the profile, exit\n\n"
 #define CS642_CRYPTANALYSIS_TESTS 3
+#define CS642_CHECKPOINT_INTERVAL 30.0
+#define CS642_CALIBRATION_CORPUS "pg11.txt"
+#define CS642_CALIBRATION_SAMPLES 4
 
 // This is the file table
 
@@ -51,9 +74,12 @@ uint32_t CipherVerboseLevel;
 int main(int argc, char *argv[]) {
 
   // Local variables
-  int ch, log_initialized = 0, unit_tests = 0, keylen, i, clen;
-  char *ciphertext, *plaintext, *key;
-  cs642Cipher cipher = CIPHER_UNK;
+  int ch, log_initialized = 0, unit_tests = 0;
+  int workers = cs642DefaultPipelineWorkers(), workers_given = 0;
+  int resume = 0, beam_width = 0, profile = 0;
+  cs642AnnealSchedule anneal = {0, 0, 0, 0, 0};
+  char *checkpoint_prefix = NULL, *tuning_path = NULL, *calibration_path = NULL;
+  double checkpoint_interval = CS642_CHECKPOINT_INTERVAL;
 
   // Process the command line parameters
   while ((ch = getopt(argc, argv, cs642_CRYPTANALYSIS_ARGUMENTS)) != -1) {
@@ -66,6 +92,70 @@ int main(int argc, char *argv[]) {
       unit_tests = 1;
       break;
 
+    case 'w': // Analysis workers
+      workers = atoi(optarg);
+      if (workers < 1) {
+        fprintf(stderr, "Invalid worker count (%s), aborting.\n", optarg);
+        return (-1);
+      }
+      workers_given = 1;
+      break;
+
+    case 'k': // Checkpoint prefix
+      checkpoint_prefix = optarg;
+      break;
+
+    case 'i': // Checkpoint interval
+      checkpoint_interval = atof(optarg);
+      if (checkpoint_interval <= 0) {
+        fprintf(stderr, "Invalid checkpoint interval (%s), aborting.\n", optarg);
+        return (-1);
+      }
+      break;
+
+    case 'r': // Resume from checkpoints
+      resume = 1;
+      break;
+
+    case 'b': // Substitution beam width
+      beam_width = atoi(optarg);
+      if (cs642ConfigureSUBSBeam(beam_width) || beam_width == 0) {
+        fprintf(stderr, "Invalid beam width (%s), aborting.\n", optarg);
+        return (-1);
+      }
+      break;
+
+    case 'e': // Substitution portfolio
+      if (cs642ConfigureSUBSPortfolio(atoi(optarg)) || atoi(optarg) == 0) {
+        fprintf(stderr, "Invalid engine count (%s), aborting.\n", optarg);
+        return (-1);
+      }
+      break;
+
+    case 'a': // Substitution annealing steps
+      anneal.steps = atol(optarg);
+      if (anneal.steps <= 0) {
+        fprintf(stderr, "Invalid annealing steps (%s), aborting.\n", optarg);
+        return (-1);
+      }
+      break;
+
+    case 's': // Annealing seed
+      anneal.seed = strtoull(optarg, NULL, 0);
+      break;
+
+    case 't': // Tuning profile
+      tuning_path = optarg;
+      break;
+
+    case 'T': // Calibrate a tuning profile
+      calibration_path = optarg;
+      break;
+
+    case 'p': // Profiling mode
+      profile = 1;
+      break;
+
     case 'h': // Help Flag
       fprintf(stderr, cs642_CRYPTANALYSIS_USAGE);
       return (0);
@@ -89,10 +179,17 @@ int main(int argc, char *argv[]) {
 
   // Run the unit tests
   if (unit_tests) {
-    if (cs642CipherUnittest()) {
+    if (cs642CipherUnittest() || cs642KernelSelfTest() || cs642CountSelfTest()) {
       fprintf(stderr, "Unit tests failed, aborting.\n");
       return (-1);
     }
+
+    // The crib checks decrypt, so they need the dictionary
+    cs642StartProject();
+    if (cs642StudentInit() || cs642CribSelfTest() || cs642StudentCleanUp()) {
+      fprintf(stderr, "Crib self-test failed, aborting.\n");
+      return (-1);
+    }
   } else {
 
     // Run the cryptanalysis tests
@@ -108,59 +205,66 @@ int main(int argc, char *argv[]) {
     } else {
       logMessage(LOG_OUTPUT_LEVEL, "cs642StudentInit succeeded");
     }
+    logMessage(LOG_INFO_LEVEL, "Using %s analysis kernels.", cs642GetKernels()->name);
+    cs642LogTopology();
 
-    for (cipher = CIPHER_ROTX; cipher < CIPHER_UNK; cipher++) {
-      for (i = 0; i < CS642_CRYPTANALYSIS_TESTS; i++) {
-
-        // Get the ciphertext, create space for key and plaintext
-        ciphertext = cs642GetCiphertextSample(cipher);
-        clen = strlen(ciphertext);
-        plaintext = malloc(clen + 1);
-        memset(plaintext, 0x00, clen + 1);
-        keylen = cs642GetCipherKeyLength(cipher);
-        key = malloc(keylen + 1);
-        memset(key, 0x00, keylen + 1);
-
-        // Perform the cryptanalysis
-        switch (cipher) {
-        case CIPHER_ROTX:
-          cs642PerformROTXCryptanalysis(ciphertext, clen, plaintext, clen,
-                                        (uint8_t *)key);
-          break;
-        case CIPHER_VIGE:
-          cs642PerformVIGECryptanalysis(ciphertext, clen, plaintext, clen, key);
-          break;
-        case CIPHER_SUBS:
-          cs642PerformSUBSCryptanalysis(ciphertext, clen, plaintext, clen, key);
-          break;
-        default:
-          logMessage(LOG_ERROR_LEVEL, "Unknown cipher (%d) in cryptanalysis.",
-                     cipher);
-          break;
-        }
-
-        // Now check result
-        if (cs642CheckPlaintext(cipher, plaintext, ciphertext, key)) {
-          logMessage(
-              LOG_ERROR_LEVEL,
-              "Cryptanalysis %d/%d failed for cipher (%s), aborting program.",
-              i + 1, CS642_CRYPTANALYSIS_TESTS, cs642CipherStrings[cipher]);
-          exit(-1);
-        } else {
-          logMessage(LOG_OUTPUT_LEVEL,
-                     "Cryptanalysis %d/%d succeeded for cipher (%s).", i + 1,
-                     CS642_CRYPTANALYSIS_TESTS, cs642CipherStrings[cipher]);
-        }
-
-        // Clean up the memory
-        free(plaintext);
-        plaintext = NULL;
-        free(key);
-        key = NULL;
-        free(ciphertext);
-        ciphertext = NULL;
+    // Measure the engines and write their profile, or load one
+    if (calibration_path != NULL) {
+      cs642TuningProfile tuned;
+      if (cs642CalibrateTuning(CS642_CALIBRATION_CORPUS, CS642_CALIBRATION_SAMPLES, &tuned) ||
+          cs642SaveTuningProfile(calibration_path, &tuned)) {
+        logMessage(LOG_ERROR_LEVEL, "Calibration failed, aborting.");
+        exit(-1);
+      }
+      logMessage(LOG_OUTPUT_LEVEL, "Tuning profile with %d band(s) written to [%s].", tuned.bands,
+                 calibration_path);
+      cs642StudentCleanUp();
+      return (0);
+    }
+    if (tuning_path != NULL) {
+      if (cs642LoadTuningProfile(tuning_path)) {
+        logMessage(LOG_ERROR_LEVEL, "Unable to load tuning profile, aborting.");
+        exit(-1);
+      }
+      if (!workers_given && cs642GetTuningProfile()->workers > 0) {
+        workers = cs642GetTuningProfile()->workers;
       }
     }
+    if (resume && checkpoint_prefix == NULL) {
+      logMessage(LOG_ERROR_LEVEL, "Resuming needs a checkpoint prefix (-k), aborting.");
+      exit(-1);
+    }
+    if (cs642ConfigureSUBSCheckpoint(checkpoint_prefix, checkpoint_interval, resume)) {
+      logMessage(LOG_ERROR_LEVEL, "Invalid checkpoint prefix, aborting.");
+      exit(-1);
+    }
+    if (anneal.steps > 0) {
+      cs642ConfigureSUBSAnneal(&anneal);
+    }
+    if (profile && cs642EnableProfiling() == 0) {
+      logMessage(LOG_WARNING_LEVEL,
+                 "Hardware counters unavailable, profiling wall-clock time only.");
+    }
+
+    // Acquire, analyze and verify the samples through the pipeline
+    if (cs642RunCryptanalysisPipeline(workers, CS642_CRYPTANALYSIS_TESTS)) {
+      logMessage(LOG_ERROR_LEVEL, "Cryptanalysis pipeline failed, aborting.");
+      exit(-1);
+    }
+
+    // Report where the model construction time went
+    cs642ModelTimings timings;
+    if (cs642GetModelTimings(&timings) == 0) {
+      logMessage(LOG_INFO_LEVEL,
+                 "Model build: dictionary copy %.4fs, letters %.4fs, n-grams %.4fs, trie %.4fs",
+                 timings.dictionary_copy, timings.letter_model,
+                 timings.ngram_model, timings.word_trie);
+    }
+    if (profile) {
+      cs642Profile totals;
+      cs642GetProfileTotals(&totals);
+      cs642LogProfile("total", &totals);
+    }
     cs642CleanCipherStructures(); // Clean up the cipher structures
     if (cs642StudentCleanUp()) {
       logMessage(LOG_ERROR_LEVEL,